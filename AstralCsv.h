@@ -0,0 +1,283 @@
+/*
+ * AstralCsv.h
+ *
+ * ------------------------------------------------------------
+ * Purpose:
+ *     Fast reader for the ASTRAL CMM CSV export, e.g.
+ *
+ *         Tue Oct  7 15:37:22 2025
+ *         POINT,X,Y,Z,I,J,K
+ *         1,10,10,0.045,0.004,0.009,1
+ *         ...
+ *
+ *     The file is memory mapped and parsed in place with
+ *     std::from_chars straight into the PointCloud columns: no
+ *     per-line std::string, no iostreams.
+ *
+ * Overview:
+ *     1. Map the file (MappedFile.h).
+ *     2. Locate the "POINT,X,Y,Z[,I,J,K]" header within the first
+ *        kMaxPreambleLines lines; the column order is taken from it.
+ *     3. Count the remaining lines once to reserve every column.
+ *     4. Parse each row; rows that cannot be parsed are reported
+ *        with their line number on the given log (std::cerr by
+ *        default) and skipped.
+ *
+ * Usage:
+ *     #include "AstralCsv.h"
+ *
+ *     AstralCsv::Report rep;
+ *     PointCloud cloud = AstralCsv::read("scan.csv", &rep);   // or (..., &rep, log)
+ *     if (!rep.headerFound) cloud = readPointCloud("scan.csv");
+ *
+ * Notes:
+ *     The I/J/K normal columns are optional; POINT labels must be
+ *     integers.  When the standard library lacks floating-point
+ *     from_chars (older libc++), numbers go through strtod on a
+ *     small stack copy of the field instead.
+ *
+ * ------------------------------------------------------------
+ * Author:    Luciano Ristori
+ * Created:   Oct 2025
+ * License:   MIT / open use
+ * ------------------------------------------------------------
+ */
+
+#ifndef ASTRAL_CSV_H
+#define ASTRAL_CSV_H
+
+#include <charconv>
+#include <cstring>
+#include <cstdlib>
+#include <cctype>
+#include <string>
+#include <iostream>
+#include <algorithm>
+
+#include "MappedFile.h"
+#include "PointCloud.h"
+
+namespace AstralCsv {
+
+enum Column { kPoint = 0, kX, kY, kZ, kI, kJ, kK, kNumColumns };
+
+constexpr size_t kMaxPreambleLines = 64;   // header must appear within these lines
+constexpr size_t kMaxReportedErrors = 20;  // further bad rows are only counted
+constexpr int kMaxFields = 32;             // fields beyond this are ignored
+
+struct Header {
+    int index[kNumColumns] = {-1, -1, -1, -1, -1, -1, -1};
+    int nFields = 0;
+    int fieldColumn[kMaxFields];   // field position -> Column, -1 if unused
+    int nUsedFields = 0;           // fields to scan per row (last used + 1)
+    int nNeeded = 0;               // recognized columns per row
+
+    bool valid() const { return index[kX] >= 0 && index[kY] >= 0 && index[kZ] >= 0; }
+    bool hasLabels() const { return index[kPoint] >= 0; }
+    bool hasNormals() const { return index[kI] >= 0 && index[kJ] >= 0 && index[kK] >= 0; }
+};
+
+struct Report {
+    bool headerFound = false;
+    size_t headerLine = 0;     // 1-based line number of the header
+    size_t rows = 0;           // rows stored in the cloud
+    size_t rejected = 0;       // rows that could not be parsed
+};
+
+// --- Trim blanks and the CR of CRLF line endings ---
+inline void trim(const char *&b, const char *&e)
+{
+    while (b < e && (*b == ' ' || *b == '\t')) ++b;
+    while (e > b && (e[-1] == ' ' || e[-1] == '\t' || e[-1] == '\r')) --e;
+}
+
+inline bool parseDouble(const char *b, const char *e, double &v)
+{
+    trim(b, e);
+    if (b < e && *b == '+') ++b;
+    if (b == e) return false;
+#if defined(__cpp_lib_to_chars) && __cpp_lib_to_chars >= 201611L
+    auto r = std::from_chars(b, e, v);
+    return r.ec == std::errc() && r.ptr == e;
+#else
+    char tmp[64];
+    size_t len = static_cast<size_t>(e - b);
+    if (len >= sizeof(tmp)) return false;
+    std::memcpy(tmp, b, len);
+    tmp[len] = '\0';
+    char *stop = nullptr;
+    v = std::strtod(tmp, &stop);
+    return stop == tmp + len;
+#endif
+}
+
+inline bool parseLong(const char *b, const char *e, long &v)
+{
+    trim(b, e);
+    if (b < e && *b == '+') ++b;
+    if (b == e) return false;
+    auto r = std::from_chars(b, e, v);
+    return r.ec == std::errc() && r.ptr == e;
+}
+
+// ------------------------------------------------------------
+// parseHeader()
+//   Recognizes "POINT,X,Y,Z,I,J,K" (any order, case-insensitive).
+// ------------------------------------------------------------
+inline bool parseHeader(const char *b, const char *e, Header &h)
+{
+    static const char *names[kNumColumns] = {"POINT", "X", "Y", "Z", "I", "J", "K"};
+    Header hdr;
+    int field = 0;
+    const char *f = b;
+    while (f <= e) {
+        const char *fe = static_cast<const char *>(std::memchr(f, ',', e - f));
+        if (!fe) fe = e;
+        const char *tb = f, *te = fe;
+        trim(tb, te);
+        for (int c = 0; c < kNumColumns; ++c) {
+            size_t len = std::strlen(names[c]);
+            if (static_cast<size_t>(te - tb) != len) continue;
+            bool same = true;
+            for (size_t q = 0; q < len; ++q)
+                if (std::toupper(static_cast<unsigned char>(tb[q])) != names[c][q]) { same = false; break; }
+            if (same && hdr.index[c] < 0) hdr.index[c] = field;
+        }
+        ++field;
+        f = fe + 1;
+    }
+    hdr.nFields = field;
+    if (!hdr.valid()) return false;
+
+    for (int q = 0; q < kMaxFields; ++q) hdr.fieldColumn[q] = -1;
+    for (int c = 0; c < kNumColumns; ++c) {
+        if (hdr.index[c] < 0) continue;
+        if (hdr.index[c] >= kMaxFields) {
+            if (c == kX || c == kY || c == kZ) return false;
+            hdr.index[c] = -1;
+            continue;
+        }
+        hdr.fieldColumn[hdr.index[c]] = c;
+        hdr.nUsedFields = std::max(hdr.nUsedFields, hdr.index[c] + 1);
+        ++hdr.nNeeded;
+    }
+    h = hdr;
+    return true;
+}
+
+// ------------------------------------------------------------
+// parseRow()
+//   Splits one data line on commas and converts the columns named
+//   in the header.  out[] is indexed by Column.  Returns false if a
+//   needed field is missing or not a number.
+// ------------------------------------------------------------
+inline bool parseRow(const char *b, const char *e, const Header &h,
+                     double out[kNumColumns], long &label)
+{
+    int field = 0, found = 0;
+    const char *f = b;
+    while (f <= e && field < h.nUsedFields) {
+        const char *fe = static_cast<const char *>(std::memchr(f, ',', e - f));
+        if (!fe) fe = e;
+        int c = h.fieldColumn[field];
+        if (c == kPoint) {
+            if (!parseLong(f, fe, label)) return false;
+            ++found;
+        } else if (c >= 0) {
+            if (!parseDouble(f, fe, out[c])) return false;
+            ++found;
+        }
+        ++field;
+        f = fe + 1;
+    }
+    return found == h.nNeeded;
+}
+
+// ------------------------------------------------------------
+// read()
+//   Loads an ASTRAL CSV into a PointCloud.  If no header is found
+//   the returned cloud is empty and report->headerFound is false,
+//   so the caller can fall back to the generic reader.  Open
+//   errors and unparsable rows are reported on log.
+// ------------------------------------------------------------
+inline PointCloud read(const std::string &filename, Report *report = nullptr,
+                       std::ostream &log = std::cerr)
+{
+    PointCloud cloud;
+    Report rep;
+
+    MappedFile file(filename);
+    if (!file.ok()) {
+        log << "Error: cannot open file " << filename << std::endl;
+        if (report) *report = rep;
+        return cloud;
+    }
+    const char *p = file.data();
+    const char *end = p + file.size();
+
+    // --- Locate header ---
+    Header hdr;
+    size_t lineNo = 0;
+    while (p < end && lineNo < kMaxPreambleLines) {
+        const char *eol = static_cast<const char *>(std::memchr(p, '\n', end - p));
+        if (!eol) eol = end;
+        ++lineNo;
+        const char *b = p, *e = eol;
+        p = (eol < end) ? eol + 1 : end;
+        trim(b, e);
+        if (parseHeader(b, e, hdr)) {
+            rep.headerFound = true;
+            rep.headerLine = lineNo;
+            break;
+        }
+    }
+    if (!rep.headerFound) {
+        if (report) *report = rep;
+        return cloud;
+    }
+
+    // --- Size columns once ---
+    size_t nLines = static_cast<size_t>(std::count(p, end, '\n')) + 1;
+    cloud.reserve(nLines, hdr.hasNormals(), hdr.hasLabels());
+
+    // --- Parse rows ---
+    double v[kNumColumns] = {0, 0, 0, 0, 0, 0, 0};
+    long label = 0;
+    while (p < end) {
+        const char *eol = static_cast<const char *>(std::memchr(p, '\n', end - p));
+        if (!eol) eol = end;
+        ++lineNo;
+        const char *b = p, *e = eol;
+        p = (eol < end) ? eol + 1 : end;
+        trim(b, e);
+        if (b == e) continue;
+
+        if (!parseRow(b, e, hdr, v, label)) {
+            if (rep.rejected < kMaxReportedErrors)
+                log << filename << ":" << lineNo
+                    << ": cannot parse row \"" << std::string(b, e) << "\"" << std::endl;
+            ++rep.rejected;
+            continue;
+        }
+        if (hdr.hasLabels()) cloud.label.push_back(label);
+        cloud.x.push_back(v[kX]);
+        cloud.y.push_back(v[kY]);
+        cloud.z.push_back(v[kZ]);
+        if (hdr.hasNormals()) {
+            cloud.i.push_back(v[kI]);
+            cloud.j.push_back(v[kJ]);
+            cloud.k.push_back(v[kK]);
+        }
+    }
+    rep.rows = cloud.size();
+    if (rep.rejected > kMaxReportedErrors)
+        log << filename << ": " << rep.rejected - kMaxReportedErrors
+            << " further unparsable rows not shown" << std::endl;
+
+    if (report) *report = rep;
+    return cloud;
+}
+
+} // namespace AstralCsv
+
+#endif // ASTRAL_CSV_H
@@ -0,0 +1,129 @@
+/*
+ * Binning.h
+ *
+ * ------------------------------------------------------------
+ * Purpose:
+ *     Chooses the number of bins and the range of the 1D histograms
+ *     in flatnessScan from the statistics already accumulated for
+ *     the scan, so histogram size follows the information content
+ *     rather than the physical size of the part.
+ *
+ * Policies (--binning=...):
+ *     fd        Freedman–Diaconis width 2·IQR·N^(-1/3), with the
+ *               IQR estimated as 1.349·σ (Gaussian)          [default]
+ *     um:W      fixed bin width of W microns
+ *     bins:N    fixed number of bins
+ *
+ *     Every policy is capped at maxBins (--max-bins=N, default 10000).
+ *
+ * Range:
+ *     [min - margin, max + margin] with margin = marginFraction·(max - min),
+ *     the convention flatnessScan has always used (marginFraction = 0.5).
+ *
+ * Usage:
+ *     #include "Binning.h"
+ *
+ *     Binning::Spec spec;
+ *     Binning::parse("um:5", spec);
+ *     Binning::Axis a = Binning::make(spec, zMin, zMax, zSigma, nPoints);
+ *     new TH1D("hZ", "...", a.nBins, a.lo, a.hi);
+ *
+ * ------------------------------------------------------------
+ * Author:    Luciano Ristori
+ * Created:   Oct 2025
+ * License:   MIT / open use
+ * ------------------------------------------------------------
+ */
+
+#ifndef BINNING_H
+#define BINNING_H
+
+#include <string>
+#include <cmath>
+#include <cstdlib>
+#include <cstddef>
+#include <algorithm>
+
+namespace Binning {
+
+enum class Policy { FreedmanDiaconis, FixedWidth, FixedCount };
+
+struct Spec {
+    Policy policy = Policy::FreedmanDiaconis;
+    double widthUm = 1.0;        // FixedWidth
+    int nBins = 100;             // FixedCount
+    int maxBins = 10000;         // cap for every policy
+    double marginFraction = 0.5; // range margin on each side
+};
+
+struct Axis {
+    int nBins = 1;
+    double lo = 0.0;
+    double hi = 1.0;
+};
+
+// ------------------------------------------------------------
+// parse()
+//   "fd", "um:<width>", "bins:<n>"; returns false if malformed.
+// ------------------------------------------------------------
+inline bool parse(const std::string &text, Spec &spec)
+{
+    auto number = [](const std::string &s, double &v) {
+        char *end = nullptr;
+        v = std::strtod(s.c_str(), &end);
+        return !s.empty() && end && *end == '\0' && v > 0.0;
+    };
+    double v = 0.0;
+    if (text == "fd") {
+        spec.policy = Policy::FreedmanDiaconis;
+        return true;
+    }
+    if (text.rfind("um:", 0) == 0 && number(text.substr(3), v)) {
+        spec.policy = Policy::FixedWidth;
+        spec.widthUm = v;
+        return true;
+    }
+    if (text.rfind("bins:", 0) == 0 && number(text.substr(5), v)) {
+        spec.policy = Policy::FixedCount;
+        spec.nBins = static_cast<int>(v + 0.5);
+        return spec.nBins > 0;
+    }
+    return false;
+}
+
+// ------------------------------------------------------------
+// make()
+//   Axis for values in [min, max] with standard deviation sigma
+//   over n entries (all in mm).
+// ------------------------------------------------------------
+inline Axis make(const Spec &spec, double min, double max, double sigma, size_t n)
+{
+    Axis a;
+    if (min == max) { min -= 0.5; max += 0.5; }
+    double margin = spec.marginFraction * (max - min);
+    a.lo = min - margin;
+    a.hi = max + margin;
+    double span = a.hi - a.lo;
+
+    double nb = 1.0;
+    switch (spec.policy) {
+    case Policy::FixedWidth:
+        nb = span / (spec.widthUm * 1e-3);
+        break;
+    case Policy::FixedCount:
+        nb = spec.nBins;
+        break;
+    case Policy::FreedmanDiaconis: {
+        double width = 2.0 * 1.349 * sigma / std::cbrt(double(std::max<size_t>(n, 1)));
+        nb = (width > 0.0) ? span / width : spec.maxBins;
+        break;
+    }
+    }
+    nb = std::min<double>(nb, spec.maxBins);
+    a.nBins = std::max(1, static_cast<int>(nb + 0.5));
+    return a;
+}
+
+} // namespace Binning
+
+#endif // BINNING_H
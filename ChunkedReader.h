@@ -0,0 +1,265 @@
+/*
+ * ChunkedReader.h
+ *
+ * ------------------------------------------------------------
+ * Purpose:
+ *     Out-of-core reader for point files larger than memory.  The
+ *     file is read through one fixed-size buffer and handed out as
+ *     successive PointCloud chunks, so memory stays bounded by the
+ *     chunk size whatever the number of points.
+ *
+ * Overview:
+ *     - Each next() reads up to chunkBytes, parses every complete
+ *       line into the caller's PointCloud (cleared, capacity kept)
+ *       and carries the trailing partial line over to the next read.
+ *     - The format is detected once on the first buffer: an ASTRAL
+ *       "POINT,X,Y,Z[,I,J,K]" header within the first
+ *       AstralCsv::kMaxPreambleLines lines selects AstralCsv::parseRow,
+ *       otherwise the generic layouts of PointCloud.h are accepted
+ *       (the first data line fixes the layout for the whole file).
+ *     - rewind() restarts at the first data line, for a second pass.
+ *     - Open errors and the first AstralCsv::kMaxReportedErrors
+ *       unparsable rows go to the log given on construction
+ *       (std::cerr by default).
+ *     - poll() is the tail -f variant for a file that is still being
+ *       written: it parses the complete lines appended since the last
+ *       call and keeps a partial last line until its newline arrives.
+ *       The format is still detected on construction, so construct
+ *       the reader once the header (if any) has been written; without
+ *       it the generic layouts apply, which include ASTRAL's default
+ *       POINT,X,Y,Z,I,J,K column order.
+ *
+ * Usage:
+ *     #include "ChunkedReader.h"
+ *
+ *     ChunkedReader in("huge.csv", 64 << 20);        // or (..., log)
+ *     PointCloud chunk;
+ *     while (in.next(chunk)) accumulate(chunk);
+ *     in.rewind();
+ *     while (in.next(chunk)) fill(chunk);
+ *
+ *     ChunkedReader tail("growing.csv", 1 << 20);
+ *     for (;;) { while (tail.poll(chunk)) update(chunk); wait(); }
+ *
+ * ------------------------------------------------------------
+ * Author:    Luciano Ristori
+ * Created:   Oct 2025
+ * License:   MIT / open use
+ * ------------------------------------------------------------
+ */
+
+#ifndef CHUNKED_READER_H
+#define CHUNKED_READER_H
+
+#include <vector>
+#include <string>
+#include <cstring>
+#include <cstddef>
+#include <iostream>
+#include <algorithm>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "PointCloud.h"
+#include "AstralCsv.h"
+
+class ChunkedReader {
+public:
+    static constexpr size_t kDefaultChunkBytes = size_t(64) << 20;
+
+    explicit ChunkedReader(const std::string &path, size_t chunkBytes = kDefaultChunkBytes,
+                           std::ostream &log = std::cerr)
+        : path_(path), log_(&log), buf_(std::max<size_t>(chunkBytes, 4096) + 1)
+    {
+        fd_ = ::open(path.c_str(), O_RDONLY);
+        if (fd_ < 0) {
+            *log_ << "Error: cannot open file " << path << std::endl;
+            return;
+        }
+        detectFormat();
+    }
+
+    ~ChunkedReader() {
+        if (fd_ >= 0) ::close(fd_);
+    }
+
+    ChunkedReader(const ChunkedReader &) = delete;
+    ChunkedReader &operator=(const ChunkedReader &) = delete;
+
+    bool ok() const { return fd_ >= 0; }
+    bool astral() const { return astral_; }
+    size_t rejected() const { return rejected_; }
+    size_t chunkBytes() const { return buf_.size() - 1; }
+
+    // Restart at the first data line (rejected() restarts as well)
+    void rewind() {
+        if (fd_ < 0) return;
+        ::lseek(fd_, dataOffset_, SEEK_SET);
+        begin_ = end_ = 0;
+        eof_ = false;
+        lineNo_ = dataLine_;
+        rejected_ = 0;
+    }
+
+    // Next chunk of points; false once the file is exhausted
+    bool next(PointCloud &chunk) {
+        chunk.clear();
+        while (chunk.empty()) {
+            if (!fill()) return false;
+
+            // Parse up to the last complete line; at EOF take everything
+            const char *b = buf_.data() + begin_;
+            const char *e = buf_.data() + end_;
+            const char *stop = e;
+            if (!eof_) {
+                while (stop > b && stop[-1] != '\n') --stop;
+                if (stop == b) {           // line longer than the buffer
+                    grow();
+                    continue;
+                }
+            }
+            parseLines(b, stop, chunk);
+            begin_ = static_cast<size_t>(stop - buf_.data());
+            if (eof_ && begin_ >= end_ && chunk.empty()) return false;
+        }
+        return true;
+    }
+
+    // Follow mode: one read of the data appended since the last call,
+    // complete lines parsed into chunk; false if the file has not grown
+    bool poll(PointCloud &chunk) {
+        chunk.clear();
+        if (fd_ < 0) return false;
+        if (begin_ > 0) {
+            std::memmove(buf_.data(), buf_.data() + begin_, end_ - begin_);
+            end_ -= begin_;
+            begin_ = 0;
+        }
+        if (end_ == buf_.size() - 1) grow();   // partial line as long as the buffer
+        ssize_t got = ::read(fd_, buf_.data() + end_, buf_.size() - 1 - end_);
+        if (got <= 0) return false;
+        end_ += static_cast<size_t>(got);
+        buf_[end_] = '\0';
+
+        const char *b = buf_.data();
+        const char *stop = b + end_;
+        while (stop > b && stop[-1] != '\n') --stop;
+        parseLines(b, stop, chunk);
+        begin_ = static_cast<size_t>(stop - b);
+        return true;
+    }
+
+private:
+    // Moves the carried-over partial line to the front and tops up the buffer
+    bool fill() {
+        if (eof_ && begin_ >= end_) return false;
+        if (begin_ > 0) {
+            std::memmove(buf_.data(), buf_.data() + begin_, end_ - begin_);
+            end_ -= begin_;
+            begin_ = 0;
+        }
+        while (!eof_ && end_ < buf_.size() - 1) {
+            ssize_t got = ::read(fd_, buf_.data() + end_, buf_.size() - 1 - end_);
+            if (got <= 0) { eof_ = true; break; }
+            end_ += static_cast<size_t>(got);
+        }
+        buf_[end_] = '\0';                 // stops strtod on a last line without '\n'
+        return end_ > begin_;
+    }
+
+    void grow() {
+        std::vector<char> bigger(2 * buf_.size() - 1);
+        std::memcpy(bigger.data(), buf_.data() + begin_, end_ - begin_);
+        end_ -= begin_;
+        begin_ = 0;
+        buf_.swap(bigger);
+    }
+
+    void detectFormat() {
+        fill();
+        const char *p = buf_.data(), *end = p + end_;
+        size_t line = 0;
+        while (p < end && line < AstralCsv::kMaxPreambleLines) {
+            const char *eol = static_cast<const char *>(std::memchr(p, '\n', end - p));
+            if (!eol) eol = end;
+            ++line;
+            const char *b = p, *e = eol;
+            p = (eol < end) ? eol + 1 : end;
+            AstralCsv::trim(b, e);
+            if (AstralCsv::parseHeader(b, e, hdr_)) {
+                astral_ = true;
+                dataOffset_ = static_cast<off_t>(p - buf_.data());
+                dataLine_ = line;
+                break;
+            }
+        }
+        rewind();
+    }
+
+    void parseLines(const char *p, const char *end, PointCloud &chunk) {
+        if (!astral_) {
+            // The first data line fixes the layout (PointCloud.h); every
+            // later line is parsed at its compile-time field count
+            double v[8];
+            while (layout_ == 0 && p < end) {
+                const char *eol = static_cast<const char *>(std::memchr(p, '\n', end - p));
+                if (!eol) eol = end;
+                int nv = parsePointLine(p, eol, v);
+                if (nv == 3 || nv == 4 || nv == 6 || nv == 7) { layout_ = nv; break; }
+                ++lineNo_;
+                p = (eol < end) ? eol + 1 : end;
+            }
+            withLayout(layout_, [&](auto layout) {
+                lineNo_ += ::parseLines<decltype(layout)>(p, end, chunk);
+            });
+            return;
+        }
+
+        double a[AstralCsv::kNumColumns] = {0, 0, 0, 0, 0, 0, 0};
+        long label = 0;
+        while (p < end) {
+            const char *eol = static_cast<const char *>(std::memchr(p, '\n', end - p));
+            if (!eol) eol = end;
+            ++lineNo_;
+            const char *b = p, *e = eol;
+            p = (eol < end) ? eol + 1 : end;
+
+            AstralCsv::trim(b, e);
+            if (b == e) continue;
+            if (!AstralCsv::parseRow(b, e, hdr_, a, label)) {
+                if (rejected_ < AstralCsv::kMaxReportedErrors)
+                    *log_ << path_ << ":" << lineNo_
+                          << ": cannot parse row \"" << std::string(b, e) << "\"" << std::endl;
+                ++rejected_;
+                continue;
+            }
+            if (hdr_.hasLabels()) chunk.label.push_back(label);
+            chunk.x.push_back(a[AstralCsv::kX]);
+            chunk.y.push_back(a[AstralCsv::kY]);
+            chunk.z.push_back(a[AstralCsv::kZ]);
+            if (hdr_.hasNormals()) {
+                chunk.i.push_back(a[AstralCsv::kI]);
+                chunk.j.push_back(a[AstralCsv::kJ]);
+                chunk.k.push_back(a[AstralCsv::kK]);
+            }
+        }
+    }
+
+    std::string path_;
+    std::ostream *log_;              // diagnostics
+    int fd_ = -1;
+    std::vector<char> buf_;
+    size_t begin_ = 0, end_ = 0;
+    bool eof_ = false;
+
+    AstralCsv::Header hdr_;
+    bool astral_ = false;
+    int layout_ = 0;                 // generic format: fields per line
+    off_t dataOffset_ = 0;
+    size_t dataLine_ = 0;
+    size_t lineNo_ = 0;
+    size_t rejected_ = 0;
+};
+
+#endif // CHUNKED_READER_H
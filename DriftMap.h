@@ -0,0 +1,164 @@
+/*
+ * DriftMap.h
+ *
+ * ------------------------------------------------------------
+ * Purpose:
+ *     Scan-to-scan comparison on a shared grid (flatnessScan
+ *     --compare): repeated scans of the same reference surface are
+ *     reduced to per-cell means on the reference scan's grid, and
+ *     only the dense per-cell temporal accumulators are kept, so any
+ *     number of scans compares in memory proportional to the grid.
+ *
+ * Overview:
+ *     - Each scan is accumulated by the caller into its own
+ *       FlatnessMap (newScan()), matched by grid cell (add(x, y, z))
+ *       or by point label (addCell() with the reference's cell of the
+ *       label), then folded in with fold().
+ *     - fold() takes the per-cell mean Z of the scan and, by default,
+ *       removes the scan's own best-fit plane (SurfaceFit order 1 of
+ *       the cell means), so fixturing tilt and height do not show as
+ *       drift.  The result is added to per-cell Welford accumulators
+ *       (temporal mean and σ over the scans covering the cell).
+ *     - Scan 0 is the reference; the latest scan covering a cell (by
+ *       index, not by completion order) is kept for the difference
+ *       map latest − reference.  fold() is thread-safe and, apart
+ *       from the reference which must be folded first, the order in
+ *       which scans are folded does not matter.
+ *     - ScanStats of each fold give the scan's own flatness (RMS of
+ *       its plane-removed cell means) and its RMS difference from the
+ *       reference over the cells both cover.
+ *
+ * Usage:
+ *     #include "DriftMap.h"
+ *
+ *     DriftMap drift(grid);                   // grid of the reference scan
+ *     FlatnessMap scan = drift.newScan();
+ *     for (...) scan.add(x, y, z);
+ *     DriftMap::ScanStats s = drift.fold(scan, k);   // k = 0 first
+ *     drift.mean(c), drift.sigma(c), drift.difference(c)
+ *
+ * ------------------------------------------------------------
+ * Author:    Luciano Ristori
+ * Created:   Oct 2025
+ * License:   MIT / open use
+ * ------------------------------------------------------------
+ */
+
+#ifndef DRIFT_MAP_H
+#define DRIFT_MAP_H
+
+#include <vector>
+#include <mutex>
+#include <cmath>
+#include <cstddef>
+
+#include "GridFinder.h"
+#include "FlatnessMap.h"
+#include "SurfaceFit.h"
+
+class DriftMap {
+public:
+    struct ScanStats {
+        size_t cells = 0;              // cells covered by the scan
+        bool planeRemoved = false;
+        double rms = 0.0;              // [mm] scan flatness over its cells
+        size_t common = 0;             // cells shared with the reference
+        double driftRms = 0.0;         // [mm] RMS (scan − reference) over them
+    };
+
+    explicit DriftMap(const GridFinder::Result &grid, bool removePlane = true)
+        : grid_(grid), removePlane_(removePlane)
+    {
+        size_t n = (grid.Nx > 0 && grid.Ny > 0) ? size_t(grid.Nx) * size_t(grid.Ny) : 0;
+        scans_.assign(n, 0);
+        mean_.assign(n, 0.0);
+        m2_.assign(n, 0.0);
+        reference_.assign(n, 0.0);
+        latest_.assign(n, 0.0);
+        latestScan_.assign(n, 0);
+        inReference_.assign(n, 0);
+    }
+
+    const GridFinder::Result &grid() const { return grid_; }
+    size_t cells() const { return scans_.size(); }
+
+    // Empty per-scan accumulator on the reference grid
+    FlatnessMap newScan() const { return FlatnessMap(grid_); }
+
+    // ------------------------------------------------------------
+    // fold()
+    //   Adds scan `index` (0 = reference, folded before any other).
+    // ------------------------------------------------------------
+    ScanStats fold(const FlatnessMap &scan, size_t index) {
+        ScanStats st;
+        SurfaceFit::Result plane;
+        if (removePlane_) {
+            plane = SurfaceFit::fitGrid(scan, 1);
+            st.planeRemoved = plane.valid;
+        }
+
+        // Per-cell values of this scan, before taking the lock
+        std::vector<double> value(cells(), 0.0);
+        double sum2 = 0.0, mean = 0.0;
+        for (int iy = 0; iy < scan.Ny; ++iy)
+            for (int ix = 0; ix < scan.Nx; ++ix) {
+                size_t c = scan.index(ix, iy);
+                if (!scan.count[c]) continue;
+                double z = scan.mean(ix, iy);
+                if (st.planeRemoved)
+                    z -= SurfaceFit::evaluate(plane, scan.xMin + ix * scan.dx, scan.yMin + iy * scan.dy, 1);
+                value[c] = z;
+                ++st.cells;
+                double d = z - mean;
+                mean += d / st.cells;
+                sum2 += d * (z - mean);
+            }
+        if (st.cells) st.rms = std::sqrt(sum2 / st.cells);
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        double dsum2 = 0.0;
+        for (size_t c = 0; c < cells(); ++c) {
+            if (!scan.count[c]) continue;
+            const double z = value[c];
+            ++scans_[c];
+            double d = z - mean_[c];
+            mean_[c] += d / scans_[c];
+            m2_[c] += d * (z - mean_[c]);
+            if (index == 0) {
+                reference_[c] = z;
+                inReference_[c] = 1;
+            } else if (inReference_[c]) {
+                double dr = z - reference_[c];
+                dsum2 += dr * dr;
+                ++st.common;
+            }
+            if (scans_[c] == 1 || index >= latestScan_[c]) {
+                latest_[c] = z;
+                latestScan_[c] = index;
+            }
+        }
+        if (index == 0) st.common = st.cells;
+        if (st.common && index != 0) st.driftRms = std::sqrt(dsum2 / st.common);
+        return st;
+    }
+
+    // Per-cell results, c = ix + Nx*iy (call once every fold() is done)
+    unsigned scans(size_t c) const { return scans_[c]; }
+    double mean(size_t c) const { return mean_[c]; }
+    double sigma(size_t c) const { return scans_[c] > 1 ? std::sqrt(m2_[c] / (scans_[c] - 1)) : 0.0; }
+    bool hasDifference(size_t c) const { return inReference_[c] && latestScan_[c] > 0; }
+    double difference(size_t c) const { return hasDifference(c) ? latest_[c] - reference_[c] : 0.0; }
+
+private:
+    GridFinder::Result grid_;
+    bool removePlane_;
+    std::mutex mutex_;
+    std::vector<unsigned> scans_;      // scans covering the cell
+    std::vector<double> mean_, m2_;    // Welford over those scans
+    std::vector<double> reference_;    // scan 0
+    std::vector<double> latest_;       // highest-index scan covering the cell
+    std::vector<size_t> latestScan_;
+    std::vector<char> inReference_;
+};
+
+#endif // DRIFT_MAP_H
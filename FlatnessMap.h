@@ -0,0 +1,120 @@
+/*
+ * FlatnessMap.h
+ *
+ * ------------------------------------------------------------
+ * Purpose:
+ *     Dense per-cell accumulation of a value (Z or residual) over the
+ *     regular grid found by GridFinder, used to build the flatness
+ *     map histograms.
+ *
+ * Overview:
+ *     - One flat array each for sum, sum of squares and count,
+ *       indexed by ix + Nx*iy; filled in a single pass with no
+ *       per-cell allocation.
+ *     - Cell (ix, iy) is centered at (xMin + ix*dx, yMin + iy*dy),
+ *       the same convention as the hZMap binning in flatnessScan.
+ *       For a rotated grid these are grid-frame coordinates: points
+ *       are rotated by the grid angle before the cell lookup.
+ *     - mean() and rms() give the per-cell average and the spread
+ *       of the values that fell into the cell.
+ *     - addCell() accumulates into a cell chosen by the caller (e.g.
+ *       matched by point label); clear() empties the map for reuse.
+ *
+ * Usage:
+ *     #include "FlatnessMap.h"
+ *
+ *     FlatnessMap map(grid);                 // grid = GridFinder::Result
+ *     for (size_t i = 0; i < n; ++i) map.add(x[i], y[i], z[i]);
+ *     for (int iy = 0; iy < map.Ny; ++iy)
+ *         for (int ix = 0; ix < map.Nx; ++ix)
+ *             if (map.count[map.index(ix, iy)]) use(map.mean(ix, iy));
+ *
+ * ------------------------------------------------------------
+ * Author:    Luciano Ristori
+ * Created:   Oct 2025
+ * License:   MIT / open use
+ * ------------------------------------------------------------
+ */
+
+#ifndef FLATNESS_MAP_H
+#define FLATNESS_MAP_H
+
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+
+#include "GridFinder.h"
+
+struct FlatnessMap {
+    int Nx = 0, Ny = 0;
+    double xMin = 0.0, yMin = 0.0;
+    double dx = 1.0, dy = 1.0;
+    double cosAngle = 1.0, sinAngle = 0.0;   // grid rotation (GridFinder::Result)
+    std::vector<double> sum;
+    std::vector<double> sum2;
+    std::vector<unsigned> count;
+
+    FlatnessMap() = default;
+
+    explicit FlatnessMap(const GridFinder::Result &grid)
+        : Nx(grid.Nx), Ny(grid.Ny), xMin(grid.xMin), yMin(grid.yMin),
+          dx(grid.dx), dy(grid.dy), cosAngle(grid.cosAngle), sinAngle(grid.sinAngle)
+    {
+        size_t n = (Nx > 0 && Ny > 0) ? size_t(Nx) * size_t(Ny) : 0;
+        sum.assign(n, 0.0);
+        sum2.assign(n, 0.0);
+        count.assign(n, 0);
+    }
+
+    size_t index(int ix, int iy) const { return size_t(ix) + size_t(Nx) * size_t(iy); }
+
+    // Cell of (x, y); returns false if the point falls outside the grid
+    bool cell(double x, double y, int &ix, int &iy) const {
+        double u = cosAngle * x + sinAngle * y;
+        double v = -sinAngle * x + cosAngle * y;
+        ix = static_cast<int>(std::round((u - xMin) / dx));
+        iy = static_cast<int>(std::round((v - yMin) / dy));
+        return ix >= 0 && ix < Nx && iy >= 0 && iy < Ny;
+    }
+
+    bool add(double x, double y, double v) {
+        int ix, iy;
+        if (!cell(x, y, ix, iy)) return false;
+        addCell(index(ix, iy), v);
+        return true;
+    }
+
+    void addCell(size_t k, double v) {
+        sum[k] += v;
+        sum2[k] += v * v;
+        ++count[k];
+    }
+
+    void clear() {
+        std::fill(sum.begin(), sum.end(), 0.0);
+        std::fill(sum2.begin(), sum2.end(), 0.0);
+        std::fill(count.begin(), count.end(), 0u);
+    }
+
+    double mean(int ix, int iy) const {
+        size_t k = index(ix, iy);
+        return count[k] ? sum[k] / count[k] : 0.0;
+    }
+
+    double rms(int ix, int iy) const {
+        size_t k = index(ix, iy);
+        if (!count[k]) return 0.0;
+        double m = sum[k] / count[k];
+        double var = sum2[k] / count[k] - m * m;
+        return var > 0.0 ? std::sqrt(var) : 0.0;
+    }
+
+    size_t occupiedCells() const {
+        size_t n = 0;
+        for (unsigned c : count) if (c) ++n;
+        return n;
+    }
+};
+
+#endif // FLATNESS_MAP_H
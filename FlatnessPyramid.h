@@ -0,0 +1,283 @@
+/*
+ * FlatnessPyramid.h
+ *
+ * ------------------------------------------------------------
+ * Purpose:
+ *     Constant-time statistics of any rectangle of a filled
+ *     FlatnessMap, and coarser versions of the map, without going
+ *     back to the points: local waviness and global form from one
+ *     dense grid.  The one place the summed-area tables of a map are
+ *     built: flatnessScan --pyramid and --local share one instance.
+ *
+ * Overview:
+ *     - Summed-area tables of the per-cell count, Σ(v - c) and
+ *       Σ(v - c)², with c the mean of the map so that the squares do
+ *       not cancel at the micron level.  A rectangle's count, mean
+ *       and RMS (over the points, not the cells) are four lookups
+ *       each.
+ *     - coarse(f) sums f × f blocks into a FlatnessMap with f times
+ *       the pitch: the mip-map levels of hZMap.
+ *     - moments() adds the plane moments of a rectangle, each point at
+ *       its cell's (i, j) in cell units: Σi, Σj, Σi², Σij, Σj², Σi·z,
+ *       Σj·z, from seven more tables built on the first call
+ *       (LocalFlatness fits a plane per window from them).
+ *     - region() also returns the extremes of the cell means, from
+ *       square-block min/max tables built on its first call: level k
+ *       holds the extremes of the 2^k × 2^k block starting at each
+ *       cell (a 2D sparse table, floats relative to c).  A rectangle
+ *       is covered by overlapping blocks of the largest level that
+ *       fits, so the peak-to-valley of the cell means of a square
+ *       window costs four lookups, of a w × h window about w/h.
+ *       Memory is levels × cells × 8 bytes.
+ *     - The lazily built tables are built once (std::call_once), so
+ *       a pyramid can be queried from several threads.
+ *
+ * Usage:
+ *     #include "FlatnessPyramid.h"
+ *
+ *     FlatnessPyramid pyr(map);               // map = filled FlatnessMap
+ *     FlatnessPyramid::Stats s = pyr.region(ix0, iy0, ix1, iy1);   // [ix0, ix1) × [iy0, iy1)
+ *     // s.count, s.mean, s.rms, s.peakToValley()
+ *     FlatnessPyramid::Moments m = pyr.moments(ix0, iy0, ix1, iy1);
+ *     FlatnessMap half = pyr.coarse(2);
+ *
+ * ------------------------------------------------------------
+ * Author:    Luciano Ristori
+ * Created:   Oct 2025
+ * License:   MIT / open use
+ * ------------------------------------------------------------
+ */
+
+#ifndef FLATNESS_PYRAMID_H
+#define FLATNESS_PYRAMID_H
+
+#include <vector>
+#include <mutex>
+#include <limits>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstddef>
+
+#include "FlatnessMap.h"
+
+class FlatnessPyramid {
+public:
+    struct Stats {
+        uint64_t count = 0;          // points
+        double mean = 0.0;
+        double rms = 0.0;            // spread of the points around mean
+        double min = 0.0, max = 0.0; // extremes of the cell means
+        double peakToValley() const { return count ? max - min : 0.0; }
+    };
+
+    // Plane moments of a rectangle; i, j in cells, z relative to center()
+    enum { N, I, J, II, IJ, JJ, Z, IZ, JZ, ZZ, kMoments };
+    struct Moments {
+        double m[kMoments] = {};
+        double operator[](int q) const { return m[q]; }
+    };
+
+    explicit FlatnessPyramid(const FlatnessMap &map)
+        : Nx_(map.Nx), Ny_(map.Ny), map_(map)
+    {
+        const size_t n = size_t(std::max(Nx_, 0)) * size_t(std::max(Ny_, 0));
+        double s = 0.0, c = 0.0;
+        for (size_t k = 0; k < n; ++k) { s += map.sum[k]; c += map.count[k]; }
+        center_ = c > 0 ? s / c : 0.0;
+
+        // Summed-area tables, (Nx+1) × (Ny+1) with a zero first row/column
+        const size_t W = size_t(Nx_) + 1;
+        count_.assign(W * (size_t(Ny_) + 1), 0.0);
+        sum_.assign(count_.size(), 0.0);
+        sum2_.assign(count_.size(), 0.0);
+        for (int iy = 0; iy < Ny_; ++iy)
+            for (int ix = 0; ix < Nx_; ++ix) {
+                size_t k = map.index(ix, iy);
+                double nk = map.count[k];
+                double sk = map.sum[k] - nk * center_;
+                double qk = map.sum2[k] - 2.0 * center_ * map.sum[k] + nk * center_ * center_;
+                size_t t = sat(ix + 1, iy + 1);
+                count_[t] = nk + count_[sat(ix, iy + 1)] + count_[sat(ix + 1, iy)] - count_[sat(ix, iy)];
+                sum_[t] = sk + sum_[sat(ix, iy + 1)] + sum_[sat(ix + 1, iy)] - sum_[sat(ix, iy)];
+                sum2_[t] = qk + sum2_[sat(ix, iy + 1)] + sum2_[sat(ix + 1, iy)] - sum2_[sat(ix, iy)];
+            }
+    }
+
+    int Nx() const { return Nx_; }
+    int Ny() const { return Ny_; }
+    const FlatnessMap &map() const { return map_; }
+    double center() const { return center_; }
+
+    // ------------------------------------------------------------
+    // region()
+    //   Cells [ix0, ix1) × [iy0, iy1), clamped to the map.
+    // ------------------------------------------------------------
+    Stats region(int ix0, int iy0, int ix1, int iy1) const {
+        Stats st;
+        ix0 = std::max(ix0, 0);  iy0 = std::max(iy0, 0);
+        ix1 = std::min(ix1, Nx_);  iy1 = std::min(iy1, Ny_);
+        if (ix1 <= ix0 || iy1 <= iy0) return st;
+        double n = rect(count_, ix0, iy0, ix1, iy1);
+        st.count = static_cast<uint64_t>(n + 0.5);
+        if (!st.count) return st;
+        double s = rect(sum_, ix0, iy0, ix1, iy1) / n;
+        double var = rect(sum2_, ix0, iy0, ix1, iy1) / n - s * s;
+        st.mean = center_ + s;
+        st.rms = var > 0.0 ? std::sqrt(var) : 0.0;
+        std::call_once(extremesOnce_, [this] { buildExtremes(); });
+        extremes(ix0, iy0, ix1, iy1, st.min, st.max);
+        st.min += center_;
+        st.max += center_;
+        return st;
+    }
+
+    // Cells whose centers lie in [u0, u1] × [v0, v1] (map coordinates)
+    Stats region(double u0, double v0, double u1, double v1) const {
+        int ix0 = static_cast<int>(std::ceil((u0 - map_.xMin) / map_.dx));
+        int ix1 = static_cast<int>(std::floor((u1 - map_.xMin) / map_.dx)) + 1;
+        int iy0 = static_cast<int>(std::ceil((v0 - map_.yMin) / map_.dy));
+        int iy1 = static_cast<int>(std::floor((v1 - map_.yMin) / map_.dy)) + 1;
+        return region(ix0, iy0, ix1, iy1);
+    }
+
+    // ------------------------------------------------------------
+    // moments()
+    //   Cells [ix0, ix1) × [iy0, iy1), inside the map.
+    // ------------------------------------------------------------
+    Moments moments(int ix0, int iy0, int ix1, int iy1) const {
+        std::call_once(planeOnce_, [this] { buildPlane(); });
+        Moments mo;
+        mo.m[N] = rect(count_, ix0, iy0, ix1, iy1);
+        mo.m[Z] = rect(sum_, ix0, iy0, ix1, iy1);
+        mo.m[ZZ] = rect(sum2_, ix0, iy0, ix1, iy1);
+        for (int q : {I, J, II, IJ, JJ, IZ, JZ})
+            mo.m[q] = rect(plane_[q], ix0, iy0, ix1, iy1);
+        return mo;
+    }
+
+    // ------------------------------------------------------------
+    // coarse()
+    //   f × f cell blocks summed into a map of pitch f·dx, f·dy; block
+    //   (jx, jy) covers cells [f·jx, f·jx + f), its center is that of
+    //   the full block.
+    // ------------------------------------------------------------
+    FlatnessMap coarse(int f) const {
+        FlatnessMap c;
+        if (f < 1 || Nx_ < 1 || Ny_ < 1) return c;
+        c.Nx = (Nx_ + f - 1) / f;
+        c.Ny = (Ny_ + f - 1) / f;
+        c.dx = map_.dx * f;
+        c.dy = map_.dy * f;
+        c.xMin = map_.xMin + 0.5 * (f - 1) * map_.dx;
+        c.yMin = map_.yMin + 0.5 * (f - 1) * map_.dy;
+        c.cosAngle = map_.cosAngle;
+        c.sinAngle = map_.sinAngle;
+        const size_t n = size_t(c.Nx) * size_t(c.Ny);
+        c.sum.assign(n, 0.0);
+        c.sum2.assign(n, 0.0);
+        c.count.assign(n, 0);
+        for (int jy = 0; jy < c.Ny; ++jy)
+            for (int jx = 0; jx < c.Nx; ++jx) {
+                const int x0 = jx * f, y0 = jy * f;
+                const int x1 = std::min(x0 + f, Nx_), y1 = std::min(y0 + f, Ny_);
+                double nk = rect(count_, x0, y0, x1, y1);
+                double sk = rect(sum_, x0, y0, x1, y1);
+                double qk = rect(sum2_, x0, y0, x1, y1);
+                size_t k = c.index(jx, jy);
+                c.count[k] = static_cast<unsigned>(nk + 0.5);
+                c.sum[k] = sk + nk * center_;
+                c.sum2[k] = qk + 2.0 * center_ * sk + nk * center_ * center_;
+            }
+        return c;
+    }
+
+private:
+    size_t sat(int ix, int iy) const { return size_t(ix) + (size_t(Nx_) + 1) * size_t(iy); }
+
+    // Summed-area tables of the plane moments other than n, z and z²
+    void buildPlane() const {
+        for (int q : {I, J, II, IJ, JJ, IZ, JZ}) plane_[q].assign(count_.size(), 0.0);
+        for (int iy = 0; iy < Ny_; ++iy)
+            for (int ix = 0; ix < Nx_; ++ix) {
+                const size_t k = map_.index(ix, iy);
+                const double n = map_.count[k], i = ix, j = iy;
+                const double z = map_.sum[k] - n * center_;
+                double m[kMoments];
+                m[I] = n * i;  m[J] = n * j;
+                m[II] = n * i * i;  m[IJ] = n * i * j;  m[JJ] = n * j * j;
+                m[IZ] = z * i;  m[JZ] = z * j;
+                const size_t a = sat(ix + 1, iy + 1), b = sat(ix, iy + 1);
+                const size_t d = sat(ix + 1, iy), e = sat(ix, iy);
+                for (int q : {I, J, II, IJ, JJ, IZ, JZ})
+                    plane_[q][a] = m[q] + plane_[q][b] + plane_[q][d] - plane_[q][e];
+            }
+    }
+
+    // Min/max of the cell means over 2^k × 2^k blocks
+    void buildExtremes() const {
+        const size_t n = size_t(std::max(Nx_, 0)) * size_t(std::max(Ny_, 0));
+        const float inf = std::numeric_limits<float>::infinity();
+        int levels = 0;
+        while ((2 << levels) <= std::min(Nx_, Ny_)) ++levels;
+        lo_.resize(n ? levels + 1 : 0);
+        hi_.resize(lo_.size());
+        if (n) {
+            lo_[0].assign(n, inf);
+            hi_[0].assign(n, -inf);
+            for (size_t k = 0; k < n; ++k)
+                if (map_.count[k]) {
+                    lo_[0][k] = hi_[0][k] = static_cast<float>(map_.sum[k] / map_.count[k] - center_);
+                }
+        }
+        for (size_t l = 1; l < lo_.size(); ++l) {
+            const int h = 1 << (l - 1), s2 = 1 << l;
+            lo_[l].assign(n, inf);
+            hi_[l].assign(n, -inf);
+            for (int iy = 0; iy + s2 <= Ny_; ++iy)
+                for (int ix = 0; ix + s2 <= Nx_; ++ix) {
+                    const size_t a = map_.index(ix, iy), b = map_.index(ix + h, iy);
+                    const size_t c2 = map_.index(ix, iy + h), d = map_.index(ix + h, iy + h);
+                    const std::vector<float> &L = lo_[l - 1], &H = hi_[l - 1];
+                    lo_[l][a] = std::min(std::min(L[a], L[b]), std::min(L[c2], L[d]));
+                    hi_[l][a] = std::max(std::max(H[a], H[b]), std::max(H[c2], H[d]));
+                }
+        }
+    }
+
+    double rect(const std::vector<double> &t, int ix0, int iy0, int ix1, int iy1) const {
+        return t[sat(ix1, iy1)] - t[sat(ix0, iy1)] - t[sat(ix1, iy0)] + t[sat(ix0, iy0)];
+    }
+
+    // Min/max of the cell means: overlapping blocks of the largest level
+    // fitting the rectangle, the last row/column of blocks flush with its end
+    void extremes(int ix0, int iy0, int ix1, int iy1, double &mn, double &mx) const {
+        const int w = ix1 - ix0, h = iy1 - iy0;
+        size_t l = 0;
+        while (l + 1 < lo_.size() && (2 << l) <= std::min(w, h)) ++l;
+        const int s = 1 << l;
+        float a = std::numeric_limits<float>::infinity(), b = -a;
+        for (int y = iy0;; y += s) {
+            const int yb = std::min(y, iy1 - s);
+            for (int x = ix0;; x += s) {
+                const size_t k = map_.index(std::min(x, ix1 - s), yb);
+                a = std::min(a, lo_[l][k]);
+                b = std::max(b, hi_[l][k]);
+                if (x + s >= ix1) break;
+            }
+            if (y + s >= iy1) break;
+        }
+        mn = a;
+        mx = b;
+    }
+
+    int Nx_, Ny_;
+    const FlatnessMap &map_;
+    double center_ = 0.0;
+    std::vector<double> count_, sum_, sum2_;      // summed-area tables
+    mutable std::once_flag planeOnce_, extremesOnce_;
+    mutable std::vector<double> plane_[kMoments]; // [I .. JZ] of moments(), on first use
+    mutable std::vector<std::vector<float>> lo_, hi_;   // [level][cell] block extremes, on first use
+};
+
+#endif // FLATNESS_PYRAMID_H
@@ -23,14 +23,44 @@
  *                   << res.dx << " dy=" << res.dy << std::endl;
  *
  * Data model:
- *     The input is a vector of (X,Y) pairs.  The algorithm:
- *       1. Extracts all unique X and Y coordinates.
- *       2. Merges coordinates that differ by less than a
- *          user-defined fraction of the grid step (mergeStepFraction).
+ *     The input is a vector of (X,Y) pairs, or two parallel coordinate
+ *     columns (pointer + count, e.g. straight from a PointCloud):
+ *
+ *         GridFinder::analyze(cloud.x.data(), cloud.y.data(), cloud.size());
+ *
+ *     The algorithm:
+ *       1. Clusters the X and Y coordinates into grid lines in linear
+ *          time, without sorting (clusterLines()): a pitch is first
+ *          estimated on a hashed sample of at most kPitchSample values;
+ *          every coordinate is then counted into buckets of a quarter
+ *          of that pitch over [min, max] (independent of N, so jitter
+ *          does not split a line however dense the scan), and runs of
+ *          adjacent occupied buckets form clusters.  The pitch comes
+ *          from a log-binned histogram of the gaps between cluster
+ *          centroids (linePitch()): of the groups of gaps that are
+ *          small multiples of their mode, the one with the largest gaps
+ *          among those explaining at least half as many gaps as the
+ *          best, so that neither a few stray or missing-line gaps nor
+ *          the small gaps left by jitter can set it.
+ *       2. Merges clusters closer than a user-defined fraction of that
+ *          pitch (mergeStepFraction); a line is the centroid of its
+ *          coordinates.
  *       3. Computes mean and spread of consecutive spacings.
  *       4. Declares the grid "regular" if the fractional spread is below
  *          toleranceFraction (default 5%).
- *       5. Scans all (X,Y) combinations to detect missing grid points.
+ *       5. Builds a cell index over the merged (X,Y) grid lines in one
+ *          pass over the points (each point marks the cells whose lines
+ *          lie within the presence tolerance) and counts the
+ *          intersections that were never marked as missing.
+ *       6. If the grid is not regular in X/Y, or is regular but with
+ *          missing intersections (a slight rotation smears each line
+ *          within the merge tolerance), estimates the dominant in-plane
+ *          rotation (estimateRotation(): nearest-neighbour directions
+ *          from a k-d tree, histogrammed modulo 90°) and repeats 1-5 in
+ *          the rotated frame.  A grid that is regular there, with fewer
+ *          missing intersections, is returned with its angle; every
+ *          geometric field (xMin..yMax, lines, cells) is then in
+ *          grid-frame coordinates (see Result::toGrid()).
  *
  * Adjustable parameters:
  *     toleranceFraction       - allowed deviation from uniform spacing
@@ -49,6 +79,12 @@
  *         dx, dy          → average step size
  *         regularX, regularY → spacing uniformity flags
  *         missingPoints   → count of missing grid intersections
+ *         xLines, yLines  → merged grid-line coordinates
+ *         angle           → rotation of the grid axes from X/Y [rad]
+ *         cellCount       → points per grid intersection,
+ *                           index ix + xLines.size()*iy
+ *                           (empty if the line grid is too large
+ *                           for a dense table; see kMaxDenseCells)
  *
  * Example:
  *     // A perfect 10x10 grid with minor rounding noise
@@ -73,6 +109,11 @@
 #include <algorithm>
 #include <numeric>
 #include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <unordered_set>
+
+#include "KdTree.h"
 
 namespace GridFinder {
 
@@ -88,58 +129,313 @@ struct Result {
     double yMin = 0.0;
     double yMax = 0.0;
     int missingPoints = 0;
+    std::vector<double> xLines;
+    std::vector<double> yLines;
+    std::vector<unsigned> cellCount;
+
+    // Rotation of the grid axes from X/Y, 0 for an axis-aligned grid.
+    // Grid-frame coordinates: u = cos·x + sin·y, v = -sin·x + cos·y
+    double angle = 0.0;     // [rad]
+    double cosAngle = 1.0;
+    double sinAngle = 0.0;
+
+    void toGrid(double x, double y, double &u, double &v) const {
+        u = cosAngle * x + sinAngle * y;
+        v = -sinAngle * x + cosAngle * y;
+    }
 };
 
+// Dense occupancy tables above this many cells (or 8 cells per point)
+// fall back to a hash set of occupied cells.
+constexpr size_t kMaxDenseCells = size_t(1) << 24;
+
+constexpr double kPi = 3.14159265358979323846;
+
+// Rotation estimate: points sampled, direction histogram bins over 90°,
+// and the half-width of the window refined around the peak bin
+constexpr size_t kRotationSample = size_t(1) << 16;
+constexpr int kAngleBins = 360;
+constexpr double kPeakWindow = 1.0 * kPi / 180.0;
+
+// clusterLines(): values sampled for the pitch estimate and fine buckets
+// per sampled value, then buckets per pitch for the full pass (capped)
+constexpr size_t kPitchSample = 4096;
+constexpr size_t kSampleBuckets = 1024;
+constexpr double kBucketsPerPitch = 4.0;
+constexpr size_t kMinBuckets = 1024;        // when no pitch can be estimated
+constexpr size_t kMaxBuckets = size_t(1) << 22;
+
+// linePitch(): ratio width of the gap histogram bins, empty ratio that
+// separates two groups of gaps, and the tests a group must pass
+constexpr double kGapBin = 1.1;
+constexpr double kGapPlateau = 3.0;
+constexpr double kMultipleTolerance = 0.15;   // of the pitch
+constexpr int kMaxMultiple = 3;               // gaps of up to two missing lines
+constexpr double kMultipleFraction = 0.6;     // gaps of the group near k·pitch
+constexpr double kMinOccupancy = 0.01;        // centroids / lines the pitch implies
+
+namespace detail {
+
+// Centroids (increasing) and counts of the runs of adjacent occupied
+// buckets, with nBuckets fine buckets over [lo, hi]
+inline void runCentroids(const double *v, size_t n, double lo, double hi, size_t nBuckets,
+                         std::vector<double> &centroid, std::vector<size_t> &count)
+{
+    const double scale = nBuckets / (hi - lo);
+    auto bucket = [&](double x) {
+        return std::min(nBuckets - 1, static_cast<size_t>((x - lo) * scale));
+    };
+
+    // Occupancy, then each bucket's run index
+    std::vector<uint32_t> run(nBuckets, 0);
+    for (size_t i = 0; i < n; ++i) run[bucket(v[i])] = 1;
+    uint32_t nRuns = 0;
+    bool inRun = false;
+    for (size_t b = 0; b < nBuckets; ++b) {
+        if (run[b]) {
+            if (!inRun) ++nRuns;
+            run[b] = nRuns - 1;
+            inRun = true;
+        } else {
+            run[b] = UINT32_MAX;
+            inRun = false;
+        }
+    }
+
+    centroid.assign(nRuns, 0.0);
+    count.assign(nRuns, 0);
+    for (size_t i = 0; i < n; ++i) {
+        uint32_t r = run[bucket(v[i])];
+        centroid[r] += v[i];
+        ++count[r];
+    }
+    for (uint32_t r = 0; r < nRuns; ++r) centroid[r] /= count[r];
+}
+
 // ------------------------------------------------------------
-// analyze()
-//   Checks if a set of (X,Y) points form a regular rectangular grid.
+// linePitch()
+//   Grid pitch from the gaps between consecutive centroids, 0 if none
+//   is found.  The gaps go into a histogram of log-spaced bins (no
+//   sort); runs of at least kGapPlateau in ratio without a gap split it
+//   into groups: jitter splitting lines (a broad group of small gaps),
+//   the pitch and its multiples, stray points.  The candidate of a group
+//   is the mean gap of its fullest pair of bins.  It is accepted if most
+//   gaps of its group are small multiples of it (up to kMaxMultiple) and
+//   it does not imply far more lines than there are centroids; of the
+//   accepted ones, weighted by the gaps they explain, the pitch is the
+//   largest holding at least half the weight of the heaviest.
 // ------------------------------------------------------------
-inline Result analyze(
-    const std::vector<std::pair<double,double>> &points,
+inline double linePitch(const std::vector<double> &centroid, double range)
+{
+    const size_t nGaps = centroid.size() > 1 ? centroid.size() - 1 : 0;
+    if (nGaps == 0) return 0.0;
+    double gMin = range, gMax = 0.0;
+    for (size_t k = 0; k < nGaps; ++k) {
+        double g = centroid[k + 1] - centroid[k];
+        gMin = std::min(gMin, g);
+        gMax = std::max(gMax, g);
+    }
+    if (!(gMin > 0.0)) return 0.0;
+
+    const double logBin = std::log(kGapBin);
+    auto binOf = [&](double g) { return static_cast<size_t>(std::log(g / gMin) / logBin); };
+    const size_t nBins = binOf(gMax) + 1;
+    std::vector<size_t> count(nBins, 0);
+    std::vector<double> sum(nBins, 0.0);
+    for (size_t k = 0; k < nGaps; ++k) {
+        double g = centroid[k + 1] - centroid[k];
+        size_t b = std::min(nBins - 1, binOf(g));
+        ++count[b];
+        sum[b] += g;
+    }
+
+    const size_t plateau = static_cast<size_t>(std::ceil(std::log(kGapPlateau) / logBin));
+    std::vector<std::pair<double, size_t>> accepted;    // (candidate, gaps it explains)
+    for (size_t b0 = 0; b0 < nBins; ) {
+        // Group [b0, b1]: populated bins no more than `plateau` empty bins apart
+        size_t b1 = b0, empty = 0;
+        for (size_t b = b0 + 1; b < nBins && empty < plateau; ++b) {
+            if (count[b]) { b1 = b; empty = 0; }
+            else ++empty;
+        }
+
+        size_t best = b0;
+        for (size_t b = b0; b <= b1; ++b)
+            if (count[b] + (b < b1 ? count[b + 1] : 0) >
+                count[best] + (best < b1 ? count[best + 1] : 0))
+                best = b;
+        const size_t bEnd = std::min(best + 1, b1);
+        double p = 0.0;
+        size_t inWindow = 0;
+        for (size_t b = best; b <= bEnd; ++b) { p += sum[b]; inWindow += count[b]; }
+        p /= inWindow;
+
+        size_t inGroup = 0, multiples = 0;
+        for (size_t k = 0; k < nGaps; ++k) {
+            double g = centroid[k + 1] - centroid[k];
+            size_t b = std::min(nBins - 1, binOf(g));
+            if (b < b0 || b > b1) continue;
+            ++inGroup;
+            double j = std::min<double>(kMaxMultiple, std::max(1.0, std::round(g / p)));
+            if (std::fabs(g / p - j) <= kMultipleTolerance) ++multiples;
+        }
+        if (multiples >= kMultipleFraction * inGroup &&
+            centroid.size() >= kMinOccupancy * (range / p + 1.0))
+            accepted.emplace_back(p, multiples);
+
+        b0 = b1 + 1;
+        while (b0 < nBins && !count[b0]) ++b0;
+    }
+
+    // The largest candidate explaining at least half as many gaps as the
+    // best one: lines split by jitter leave groups of small gaps that
+    // can pass by chance, a few stray gaps cannot outweigh the pitch
+    size_t most = 0;
+    for (const auto &a : accepted) most = std::max(most, a.second);
+    double pitch = 0.0;
+    for (const auto &a : accepted)
+        if (2 * a.second >= most) pitch = a.first;
+    return pitch;
+}
+
+} // namespace detail
+
+// ------------------------------------------------------------
+// clusterLines()
+//   Groups the n values of v into grid lines, in increasing order,
+//   in O(n + buckets) without sorting: a pitch estimate from a sample
+//   sets the bucket width (kBucketsPerPitch per pitch, whatever n is),
+//   runs of occupied buckets are the candidate lines, and runs closer
+//   than mergeStepFraction × their own pitch (linePitch()) are merged.
+//   Returns the centroids.
+// ------------------------------------------------------------
+inline std::vector<double> clusterLines(const double *v, size_t n, double mergeStepFraction)
+{
+    std::vector<double> lines;
+    if (n == 0) return lines;
+    auto range = std::minmax_element(v, v + n);
+    const double lo = *range.first, hi = *range.second;
+    if (!(hi > lo)) {
+        lines.push_back(lo);
+        return lines;
+    }
+
+    // Pitch estimate: up to kPitchSample values at hashed positions (a
+    // stride could follow the scan raster), in buckets fine enough to
+    // resolve the jitter of a line
+    std::vector<double> centroid;
+    std::vector<size_t> count;
+    const size_t m = std::min(n, kPitchSample);
+    std::vector<double> sample(m);
+    for (size_t i = 0; i < m; ++i) {
+        uint64_t h = (uint64_t(i) + 1) * 0x9E3779B97F4A7C15ull;
+        h = (h ^ (h >> 31)) * 0xBF58476D1CE4E5B9ull;
+        sample[i] = m == n ? v[i] : v[(h ^ (h >> 29)) % n];
+    }
+    detail::runCentroids(sample.data(), m, lo, hi,
+                         std::min(kMaxBuckets, std::max(kMinBuckets, kSampleBuckets * m)),
+                         centroid, count);
+    const double samplePitch = detail::linePitch(centroid, hi - lo);
+
+    // Full pass: a line spans at most two adjacent buckets
+    size_t nBuckets = kMinBuckets;
+    if (samplePitch > 0.0)
+        nBuckets = static_cast<size_t>(std::min<double>(kMaxBuckets,
+                       std::ceil((hi - lo) / samplePitch * kBucketsPerPitch) + 1));
+    detail::runCentroids(v, n, lo, hi, nBuckets, centroid, count);
+    const size_t nRuns = centroid.size();
+    if (nRuns == 1) {
+        lines.push_back(centroid[0]);
+        return lines;
+    }
+    double pitch = detail::linePitch(centroid, hi - lo);
+    if (pitch == 0.0) pitch = samplePitch;
+    const double eps = pitch * mergeStepFraction;
+
+    // Merge runs closer than eps into count-weighted centroids
+    double wsum = centroid[0] * count[0];
+    size_t wcount = count[0];
+    for (size_t r = 1; r < nRuns; ++r) {
+        if (centroid[r] - centroid[r - 1] > eps) {
+            lines.push_back(wsum / wcount);
+            wsum = 0.0;
+            wcount = 0;
+        }
+        wsum += centroid[r] * count[r];
+        wcount += count[r];
+    }
+    lines.push_back(wsum / wcount);
+    return lines;
+}
+
+// ------------------------------------------------------------
+// estimateRotation()
+//   Dominant direction of the nearest-neighbour vectors, folded into
+//   [-45°, 45°) [rad].  Up to kRotationSample points are queried
+//   against a k-d tree of all points; neighbours closer than 5% of the
+//   mean spacing (repeated measurements) are skipped.  The peak of the
+//   direction histogram is refined by the circular mean of 4θ within
+//   ±kPeakWindow.  Returns 0 if no direction could be measured.
+// ------------------------------------------------------------
+inline double estimateRotation(const double *px, const double *py, size_t nPoints)
+{
+    if (nPoints < 4) return 0.0;
+    auto xr = std::minmax_element(px, px + nPoints);
+    auto yr = std::minmax_element(py, py + nPoints);
+    double area = (*xr.second - *xr.first) * (*yr.second - *yr.first);
+    double minDist = 0.05 * std::sqrt(area / nPoints);
+
+    KdTree tree(px, py, nPoints);
+    const double quarter = kPi / 2;
+    auto fold = [&](double a) {           // into [-45°, 45°)
+        a = std::fmod(a + kPi / 4, quarter);
+        if (a < 0) a += quarter;
+        return a - kPi / 4;
+    };
+
+    std::vector<double> dirs;
+    std::vector<unsigned> hist(kAngleBins, 0);
+    const size_t stride = std::max<size_t>(1, nPoints / kRotationSample);
+    for (size_t i = 0; i < nPoints; i += stride) {
+        size_t j = tree.nearest(i, minDist * minDist);
+        if (j == KdTree::kNone) continue;
+        double a = fold(std::atan2(py[j] - py[i], px[j] - px[i]));
+        dirs.push_back(a);
+        int b = static_cast<int>((a + kPi / 4) / quarter * kAngleBins);
+        ++hist[std::min(kAngleBins - 1, std::max(0, b))];
+    }
+    if (dirs.empty()) return 0.0;
+
+    int peak = static_cast<int>(std::max_element(hist.begin(), hist.end()) - hist.begin());
+    double center = -kPi / 4 + (peak + 0.5) * quarter / kAngleBins;
+    double c = 0.0, s = 0.0;
+    for (double a : dirs) {
+        if (std::fabs(fold(a - center)) > kPeakWindow) continue;
+        c += std::cos(4 * a);
+        s += std::sin(4 * a);
+    }
+    return fold(std::atan2(s, c) / 4);
+}
+
+// ------------------------------------------------------------
+// analyzeAligned()
+//   Checks if a set of (X,Y) points form a regular rectangular grid
+//   with lines parallel to the X and Y axes.
+//   px[i], py[i] are the coordinates of point i (i < nPoints).
+// ------------------------------------------------------------
+inline Result analyzeAligned(
+    const double *px, const double *py, size_t nPoints,
     double toleranceFraction = 0.05,        // allowed deviation in spacing (~5%)
     double presenceEpsilonFraction = 0.2,   // proximity for missing-point detection
     double mergeStepFraction = 0.10         // merge threshold = 10% of mean step
 )
 {
     Result result;
-    if (points.size() < 4) return result;
-
-    // --- Extract X and Y coordinates ---
-    std::vector<double> xs, ys;
-    xs.reserve(points.size());
-    ys.reserve(points.size());
-    for (auto &p : points) {
-        xs.push_back(p.first);
-        ys.push_back(p.second);
-    }
-    std::sort(xs.begin(), xs.end());
-    std::sort(ys.begin(), ys.end());
+    if (nPoints < 4) return result;
 
-    // --- Estimate average step for merge tolerance ---
-    auto estimateMeanStep = [](const std::vector<double> &v) {
-        if (v.size() < 2) return 0.0;
-        std::vector<double> d;
-        for (size_t i = 1; i < v.size(); ++i)
-            d.push_back(v[i] - v[i-1]);
-        return std::accumulate(d.begin(), d.end(), 0.0) / d.size();
-    };
-    double dxGuess = estimateMeanStep(xs);
-    double dyGuess = estimateMeanStep(ys);
-
-    // --- Merge close coordinates ---
-    auto mergeClose = [&](std::vector<double> &v, double step) {
-        std::vector<double> merged;
-        if (v.empty()) return merged;
-        merged.push_back(v[0]);
-        double eps = std::fabs(step) * mergeStepFraction;
-        for (double val : v) {
-            if (std::fabs(val - merged.back()) > eps)
-                merged.push_back(val);
-        }
-        return merged;
-    };
-    xs = mergeClose(xs, dxGuess);
-    ys = mergeClose(ys, dyGuess);
+    // --- Cluster X and Y coordinates into grid lines (no sort) ---
+    std::vector<double> xs = clusterLines(px, nPoints, mergeStepFraction);
+    std::vector<double> ys = clusterLines(py, nPoints, mergeStepFraction);
 
 	result.Nx = xs.size();
 	result.Ny = ys.size();
@@ -162,26 +458,52 @@ inline Result analyze(
     result.dx = dx;
     result.dy = dy;
 
-    result.regularX = (dxSpread / dx < toleranceFraction);
-    result.regularY = (dySpread / dy < toleranceFraction);
+    // Regular: even spacing, and as many lines as the extent holds at the
+    // median spacing (a missing line or a stray point breaks either)
+    auto consistent = [](const std::vector<double> &v) {
+        std::vector<double> d;
+        for (size_t i = 1; i < v.size(); ++i) d.push_back(v[i] - v[i-1]);
+        std::nth_element(d.begin(), d.begin() + d.size() / 2, d.end());
+        double step = d[d.size() / 2];
+        return step > 0 && std::lround((v.back() - v.front()) / step) + 1 == long(v.size());
+    };
+    result.regularX = (dxSpread / dx < toleranceFraction) && consistent(xs);
+    result.regularY = (dySpread / dy < toleranceFraction) && consistent(ys);
 
     // --- Count missing grid points ---
+    // A grid intersection (x,y) is present if some point lies within eps
+    // of both lines.  Each point marks the (few) lines within eps, found
+    // by binary search, so the index is built in a single pass.
     double eps = std::min(dx, dy) * presenceEpsilonFraction;
-    size_t missing = 0;
-    for (double x : xs) {
-        for (double y : ys) {
-            bool found = false;
-            for (auto &p : points) {
-                if (std::fabs(p.first - x) < eps &&
-                    std::fabs(p.second - y) < eps) {
-                    found = true;
-                    break;
-                }
+    const size_t nxLines = xs.size(), nyLines = ys.size();
+    const size_t nCells = nxLines * nyLines;
+    const bool dense = nCells <= std::max(kMaxDenseCells, 8 * nPoints);
+
+    std::vector<unsigned> counts;
+    std::unordered_set<uint64_t> occupied;
+    if (dense) counts.assign(nCells, 0);
+
+    for (size_t i = 0; i < nPoints; ++i) {
+        auto ix0 = std::lower_bound(xs.begin(), xs.end(), px[i] - eps) - xs.begin();
+        auto iy0 = std::lower_bound(ys.begin(), ys.end(), py[i] - eps) - ys.begin();
+        for (size_t ix = ix0; ix < nxLines && xs[ix] < px[i] + eps; ++ix) {
+            if (!(std::fabs(px[i] - xs[ix]) < eps)) continue;
+            for (size_t iy = iy0; iy < nyLines && ys[iy] < py[i] + eps; ++iy) {
+                if (!(std::fabs(py[i] - ys[iy]) < eps)) continue;
+                if (dense) ++counts[ix + nxLines * iy];
+                else occupied.insert(uint64_t(ix) + uint64_t(nxLines) * iy);
             }
-            if (!found) ++missing;
         }
     }
-    result.missingPoints = missing;
+
+    size_t present = 0;
+    if (dense) {
+        for (unsigned c : counts) if (c) ++present;
+    } else {
+        present = occupied.size();
+    }
+    result.missingPoints = nCells - present;
+    result.cellCount = std::move(counts);
     
     result.xMin = *std::min_element(xs.begin(), xs.end());
 	result.xMax = *std::max_element(xs.begin(), xs.end());
@@ -189,11 +511,73 @@ inline Result analyze(
 	result.yMax = *std::max_element(ys.begin(), ys.end());
 	result.Nx = std::round((result.xMax - result.xMin) / result.dx) + 1;
 	result.Ny = std::round((result.yMax - result.yMin) / result.dy) + 1;
-
+    result.xLines = std::move(xs);
+    result.yLines = std::move(ys);
 
     return result;
 }
 
+// ------------------------------------------------------------
+// analyze()
+//   Checks if a set of (X,Y) points form a regular rectangular grid,
+//   axis-aligned or rotated in the plane (see Result::angle).  The
+//   rotation is only estimated when the aligned grid is irregular or
+//   incomplete, so complete axis-aligned scans pay nothing extra.
+// ------------------------------------------------------------
+inline Result analyze(
+    const double *px, const double *py, size_t nPoints,
+    double toleranceFraction = 0.05,
+    double presenceEpsilonFraction = 0.2,
+    double mergeStepFraction = 0.10
+)
+{
+    Result result = analyzeAligned(px, py, nPoints, toleranceFraction,
+                                   presenceEpsilonFraction, mergeStepFraction);
+    const bool aligned = result.regularX && result.regularY;
+    if (aligned && result.missingPoints == 0) return result;
+
+    double angle = estimateRotation(px, py, nPoints);
+    if (std::fabs(angle) < 1e-6) return result;
+
+    Result rotated;
+    rotated.cosAngle = std::cos(angle);
+    rotated.sinAngle = std::sin(angle);
+    std::vector<double> u(nPoints), v(nPoints);
+    for (size_t i = 0; i < nPoints; ++i)
+        rotated.toGrid(px[i], py[i], u[i], v[i]);
+
+    Result r = analyzeAligned(u.data(), v.data(), nPoints, toleranceFraction,
+                              presenceEpsilonFraction, mergeStepFraction);
+    if (!(r.regularX && r.regularY)) return result;
+    if (aligned && r.missingPoints >= result.missingPoints) return result;
+    r.angle = angle;
+    r.cosAngle = rotated.cosAngle;
+    r.sinAngle = rotated.sinAngle;
+    return r;
+}
+
+// ------------------------------------------------------------
+// analyze()
+//   Convenience overload for a vector of (X,Y) pairs.
+// ------------------------------------------------------------
+inline Result analyze(
+    const std::vector<std::pair<double,double>> &points,
+    double toleranceFraction = 0.05,
+    double presenceEpsilonFraction = 0.2,
+    double mergeStepFraction = 0.10
+)
+{
+    std::vector<double> xs, ys;
+    xs.reserve(points.size());
+    ys.reserve(points.size());
+    for (auto &p : points) {
+        xs.push_back(p.first);
+        ys.push_back(p.second);
+    }
+    return analyze(xs.data(), ys.data(), xs.size(),
+                   toleranceFraction, presenceEpsilonFraction, mergeStepFraction);
+}
+
 } // namespace GridFinder
 
 #endif // GRID_FINDER_H
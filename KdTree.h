@@ -0,0 +1,111 @@
+/*
+ * KdTree.h
+ *
+ * ------------------------------------------------------------
+ * Purpose:
+ *     Static 2D k-d tree over (X, Y) point columns, for nearest-
+ *     neighbour queries (GridFinder's rotation estimate).
+ *
+ * Overview:
+ *     - The tree is implicit: an index permutation ordered so that
+ *       the median of every range splits it, alternately in X and Y
+ *       (std::nth_element, O(N log N) build, no node allocation).
+ *     - nearest() descends to the query's leaf, then backtracks into
+ *       the far side of a split only while the split plane is closer
+ *       than the best distance found.
+ *     - The coordinates are not copied: the columns must outlive the
+ *       tree.
+ *
+ * Usage:
+ *     #include "KdTree.h"
+ *
+ *     KdTree tree(cloud.x.data(), cloud.y.data(), cloud.size());
+ *     size_t j = tree.nearest(i);   // closest other point to point i
+ *
+ * ------------------------------------------------------------
+ * Author:    Luciano Ristori
+ * Created:   Oct 2025
+ * License:   MIT / open use
+ * ------------------------------------------------------------
+ */
+
+#ifndef KD_TREE_H
+#define KD_TREE_H
+
+#include <vector>
+#include <numeric>
+#include <algorithm>
+#include <limits>
+#include <cstddef>
+
+class KdTree {
+public:
+    static constexpr size_t kNone = static_cast<size_t>(-1);
+
+    KdTree(const double *px, const double *py, size_t n)
+        : px_(px), py_(py), index_(n)
+    {
+        std::iota(index_.begin(), index_.end(), size_t(0));
+        build(0, n, 0);
+    }
+
+    size_t size() const { return index_.size(); }
+
+    // ------------------------------------------------------------
+    // nearest()
+    //   Index of the point closest to point i, other than i itself and
+    //   any point within sqrt(minDist2) of it (duplicates, repeated
+    //   measurements); kNone if there is none.
+    // ------------------------------------------------------------
+    size_t nearest(size_t i, double minDist2 = 0.0) const {
+        Query q{px_[i], py_[i], i, minDist2, std::numeric_limits<double>::max(), kNone};
+        search(0, index_.size(), 0, q);
+        return q.best;
+    }
+
+private:
+    struct Query {
+        double x, y;
+        size_t self;
+        double minDist2;
+        double bestDist2;
+        size_t best;
+    };
+
+    double coord(size_t p, int axis) const { return axis ? py_[p] : px_[p]; }
+
+    void build(size_t lo, size_t hi, int axis) {
+        if (hi - lo < 2) return;
+        size_t mid = lo + (hi - lo) / 2;
+        std::nth_element(index_.begin() + lo, index_.begin() + mid, index_.begin() + hi,
+                         [&](size_t a, size_t b) { return coord(a, axis) < coord(b, axis); });
+        build(lo, mid, axis ^ 1);
+        build(mid + 1, hi, axis ^ 1);
+    }
+
+    void search(size_t lo, size_t hi, int axis, Query &q) const {
+        if (lo >= hi) return;
+        size_t mid = lo + (hi - lo) / 2;
+        size_t p = index_[mid];
+        double dx = px_[p] - q.x, dy = py_[p] - q.y;
+        double d2 = dx * dx + dy * dy;
+        if (p != q.self && d2 > q.minDist2 && d2 < q.bestDist2) {
+            q.bestDist2 = d2;
+            q.best = p;
+        }
+        double diff = (axis ? q.y : q.x) - coord(p, axis);
+        if (diff < 0) {
+            search(lo, mid, axis ^ 1, q);
+            if (diff * diff < q.bestDist2) search(mid + 1, hi, axis ^ 1, q);
+        } else {
+            search(mid + 1, hi, axis ^ 1, q);
+            if (diff * diff < q.bestDist2) search(lo, mid, axis ^ 1, q);
+        }
+    }
+
+    const double *px_;
+    const double *py_;
+    std::vector<size_t> index_;
+};
+
+#endif // KD_TREE_H
@@ -0,0 +1,276 @@
+/*
+ * Kernels.h
+ *
+ * ------------------------------------------------------------
+ * Purpose:
+ *     Vectorized, optionally multithreaded kernels for the two hot
+ *     loops of flatnessScan:
+ *
+ *       chi2()       Σ (ax*X + ay*Y + az*(Z+offset) - 1)² / |a|²
+ *       residuals()  (ax*X + ay*Y + az*(Z+offset) - 1) / |a|  per point
+ *
+ *     plus summarize(), the mean/σ/min/max of a column.
+ *
+ * Overview:
+ *     - The plane is folded into constants once per call
+ *       (c = az*offset - 1, 1/|a|), so the loop body is three
+ *       multiplies and three adds per point; divisions by |a| happen
+ *       outside the loop.
+ *     - The data are cut into fixed blocks of kBlock points.  Every
+ *       block is reduced into 4 lanes (point i goes to lane i % 4),
+ *       the lanes are combined in a fixed order, and the block sums
+ *       are added pairwise.  The result therefore does not depend on
+ *       the number of threads.
+ *     - AVX2 (x86, build with -mavx2 or -march=native) and NEON
+ *       (arm64) paths use intrinsics; other targets use the portable
+ *       4-lane scalar loop, which compilers auto-vectorize.
+ *     - Above kParallelMin points the blocks are split across
+ *       nThreads std::threads.
+ *
+ * Usage:
+ *     #include "Kernels.h"
+ *
+ *     double c2 = Kernels::chi2(x, y, z, n, ax, ay, az, offset, nThreads);
+ *     Kernels::residuals(x, y, z, n, ax, ay, az, offset, r.data(), nThreads);
+ *     RunningStats s = Kernels::summarize(r.data(), n, nThreads);
+ *
+ * ------------------------------------------------------------
+ * Author:    Luciano Ristori
+ * Created:   Oct 2025
+ * License:   MIT / open use
+ * ------------------------------------------------------------
+ */
+
+#ifndef KERNELS_H
+#define KERNELS_H
+
+#include <vector>
+#include <thread>
+#include <cmath>
+#include <cstddef>
+#include <limits>
+#include <algorithm>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+#include "ScanAccumulator.h"
+
+namespace Kernels {
+
+constexpr size_t kBlock = 2048;                      // points per reduction block
+constexpr size_t kParallelMin = size_t(1) << 20;     // below this, stay single-threaded
+
+struct Plane {
+    double ax, ay, az;
+    double c;       // az*offset - 1
+    double inv;     // 1/|a|
+};
+
+inline Plane makePlane(double ax, double ay, double az, double offset)
+{
+    Plane p;
+    p.ax = ax; p.ay = ay; p.az = az;
+    p.c = az * offset - 1.0;
+    double moda = std::sqrt(ax * ax + ay * ay + az * az);
+    p.inv = moda > 0.0 ? 1.0 / moda : 0.0;
+    return p;
+}
+
+namespace detail {
+
+// Runs f(b) for every block b < nBlocks, split in contiguous ranges
+template <class F>
+void forBlocks(size_t nBlocks, size_t nPoints, unsigned nThreads, F f)
+{
+    unsigned nt = (nPoints >= kParallelMin) ? std::max(1u, nThreads) : 1u;
+    nt = static_cast<unsigned>(std::min<size_t>(nt, nBlocks));
+    if (nt <= 1) {
+        for (size_t b = 0; b < nBlocks; ++b) f(b);
+        return;
+    }
+    std::vector<std::thread> threads;
+    threads.reserve(nt);
+    for (unsigned t = 0; t < nt; ++t) {
+        size_t b0 = nBlocks * t / nt, b1 = nBlocks * (t + 1) / nt;
+        threads.emplace_back([=, &f] { for (size_t b = b0; b < b1; ++b) f(b); });
+    }
+    for (auto &th : threads) th.join();
+}
+
+// Fixed-order pairwise sum
+inline double pairwiseSum(const double *v, size_t n)
+{
+    if (n <= 8) {
+        double s = 0.0;
+        for (size_t i = 0; i < n; ++i) s += v[i];
+        return s;
+    }
+    size_t h = n / 2;
+    return pairwiseSum(v, h) + pairwiseSum(v + h, n - h);
+}
+
+inline double combineLanes(const double l[4]) { return (l[0] + l[1]) + (l[2] + l[3]); }
+
+// Σ d² over one block (d not yet divided by |a|)
+inline double blockDistSq(const double *x, const double *y, const double *z,
+                          size_t n, const Plane &p)
+{
+    double lane[4] = {0.0, 0.0, 0.0, 0.0};
+    size_t i = 0;
+#if defined(__AVX2__)
+    __m256d vax = _mm256_set1_pd(p.ax), vay = _mm256_set1_pd(p.ay);
+    __m256d vaz = _mm256_set1_pd(p.az), vc = _mm256_set1_pd(p.c);
+    __m256d acc = _mm256_setzero_pd();
+    for (; i + 4 <= n; i += 4) {
+        __m256d d = _mm256_add_pd(_mm256_mul_pd(vax, _mm256_loadu_pd(x + i)),
+                                  _mm256_mul_pd(vay, _mm256_loadu_pd(y + i)));
+        d = _mm256_add_pd(d, _mm256_mul_pd(vaz, _mm256_loadu_pd(z + i)));
+        d = _mm256_add_pd(d, vc);
+        acc = _mm256_add_pd(acc, _mm256_mul_pd(d, d));
+    }
+    _mm256_storeu_pd(lane, acc);
+#elif defined(__ARM_NEON)
+    float64x2_t vax = vdupq_n_f64(p.ax), vay = vdupq_n_f64(p.ay);
+    float64x2_t vaz = vdupq_n_f64(p.az), vc = vdupq_n_f64(p.c);
+    float64x2_t acc0 = vdupq_n_f64(0.0), acc1 = vdupq_n_f64(0.0);
+    for (; i + 4 <= n; i += 4) {
+        float64x2_t d0 = vaddq_f64(vmulq_f64(vax, vld1q_f64(x + i)), vmulq_f64(vay, vld1q_f64(y + i)));
+        float64x2_t d1 = vaddq_f64(vmulq_f64(vax, vld1q_f64(x + i + 2)), vmulq_f64(vay, vld1q_f64(y + i + 2)));
+        d0 = vaddq_f64(vaddq_f64(d0, vmulq_f64(vaz, vld1q_f64(z + i))), vc);
+        d1 = vaddq_f64(vaddq_f64(d1, vmulq_f64(vaz, vld1q_f64(z + i + 2))), vc);
+        acc0 = vaddq_f64(acc0, vmulq_f64(d0, d0));
+        acc1 = vaddq_f64(acc1, vmulq_f64(d1, d1));
+    }
+    vst1q_f64(lane, acc0);
+    vst1q_f64(lane + 2, acc1);
+#else
+    for (; i + 4 <= n; i += 4)
+        for (int l = 0; l < 4; ++l) {
+            double d = p.ax * x[i + l] + p.ay * y[i + l] + p.az * z[i + l] + p.c;
+            lane[l] += d * d;
+        }
+#endif
+    for (; i < n; ++i) {
+        double d = p.ax * x[i] + p.ay * y[i] + p.az * z[i] + p.c;
+        lane[i % 4] += d * d;
+    }
+    return combineLanes(lane);
+}
+
+inline void blockResiduals(const double *x, const double *y, const double *z,
+                           size_t n, const Plane &p, double *out)
+{
+    size_t i = 0;
+#if defined(__AVX2__)
+    __m256d vax = _mm256_set1_pd(p.ax), vay = _mm256_set1_pd(p.ay);
+    __m256d vaz = _mm256_set1_pd(p.az), vc = _mm256_set1_pd(p.c);
+    __m256d vinv = _mm256_set1_pd(p.inv);
+    for (; i + 4 <= n; i += 4) {
+        __m256d d = _mm256_add_pd(_mm256_mul_pd(vax, _mm256_loadu_pd(x + i)),
+                                  _mm256_mul_pd(vay, _mm256_loadu_pd(y + i)));
+        d = _mm256_add_pd(d, _mm256_mul_pd(vaz, _mm256_loadu_pd(z + i)));
+        d = _mm256_add_pd(d, vc);
+        _mm256_storeu_pd(out + i, _mm256_mul_pd(d, vinv));
+    }
+#elif defined(__ARM_NEON)
+    float64x2_t vax = vdupq_n_f64(p.ax), vay = vdupq_n_f64(p.ay);
+    float64x2_t vaz = vdupq_n_f64(p.az), vc = vdupq_n_f64(p.c);
+    float64x2_t vinv = vdupq_n_f64(p.inv);
+    for (; i + 2 <= n; i += 2) {
+        float64x2_t d = vaddq_f64(vmulq_f64(vax, vld1q_f64(x + i)), vmulq_f64(vay, vld1q_f64(y + i)));
+        d = vaddq_f64(vaddq_f64(d, vmulq_f64(vaz, vld1q_f64(z + i))), vc);
+        vst1q_f64(out + i, vmulq_f64(d, vinv));
+    }
+#endif
+    for (; i < n; ++i)
+        out[i] = (p.ax * x[i] + p.ay * y[i] + p.az * z[i] + p.c) * p.inv;
+}
+
+} // namespace detail
+
+// ------------------------------------------------------------
+// chi2()
+//   Sum of squared orthogonal distances to the plane [mm²].
+// ------------------------------------------------------------
+inline double chi2(const double *x, const double *y, const double *z, size_t n,
+                   double ax, double ay, double az, double offset,
+                   unsigned nThreads = 1)
+{
+    Plane p = makePlane(ax, ay, az, offset);
+    size_t nBlocks = (n + kBlock - 1) / kBlock;
+    std::vector<double> partial(nBlocks, 0.0);
+    detail::forBlocks(nBlocks, n, nThreads, [&](size_t b) {
+        size_t i0 = b * kBlock, len = std::min(kBlock, n - i0);
+        partial[b] = detail::blockDistSq(x + i0, y + i0, z + i0, len, p);
+    });
+    return detail::pairwiseSum(partial.data(), nBlocks) * p.inv * p.inv;
+}
+
+// ------------------------------------------------------------
+// residuals()
+//   Signed orthogonal residual of every point [mm] into out[0..n).
+// ------------------------------------------------------------
+inline void residuals(const double *x, const double *y, const double *z, size_t n,
+                      double ax, double ay, double az, double offset,
+                      double *out, unsigned nThreads = 1)
+{
+    Plane p = makePlane(ax, ay, az, offset);
+    size_t nBlocks = (n + kBlock - 1) / kBlock;
+    detail::forBlocks(nBlocks, n, nThreads, [&](size_t b) {
+        size_t i0 = b * kBlock, len = std::min(kBlock, n - i0);
+        detail::blockResiduals(x + i0, y + i0, z + i0, len, p, out + i0);
+    });
+}
+
+// ------------------------------------------------------------
+// summarize()
+//   Mean, variance (two-pass), minimum and maximum of v[0..n),
+//   returned as a RunningStats.
+// ------------------------------------------------------------
+inline RunningStats summarize(const double *v, size_t n, unsigned nThreads = 1)
+{
+    RunningStats s;
+    if (n == 0) return s;
+    size_t nBlocks = (n + kBlock - 1) / kBlock;
+    std::vector<double> sum(nBlocks), lo(nBlocks), hi(nBlocks);
+
+    detail::forBlocks(nBlocks, n, nThreads, [&](size_t b) {
+        size_t i0 = b * kBlock, i1 = std::min(n, i0 + kBlock);
+        double lane[4] = {0.0, 0.0, 0.0, 0.0};
+        double mn = v[i0], mx = v[i0];
+        for (size_t i = i0; i < i1; ++i) {
+            lane[(i - i0) % 4] += v[i];
+            mn = std::min(mn, v[i]);
+            mx = std::max(mx, v[i]);
+        }
+        sum[b] = detail::combineLanes(lane);
+        lo[b] = mn;
+        hi[b] = mx;
+    });
+    double mean = detail::pairwiseSum(sum.data(), nBlocks) / n;
+
+    detail::forBlocks(nBlocks, n, nThreads, [&](size_t b) {
+        size_t i0 = b * kBlock, i1 = std::min(n, i0 + kBlock);
+        double lane[4] = {0.0, 0.0, 0.0, 0.0};
+        for (size_t i = i0; i < i1; ++i) {
+            double d = v[i] - mean;
+            lane[(i - i0) % 4] += d * d;
+        }
+        sum[b] = detail::combineLanes(lane);
+    });
+
+    s.n = n;
+    s.mean = mean;
+    s.m2 = detail::pairwiseSum(sum.data(), nBlocks);
+    s.min = *std::min_element(lo.begin(), lo.end());
+    s.max = *std::max_element(hi.begin(), hi.end());
+    return s;
+}
+
+} // namespace Kernels
+
+#endif // KERNELS_H
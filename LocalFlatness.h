@@ -0,0 +1,205 @@
+/*
+ * LocalFlatness.h
+ *
+ * ------------------------------------------------------------
+ * Purpose:
+ *     Local-window flatness for specs of the form "within tolerance
+ *     over any W × H window" (flatnessScan --local=W[xH][:tol]): a
+ *     plane is fitted inside every window position of the grid and
+ *     the RMS of the points about it is mapped, with the worst window
+ *     located.
+ *
+ * Overview:
+ *     - The plane moments of a window come from the summed-area tables
+ *       of FlatnessPyramid (FlatnessPyramid::moments()), each point at
+ *       its cell center (i, j in cell units; the fit is invariant to
+ *       the pitch): n, Σi, Σj, Σi², Σij, Σj², Σz, Σiz, Σjz, Σz², z
+ *       taken relative to the map mean.  Every window is then 10
+ *       rectangle lookups, a 2 × 2 solve for the slopes of the centered
+ *       normal equations and RSS = Czz - b·Ciz - c·Cjz: O(1) per window
+ *       whatever its size, O(Nx·Ny) for the scan.
+ *     - Window centers are cut into kTile × kTile tiles run on a
+ *       ThreadPool; each tile keeps its own worst window and the
+ *       tiles are merged by window index, so the result does not
+ *       depend on the number of threads.
+ *     - A window is evaluated where it lies fully inside the grid and
+ *       its occupied cells are not collinear; rms[] is -1 elsewhere.
+ *     - Memory: the pyramid's 10 tables of (Nx+1)(Ny+1) doubles (80 MB
+ *       for a 1000 × 1000 grid, shared with --pyramid) plus the result
+ *       map.
+ *
+ * Usage:
+ *     #include "LocalFlatness.h"
+ *
+ *     LocalFlatness::Spec spec;
+ *     LocalFlatness::parse("25x25:5", spec);           // mm, mm, µm
+ *     int wx, wy;
+ *     LocalFlatness::windowCells(spec, map, wx, wy);
+ *     FlatnessPyramid pyr(map);
+ *     LocalFlatness::Result lf = LocalFlatness::scan(pyr, wx, wy, nThreads);
+ *     // lf.rms[ix + Nx*iy] for the window centered on cell (ix, iy), lf.worst ...
+ *
+ * ------------------------------------------------------------
+ * Author:    Luciano Ristori
+ * Created:   Oct 2025
+ * License:   MIT / open use
+ * ------------------------------------------------------------
+ */
+
+#ifndef LOCAL_FLATNESS_H
+#define LOCAL_FLATNESS_H
+
+#include <vector>
+#include <string>
+#include <mutex>
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstddef>
+
+#include "FlatnessMap.h"
+#include "FlatnessPyramid.h"
+#include "ThreadPool.h"
+
+namespace LocalFlatness {
+
+constexpr int kTile = 64;            // window centers per tile side
+
+struct Spec {
+    bool enabled = false;
+    double width = 25.0;             // [mm]
+    double height = 25.0;            // [mm]
+    double tolerance = 0.0;          // [mm], 0 = none
+};
+
+struct Result {
+    bool valid = false;
+    int wx = 0, wy = 0;              // window size in cells
+    size_t windows = 0;              // windows evaluated
+    size_t over = 0;                 // windows above the tolerance
+    double worst = 0.0;              // [mm] largest local RMS
+    int worstIx = -1, worstIy = -1;  // its center cell
+    std::vector<double> rms;         // [mm] per center cell, -1 = not evaluated
+};
+
+// ------------------------------------------------------------
+// parse()
+//   "<W>[x<H>][:<tol µm>]", sizes in mm; false if malformed.
+// ------------------------------------------------------------
+inline bool parse(const std::string &text, Spec &spec)
+{
+    const char *p = text.c_str();
+    char *end = nullptr;
+    spec.width = std::strtod(p, &end);
+    if (end == p || !(spec.width > 0)) return false;
+    spec.height = spec.width;
+    if (*end == 'x') {
+        p = end + 1;
+        spec.height = std::strtod(p, &end);
+        if (end == p || !(spec.height > 0)) return false;
+    }
+    if (*end == ':') {
+        p = end + 1;
+        spec.tolerance = std::strtod(p, &end) / 1000.0;
+        if (end == p || !(spec.tolerance > 0)) return false;
+    }
+    if (*end != '\0') return false;
+    spec.enabled = true;
+    return true;
+}
+
+// Window size in cells (at least 2 × 2) from the spec in mm
+inline void windowCells(const Spec &spec, const FlatnessMap &map, int &wx, int &wy)
+{
+    wx = std::max(2, static_cast<int>(std::lround(spec.width / map.dx)));
+    wy = std::max(2, static_cast<int>(std::lround(spec.height / map.dy)));
+}
+
+namespace detail {
+
+// RMS about the least-squares plane of a window's moments; -1 if degenerate
+inline double windowRms(const FlatnessPyramid::Moments &m)
+{
+    using P = FlatnessPyramid;
+    const double n = m[P::N];
+    if (n < 3.0) return -1.0;
+    const double mi = m[P::I] / n, mj = m[P::J] / n, mz = m[P::Z] / n;
+    const double cii = m[P::II] - n * mi * mi;
+    const double cij = m[P::IJ] - n * mi * mj;
+    const double cjj = m[P::JJ] - n * mj * mj;
+    const double ciz = m[P::IZ] - n * mi * mz;
+    const double cjz = m[P::JZ] - n * mj * mz;
+    const double czz = m[P::ZZ] - n * mz * mz;
+    const double det = cii * cjj - cij * cij;
+    if (!(det > 1e-9 * cii * cjj)) return -1.0;
+    const double bi = (ciz * cjj - cjz * cij) / det;
+    const double bj = (cjz * cii - ciz * cij) / det;
+    const double rss = czz - bi * ciz - bj * cjz;
+    return rss > 0.0 ? std::sqrt(rss / n) : 0.0;
+}
+
+} // namespace detail
+
+// ------------------------------------------------------------
+// scan()
+//   Window of wx × wy cells centered on every cell (cells
+//   [ix - wx/2, ix - wx/2 + wx)); tolerance in mm (0 = none).
+// ------------------------------------------------------------
+inline Result scan(const FlatnessPyramid &pyr, int wx, int wy, unsigned nThreads = 1,
+                   double tolerance = 0.0)
+{
+    const FlatnessMap &map = pyr.map();
+    Result lf;
+    lf.wx = wx;
+    lf.wy = wy;
+    if (map.Nx < wx || map.Ny < wy || wx < 2 || wy < 2) return lf;
+    lf.rms.assign(map.count.size(), -1.0);
+
+    // Centers whose window fits: ix in [wx/2, Nx - wx + wx/2]
+    const int cx0 = wx / 2, cx1 = map.Nx - wx + wx / 2 + 1;
+    const int cy0 = wy / 2, cy1 = map.Ny - wy + wy / 2 + 1;
+    std::mutex mutex;
+    auto runTile = [&](int tx0, int ty0) {
+        const int tx1 = std::min(tx0 + kTile, cx1), ty1 = std::min(ty0 + kTile, cy1);
+        size_t windows = 0, over = 0, worstK = 0;
+        double worst = -1.0;
+        for (int iy = ty0; iy < ty1; ++iy)
+            for (int ix = tx0; ix < tx1; ++ix) {
+                const int x0 = ix - wx / 2, y0 = iy - wy / 2;
+                double r = detail::windowRms(pyr.moments(x0, y0, x0 + wx, y0 + wy));
+                if (r < 0.0) continue;
+                const size_t k = map.index(ix, iy);
+                lf.rms[k] = r;
+                ++windows;
+                if (tolerance > 0.0 && r > tolerance) ++over;
+                if (r > worst) { worst = r; worstK = k; }
+            }
+        std::lock_guard<std::mutex> lock(mutex);
+        lf.windows += windows;
+        lf.over += over;
+        if (worst >= 0.0 && (lf.worstIx < 0 || worst > lf.worst ||
+                             (worst == lf.worst && worstK < map.index(lf.worstIx, lf.worstIy)))) {
+            lf.worst = worst;
+            lf.worstIx = static_cast<int>(worstK % map.Nx);
+            lf.worstIy = static_cast<int>(worstK / map.Nx);
+        }
+    };
+
+    const unsigned nt = std::max(1u, nThreads);
+    if (nt == 1) {
+        for (int ty = cy0; ty < cy1; ty += kTile)
+            for (int tx = cx0; tx < cx1; tx += kTile) runTile(tx, ty);
+    } else {
+        ThreadPool pool(nt);
+        for (int ty = cy0; ty < cy1; ty += kTile)
+            for (int tx = cx0; tx < cx1; tx += kTile)
+                pool.submit([&, tx, ty] { runTile(tx, ty); });
+        pool.wait();
+    }
+    lf.valid = lf.windows > 0;
+    return lf;
+}
+
+} // namespace LocalFlatness
+
+#endif // LOCAL_FLATNESS_H
@@ -0,0 +1,80 @@
+/*
+ * MappedFile.h
+ *
+ * ------------------------------------------------------------
+ * Purpose:
+ *     Minimal RAII wrapper around a read-only POSIX memory mapping,
+ *     so readers can parse a file in place without copying it into
+ *     std::string or iostream buffers.
+ *
+ * Usage:
+ *     #include "MappedFile.h"
+ *
+ *     MappedFile f("scan.csv");
+ *     if (f.ok())
+ *         parse(f.data(), f.data() + f.size());
+ *
+ * Notes:
+ *     Empty files are reported as ok() with size() == 0 and a null
+ *     data() pointer (mmap of zero bytes is not allowed).
+ *
+ * ------------------------------------------------------------
+ * Author:    Luciano Ristori
+ * Created:   Oct 2025
+ * License:   MIT / open use
+ * ------------------------------------------------------------
+ */
+
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <string>
+#include <cstddef>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+class MappedFile {
+public:
+    explicit MappedFile(const std::string &path) {
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) return;
+        struct stat st;
+        if (::fstat(fd, &st) == 0) {
+            size_ = static_cast<size_t>(st.st_size);
+            if (size_ == 0) {
+                ok_ = true;
+            } else {
+                void *p = ::mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+                if (p != MAP_FAILED) {
+                    data_ = static_cast<const char *>(p);
+                    ::madvise(p, size_, MADV_SEQUENTIAL);
+                    ok_ = true;
+                } else {
+                    size_ = 0;
+                }
+            }
+        }
+        ::close(fd);
+    }
+
+    ~MappedFile() {
+        if (data_) ::munmap(const_cast<char *>(data_), size_);
+    }
+
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    bool ok() const { return ok_; }
+    const char *data() const { return data_; }
+    size_t size() const { return size_; }
+
+private:
+    const char *data_ = nullptr;
+    size_t size_ = 0;
+    bool ok_ = false;
+};
+
+#endif // MAPPED_FILE_H
@@ -0,0 +1,323 @@
+/*
+ * MinimumZone.h
+ *
+ * ------------------------------------------------------------
+ * Purpose:
+ *     Minimum-zone flatness (ISO 1101): the smallest distance between
+ *     two parallel planes that enclose all points, together with the
+ *     limiting points that touch the two planes.
+ *
+ * Overview:
+ *     Work in the frame of the least-squares plane: w is the signed
+ *     residual, (u, v) the in-plane coordinates.  The zone is
+ *
+ *         a*u + b*v + c  <=  w  <=  a*u + b*v + c + h,
+ *
+ *     and minimizing h is a linear program in (a, b, c, h).  Its dual
+ *     has only four rows,
+ *
+ *         Σ λ_i (u_i, v_i, 1, 0) + Σ μ_i (-u_i, -v_i, 0, 1) = (0, 0, 1, 1),
+ *         maximize Σ μ_i w_i - Σ λ_i w_i,
+ *
+ *     i.e. the largest drop in w between a convex combination of
+ *     "upper" and of "lower" points sharing the same (u, v): exactly
+ *     the antipodal facet/vertex or edge/edge pairs of the convex hull.
+ *     The zone planes are recovered from the simplex multipliers.
+ *
+ *     The hull is never built.  Instead (column generation):
+ *       1. the LSQ residuals prune the cloud to candidates, the highest
+ *          and lowest point of each of kTiles×kTiles tiles in (u, v);
+ *       2. the 4-row dual is solved on the candidates (dense simplex,
+ *          Bland's rule);
+ *       3. one pass over all points finds those outside the zone;
+ *          the worst kAddPerRound join the candidates and 2. repeats.
+ *     When no point is outside, the zone is optimal for the whole
+ *     cloud.  Each round is O(N) with a handful of rounds in practice.
+ *
+ * Usage:
+ *     #include "MinimumZone.h"
+ *
+ *     MinimumZone::Result mz = MinimumZone::evaluate(x, y, z, n, ax, ay, az, offset);
+ *     // mz.width [mm], mz.upper / mz.lower = indices of limiting points
+ *
+ * Notes:
+ *     The LP minimizes the gap along the LSQ normal; the width is then
+ *     reported orthogonally, h / sqrt(1 + a² + b²).  The two differ
+ *     from the true minimum only at order (a² + b²)·h, with a, b of
+ *     order zone width / part size, i.e. far below the probe resolution.
+ *
+ * ------------------------------------------------------------
+ * Author:    Luciano Ristori
+ * Created:   Oct 2025
+ * License:   MIT / open use
+ * ------------------------------------------------------------
+ */
+
+#ifndef MINIMUM_ZONE_H
+#define MINIMUM_ZONE_H
+
+#include <vector>
+#include <cmath>
+#include <cstddef>
+#include <limits>
+#include <algorithm>
+
+namespace MinimumZone {
+
+constexpr int kTiles = 16;            // initial candidates: extremes of kTiles² tiles
+constexpr size_t kAddPerRound = 256;  // violators added per round
+constexpr int kMaxRounds = 100;
+
+struct Result {
+    bool valid = false;
+    double width = 0.0;                   // minimum-zone flatness [mm]
+    double normal[3] = {0.0, 0.0, 1.0};   // unit normal of the zone planes
+    std::vector<size_t> upper;            // point indices on the upper plane
+    std::vector<size_t> lower;            // point indices on the lower plane
+    int rounds = 0;
+    size_t candidates = 0;
+};
+
+namespace detail {
+
+// ------------------------------------------------------------
+// simplexMax()
+//   maximize c·x  subject to  A x = b (b >= 0), x >= 0.
+//   A is m×n row-major.  Two-phase tableau, Bland's rule.
+//   On success y holds the simplex multipliers c_B B⁻¹ and basis
+//   the basic column of each row (>= n for a leftover artificial).
+// ------------------------------------------------------------
+inline bool simplexMax(int m, int n, const std::vector<double> &A,
+                       const std::vector<double> &b, const std::vector<double> &c,
+                       std::vector<double> &x, std::vector<double> &y,
+                       std::vector<int> &basis)
+{
+    const double eps = 1e-10;
+    const int cols = n + m + 1;            // real, artificial, rhs
+    const int rhs = n + m;
+    std::vector<double> T(size_t(m + 1) * cols, 0.0);
+    auto at = [&](int i, int j) -> double & { return T[size_t(i) * cols + j]; };
+
+    for (int i = 0; i < m; ++i) {
+        for (int j = 0; j < n; ++j) at(i, j) = A[size_t(i) * n + j];
+        at(i, n + i) = 1.0;
+        at(i, rhs) = b[i];
+    }
+    basis.assign(m, 0);
+    for (int i = 0; i < m; ++i) basis[i] = n + i;
+
+    auto pivot = [&](int r, int q) {
+        double p = at(r, q);
+        for (int j = 0; j < cols; ++j) at(r, j) /= p;
+        for (int i = 0; i <= m; ++i) {
+            if (i == r) continue;
+            double f = at(i, q);
+            if (f == 0.0) continue;
+            for (int j = 0; j < cols; ++j) at(i, j) -= f * at(r, j);
+        }
+        basis[r] = q;
+    };
+
+    // One simplex phase on the reduced costs in row m
+    auto run = [&](int nEnter) {
+        for (int iter = 0; iter < 100000; ++iter) {
+            int q = -1;
+            for (int j = 0; j < nEnter; ++j)
+                if (at(m, j) > eps) { q = j; break; }
+            if (q < 0) return true;
+            int r = -1;
+            double best = 0.0;
+            for (int i = 0; i < m; ++i) {
+                if (at(i, q) <= eps) continue;
+                double ratio = at(i, rhs) / at(i, q);
+                if (r < 0 || ratio < best - eps ||
+                    (ratio <= best + eps && basis[i] < basis[r])) { r = i; best = ratio; }
+            }
+            if (r < 0) return false;       // unbounded
+            pivot(r, q);
+        }
+        return false;
+    };
+
+    // Phase I: maximize -Σ artificials
+    for (int j = 0; j <= rhs; ++j) {
+        double s = 0.0;
+        for (int i = 0; i < m; ++i) s += at(i, j);
+        at(m, j) = (j >= n && j < rhs) ? 0.0 : s;
+    }
+    if (!run(n)) return false;
+    if (at(m, rhs) > 1e-8) return false;   // infeasible
+
+    // Drive zero-level artificials out of the basis where possible
+    for (int i = 0; i < m; ++i) {
+        if (basis[i] < n) continue;
+        for (int j = 0; j < n; ++j)
+            if (std::fabs(at(i, j)) > eps) { pivot(i, j); break; }
+    }
+
+    // Phase II: reduced costs of c (artificials cost 0, never enter)
+    for (int j = 0; j <= rhs; ++j) at(m, j) = (j < n) ? c[j] : 0.0;
+    for (int i = 0; i < m; ++i) {
+        double cb = basis[i] < n ? c[basis[i]] : 0.0;
+        if (cb == 0.0) continue;
+        for (int j = 0; j <= rhs; ++j) at(m, j) -= cb * at(i, j);
+    }
+    if (!run(n)) return false;
+
+    x.assign(n, 0.0);
+    for (int i = 0; i < m; ++i)
+        if (basis[i] < n) x[basis[i]] = at(i, rhs);
+    // reduced cost of artificial i is 0 - y_i
+    y.assign(m, 0.0);
+    for (int i = 0; i < m; ++i) y[i] = -at(m, n + i);
+    return true;
+}
+
+} // namespace detail
+
+// ------------------------------------------------------------
+// evaluate()
+//   Minimum zone of the points not masked out (skip[i] != 0),
+//   starting from the plane ax*X + ay*Y + az*(Z+offset) = 1.
+// ------------------------------------------------------------
+inline Result evaluate(const double *x, const double *y, const double *z, size_t n,
+                       double ax, double ay, double az, double offset,
+                       const char *skip = nullptr)
+{
+    Result res;
+    double moda = std::sqrt(ax * ax + ay * ay + az * az);
+    if (n < 4 || moda == 0.0) return res;
+
+    // --- LSQ frame: normal nv, in-plane axes eu, ev ---
+    const double nv[3] = {ax / moda, ay / moda, az / moda};
+    double ref[3] = {1.0, 0.0, 0.0};
+    if (std::fabs(nv[0]) > 0.9) { ref[0] = 0.0; ref[1] = 1.0; }
+    double d = ref[0] * nv[0] + ref[1] * nv[1] + ref[2] * nv[2];
+    double eu[3] = {ref[0] - d * nv[0], ref[1] - d * nv[1], ref[2] - d * nv[2]};
+    double eun = std::sqrt(eu[0] * eu[0] + eu[1] * eu[1] + eu[2] * eu[2]);
+    for (double &e : eu) e /= eun;
+    const double ev[3] = {nv[1] * eu[2] - nv[2] * eu[1],
+                          nv[2] * eu[0] - nv[0] * eu[2],
+                          nv[0] * eu[1] - nv[1] * eu[0]};
+    const double c0 = az * offset - 1.0;
+
+    // --- Pass 1: ranges, for centering and scaling ---
+    double uLo = std::numeric_limits<double>::max(), uHi = std::numeric_limits<double>::lowest();
+    double vLo = uLo, vHi = uHi, wAbs = 0.0;
+    size_t nUsed = 0;
+    for (size_t i = 0; i < n; ++i) {
+        if (skip && skip[i]) continue;
+        double u = eu[0] * x[i] + eu[1] * y[i] + eu[2] * z[i];
+        double v = ev[0] * x[i] + ev[1] * y[i] + ev[2] * z[i];
+        double w = (ax * x[i] + ay * y[i] + az * z[i] + c0) / moda;
+        uLo = std::min(uLo, u); uHi = std::max(uHi, u);
+        vLo = std::min(vLo, v); vHi = std::max(vHi, v);
+        wAbs = std::max(wAbs, std::fabs(w));
+        ++nUsed;
+    }
+    if (nUsed < 4) return res;
+    const double uMid = 0.5 * (uLo + uHi), vMid = 0.5 * (vLo + vHi);
+    const double su = std::max(0.5 * (uHi - uLo), 1e-12);
+    const double sv = std::max(0.5 * (vHi - vLo), 1e-12);
+    const double sw = std::max(wAbs, 1e-15);
+
+    // Scaled frame coordinates of point i
+    auto frame = [&](size_t i, double &u, double &v, double &w) {
+        u = (eu[0] * x[i] + eu[1] * y[i] + eu[2] * z[i] - uMid) / su;
+        v = (ev[0] * x[i] + ev[1] * y[i] + ev[2] * z[i] - vMid) / sv;
+        w = (ax * x[i] + ay * y[i] + az * z[i] + c0) / moda / sw;
+    };
+
+    // --- Pass 2: highest and lowest point of every tile ---
+    std::vector<size_t> cand;
+    {
+        const size_t nt = size_t(kTiles) * kTiles;
+        const size_t none = std::numeric_limits<size_t>::max();
+        std::vector<size_t> hiIdx(nt, none), loIdx(nt, none);
+        std::vector<double> hiW(nt), loW(nt);
+        for (size_t i = 0; i < n; ++i) {
+            if (skip && skip[i]) continue;
+            double u, v, w;
+            frame(i, u, v, w);
+            int tu = std::min(kTiles - 1, std::max(0, int((u + 1.0) * 0.5 * kTiles)));
+            int tv = std::min(kTiles - 1, std::max(0, int((v + 1.0) * 0.5 * kTiles)));
+            size_t t = size_t(tu) + size_t(kTiles) * tv;
+            if (hiIdx[t] == none || w > hiW[t]) { hiIdx[t] = i; hiW[t] = w; }
+            if (loIdx[t] == none || w < loW[t]) { loIdx[t] = i; loW[t] = w; }
+        }
+        for (size_t t = 0; t < nt; ++t) {
+            if (hiIdx[t] != none) cand.push_back(hiIdx[t]);
+            if (loIdx[t] != none && loIdx[t] != hiIdx[t]) cand.push_back(loIdx[t]);
+        }
+    }
+
+    // --- Column generation ---
+    // Every candidate enters both as a lower (λ) and an upper (μ) column,
+    // which keeps the restricted dual feasible.
+    const double tol = 1e-9;
+    double pa = 0.0, pb = 0.0, pLow = 0.0, pUp = 0.0;   // zone in scaled frame
+    std::vector<double> xs, ys;
+    std::vector<int> basis;
+    for (int round = 1; round <= kMaxRounds; ++round) {
+        res.rounds = round;
+        const int m = 4, nc = static_cast<int>(2 * cand.size());
+        std::vector<double> A(size_t(m) * nc), b = {0.0, 0.0, 1.0, 1.0}, c(nc);
+        for (size_t k = 0; k < cand.size(); ++k) {
+            double u, v, w;
+            frame(cand[k], u, v, w);
+            int jl = static_cast<int>(2 * k), ju = jl + 1;
+            A[0 * nc + jl] = u;   A[1 * nc + jl] = v;   A[2 * nc + jl] = 1.0; A[3 * nc + jl] = 0.0;
+            A[0 * nc + ju] = -u;  A[1 * nc + ju] = -v;  A[2 * nc + ju] = 0.0; A[3 * nc + ju] = 1.0;
+            c[jl] = -w;
+            c[ju] = w;
+        }
+        if (!detail::simplexMax(m, nc, A, b, c, xs, ys, basis)) return res;
+        pa = -ys[0]; pb = -ys[1]; pLow = -ys[2]; pUp = ys[3];
+
+        // Points outside the zone, worst first
+        std::vector<std::pair<double, size_t>> viol;
+        for (size_t i = 0; i < n; ++i) {
+            if (skip && skip[i]) continue;
+            double u, v, w;
+            frame(i, u, v, w);
+            double base = pa * u + pb * v;
+            double out = std::max(base + pLow - w, w - (base + pUp));
+            if (out > tol) viol.emplace_back(out, i);
+        }
+        if (viol.empty()) {
+            res.valid = true;
+            break;
+        }
+        if (viol.size() > kAddPerRound) {
+            std::nth_element(viol.begin(), viol.begin() + kAddPerRound, viol.end(),
+                             [](const std::pair<double, size_t> &l, const std::pair<double, size_t> &r) {
+                                 return l.first > r.first;
+                             });
+            viol.resize(kAddPerRound);
+        }
+        for (const auto &vi : viol) cand.push_back(vi.second);
+    }
+    res.candidates = cand.size();
+    if (!res.valid) return res;
+
+    // --- Back to millimetres ---
+    double a = pa * sw / su, bb = pb * sw / sv;
+    double h = (pUp - pLow) * sw;
+    double norm = std::sqrt(1.0 + a * a + bb * bb);
+    res.width = h / norm;
+    for (int q = 0; q < 3; ++q)
+        res.normal[q] = (nv[q] - a * eu[q] - bb * ev[q]) / norm;
+
+    for (int i = 0; i < 4; ++i) {
+        int j = basis[i];
+        if (j >= static_cast<int>(2 * cand.size()) || xs[j] <= 0.0) continue;
+        size_t idx = cand[j / 2];
+        std::vector<size_t> &side = (j % 2) ? res.upper : res.lower;
+        if (std::find(side.begin(), side.end(), idx) == side.end()) side.push_back(idx);
+    }
+    return res;
+}
+
+} // namespace MinimumZone
+
+#endif // MINIMUM_ZONE_H
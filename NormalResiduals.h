@@ -0,0 +1,157 @@
+/*
+ * NormalResiduals.h
+ *
+ * ------------------------------------------------------------
+ * Purpose:
+ *     Residuals measured along the surface normals I, J, K that the
+ *     CMM reports with each point, with optional probe-radius
+ *     compensation, and the angle between each reported normal and
+ *     the fitted plane's: hits on an edge, a chip or dirt come back
+ *     with a tilted normal and stand out against that angle.
+ *
+ * Overview:
+ *     - û = (I, J, K) / |(I, J, K)| as reported; n̂ = a / |a| is the
+ *       fitted plane's normal (+Z) and cos θ = n̂·û.
+ *     - Probe compensation (radius R > 0): the reported point is the
+ *       ball center and û points out of the material, so the contact
+ *       point is p - R·û.  The plane of the contact points is refitted
+ *       in closed form from moments accumulated on the fly (blocks
+ *       merged in a fixed order); the columns are never copied or
+ *       modified.  R = 0 uses the caller's plane as is.
+ *     - The residual along the normal is e / |cos θ|, with e the
+ *       orthogonal residual of the (compensated) point: e = (a·p' - 1)
+ *       / |a| - R cos θ.  Its sign follows n̂, as for hDeviations, so a
+ *       reversed (I, J, K) does not flip it.
+ *     - One blocked pass over the seven columns computes both the
+ *       residual and θ; the loop body is branch-free apart from acos.
+ *       Points with a null normal, or tilted beyond maxAngle from the
+ *       plane normal (where 1 / cos θ blows up), are counted apart and
+ *       left out of the statistics.
+ *     - Same block layout as Kernels.h: results do not depend on the
+ *       number of threads.
+ *
+ * Usage:
+ *     #include "NormalResiduals.h"
+ *
+ *     NormalResiduals::Result nr = NormalResiduals::compute(
+ *         x, y, z, i, j, k, n, ax, ay, az, offset, probeRadius, maxAngleDeg,
+ *         skip, nThreads);
+ *     // nr.residual[m], nr.angle[m] for the points kept; nr.residualStats ...
+ *
+ * ------------------------------------------------------------
+ * Author:    Luciano Ristori
+ * Created:   Oct 2025
+ * License:   MIT / open use
+ * ------------------------------------------------------------
+ */
+
+#ifndef NORMAL_RESIDUALS_H
+#define NORMAL_RESIDUALS_H
+
+#include <vector>
+#include <cmath>
+#include <cstddef>
+#include <algorithm>
+
+#include "PlaneFit.h"
+#include "Kernels.h"
+#include "ScanAccumulator.h"
+
+namespace NormalResiduals {
+
+constexpr double kDefaultMaxAngle = 60.0;     // [deg] beyond this a hit is not used
+constexpr double kDegree = 180.0 / 3.14159265358979323846;
+
+struct Result {
+    bool valid = false;
+    double probeRadius = 0.0;            // [mm]
+    double ax = 0.0, ay = 0.0, az = 0.0; // plane of the (compensated) points
+    size_t used = 0;                     // points in residual / angle
+    size_t nullNormals = 0;              // |(I, J, K)| = 0
+    size_t grazing = 0;                  // tilted beyond maxAngle
+    RunningStats residualStats;          // [mm] along the normal
+    RunningStats angleStats;             // [deg]
+    std::vector<double> residual;        // [mm] per point used, in input order
+    std::vector<double> angle;           // [deg] matching residual
+};
+
+// ------------------------------------------------------------
+// compute()
+//   ax, ay, az: plane of the points as given (a·p' = 1, p' = (X, Y,
+//   Z + offset)); skip[i] != 0 leaves point i out (e.g. rejected by
+//   the robust fit).  The compensated plane is fitted on the points
+//   with a non-null normal and not skipped.
+// ------------------------------------------------------------
+inline Result compute(const double *x, const double *y, const double *z,
+                      const double *ni, const double *nj, const double *nk, size_t n,
+                      double ax, double ay, double az, double offset,
+                      double probeRadius = 0.0, double maxAngleDeg = kDefaultMaxAngle,
+                      const char *skip = nullptr, unsigned nThreads = 1)
+{
+    using Kernels::kBlock;
+    Result nr;
+    nr.probeRadius = probeRadius;
+    const size_t nBlocks = (n + kBlock - 1) / kBlock;
+    const double R = probeRadius;
+
+    // Plane of the contact points p - R·û
+    if (R != 0.0) {
+        std::vector<PlaneFit::Moments> part(nBlocks);
+        Kernels::detail::forBlocks(nBlocks, n, nThreads, [&](size_t b) {
+            const size_t i1 = std::min(n, (b + 1) * kBlock);
+            PlaneFit::Moments &m = part[b];
+            for (size_t p = b * kBlock; p < i1; ++p) {
+                if (skip && skip[p]) continue;
+                double len = std::sqrt(ni[p] * ni[p] + nj[p] * nj[p] + nk[p] * nk[p]);
+                if (len == 0.0) continue;           // cannot be compensated
+                double s = R / len;
+                m.add(x[p] - s * ni[p], y[p] - s * nj[p], z[p] - s * nk[p]);
+            }
+        });
+        PlaneFit::Moments all;
+        for (const auto &m : part) all.merge(m);
+        PlaneFit::Result fit = PlaneFit::fitPCA(all, offset);
+        if (!fit.valid) return nr;
+        ax = fit.ax; ay = fit.ay; az = fit.az;
+    }
+    nr.ax = ax; nr.ay = ay; nr.az = az;
+
+    // One pass: residual along the normal and tilt of every point.
+    // Points not used get angle -1 (null normal) or -2 (grazing).
+    const Kernels::Plane pl = Kernels::makePlane(ax, ay, az, offset);
+    const double ux = ax * pl.inv, uy = ay * pl.inv, uz = az * pl.inv;
+    const double cosMax = std::cos(maxAngleDeg / kDegree);
+    std::vector<double> res(n), ang(n);
+    Kernels::detail::forBlocks(nBlocks, n, nThreads, [&](size_t b) {
+        const size_t i1 = std::min(n, (b + 1) * kBlock);
+        for (size_t p = b * kBlock; p < i1; ++p) {
+            double len = std::sqrt(ni[p] * ni[p] + nj[p] * nj[p] + nk[p] * nk[p]);
+            double c = len > 0.0 ? (ux * ni[p] + uy * nj[p] + uz * nk[p]) / len : 0.0;
+            double e = (pl.ax * x[p] + pl.ay * y[p] + pl.az * z[p] + pl.c) * pl.inv - R * c;
+            double ac = std::min(std::fabs(c), 1.0);
+            res[p] = ac > 0.0 ? e / ac : 0.0;
+            ang[p] = len == 0.0 ? -1.0 : ac < cosMax ? -2.0 : std::acos(ac) * kDegree;
+        }
+    });
+
+    nr.residual.reserve(n);
+    nr.angle.reserve(n);
+    for (size_t p = 0; p < n; ++p) {
+        if (skip && skip[p]) continue;
+        if (ang[p] < 0.0) {
+            ++(ang[p] == -1.0 ? nr.nullNormals : nr.grazing);
+            continue;
+        }
+        nr.residual.push_back(res[p]);
+        nr.angle.push_back(ang[p]);
+    }
+    nr.used = nr.residual.size();
+    nr.residualStats = Kernels::summarize(nr.residual.data(), nr.used, nThreads);
+    nr.angleStats = Kernels::summarize(nr.angle.data(), nr.used, nThreads);
+    nr.valid = nr.used >= 3;
+    return nr;
+}
+
+} // namespace NormalResiduals
+
+#endif // NORMAL_RESIDUALS_H
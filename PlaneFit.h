@@ -0,0 +1,226 @@
+/*
+ * PlaneFit.h
+ *
+ * ------------------------------------------------------------
+ * Purpose:
+ *     Closed-form least-squares plane fit for flatnessScan.
+ *     Produces the same (ax, ay, az) parametrization used by the
+ *     Minuit2 fit in flatnessScan.cpp,
+ *
+ *         ax * X + ay * Y + az * (Z + offset) = 1
+ *
+ *     but without iterating: the plane minimizing the sum of
+ *     squared orthogonal distances passes through the centroid and
+ *     its normal is the eigenvector of the centered covariance
+ *     matrix with the smallest eigenvalue.
+ *
+ * Overview:
+ *     - PlaneFit::Moments accumulates, in a single streaming pass,
+ *       the weighted count, centroid and centered co-moments of the
+ *       points (West's weighted form of Welford's update, so that
+ *       millimetre coordinates and micron residuals do not cancel).
+ *     - PlaneFit::fitPCA() diagonalizes the 3x3 co-moment matrix
+ *       (cyclic Jacobi) and converts the normal to (ax, ay, az).
+ *     - Parameter errors are taken from the analytic Hessian of the
+ *       same χ² Minuit2 minimizes, so ax_e/ay_e/az_e are directly
+ *       comparable with min->Errors().
+ *
+ * Usage:
+ *     #include "PlaneFit.h"
+ *
+ *     PlaneFit::Moments m;
+ *     for (auto &p : points) m.add(p.coords[0], p.coords[1], p.coords[2]);
+ *     PlaneFit::Result fit = PlaneFit::fitPCA(m, offset);
+ *     // fit.ax, fit.ay, fit.az, fit.chi2 ...
+ *
+ * Notes:
+ *     chi2 is Σ (ax*X + ay*Y + az*(Z+offset) - 1)² / |a|², i.e. the
+ *     sum of squared orthogonal distances in mm², identical to the
+ *     value returned by chi2Func() at the minimum.
+ *
+ * ------------------------------------------------------------
+ * Author:    Luciano Ristori
+ * Created:   Oct 2025
+ * License:   MIT / open use
+ * ------------------------------------------------------------
+ */
+
+#ifndef PLANE_FIT_H
+#define PLANE_FIT_H
+
+#include <cmath>
+#include <cstddef>
+#include <utility>
+
+namespace PlaneFit {
+
+// ------------------------------------------------------------
+// Moments
+//   Weighted streaming centroid and centered co-moments.
+//   c[i][j] = Σ w (p_i - mean_i)(p_j - mean_j)
+// ------------------------------------------------------------
+struct Moments {
+    double w = 0.0;
+    double mean[3] = {0.0, 0.0, 0.0};
+    double c[3][3] = {{0.0, 0.0, 0.0}, {0.0, 0.0, 0.0}, {0.0, 0.0, 0.0}};
+
+    void add(double x, double y, double z, double weight = 1.0) {
+        double wNew = w + weight;
+        if (wNew == 0.0) { *this = Moments(); return; }
+        double p[3] = {x, y, z};
+        double d[3];
+        for (int i = 0; i < 3; ++i) {
+            d[i] = p[i] - mean[i];
+            mean[i] += d[i] * weight / wNew;
+        }
+        for (int i = 0; i < 3; ++i)
+            for (int j = i; j < 3; ++j)
+                c[i][j] += weight * d[i] * (p[j] - mean[j]);
+        for (int i = 0; i < 3; ++i)
+            for (int j = 0; j < i; ++j)
+                c[i][j] = c[j][i];
+        w = wNew;
+    }
+
+    // Combine two independent accumulations (Chan et al.)
+    void merge(const Moments &o) {
+        if (o.w == 0.0) return;
+        if (w == 0.0) { *this = o; return; }
+        double wNew = w + o.w;
+        double d[3];
+        for (int i = 0; i < 3; ++i) d[i] = o.mean[i] - mean[i];
+        for (int i = 0; i < 3; ++i)
+            for (int j = 0; j < 3; ++j)
+                c[i][j] += o.c[i][j] + d[i] * d[j] * w * o.w / wNew;
+        for (int i = 0; i < 3; ++i) mean[i] += d[i] * o.w / wNew;
+        w = wNew;
+    }
+
+    size_t count() const { return static_cast<size_t>(w + 0.5); }
+};
+
+struct Result {
+    bool valid = false;
+    double ax = 0.0, ay = 0.0, az = 0.0;
+    double axErr = 0.0, ayErr = 0.0, azErr = 0.0;
+    double chi2 = 0.0;                    // Σ squared orthogonal distances [mm²]
+    double normal[3] = {0.0, 0.0, 1.0};   // unit normal, oriented with +Z
+    double centroid[3] = {0.0, 0.0, 0.0};
+};
+
+// ------------------------------------------------------------
+// eigenSym3()
+//   Cyclic Jacobi diagonalization of a symmetric 3x3 matrix.
+//   Eigenvalues are returned in ascending order; column k of
+//   vecs is the eigenvector of vals[k].
+// ------------------------------------------------------------
+inline void eigenSym3(const double A[3][3], double vals[3], double vecs[3][3])
+{
+    double a[3][3];
+    for (int i = 0; i < 3; ++i)
+        for (int j = 0; j < 3; ++j) {
+            a[i][j] = A[i][j];
+            vecs[i][j] = (i == j) ? 1.0 : 0.0;
+        }
+
+    for (int sweep = 0; sweep < 50; ++sweep) {
+        double off = std::fabs(a[0][1]) + std::fabs(a[0][2]) + std::fabs(a[1][2]);
+        double diag = std::fabs(a[0][0]) + std::fabs(a[1][1]) + std::fabs(a[2][2]);
+        if (off <= 1e-30 * diag || off == 0.0) break;
+
+        for (int p = 0; p < 2; ++p) {
+            for (int q = p + 1; q < 3; ++q) {
+                if (a[p][q] == 0.0) continue;
+                double theta = (a[q][q] - a[p][p]) / (2.0 * a[p][q]);
+                double t = (theta >= 0 ? 1.0 : -1.0) /
+                           (std::fabs(theta) + std::sqrt(theta * theta + 1.0));
+                double cs = 1.0 / std::sqrt(t * t + 1.0);
+                double sn = t * cs;
+                for (int k = 0; k < 3; ++k) {
+                    double akp = a[k][p], akq = a[k][q];
+                    a[k][p] = cs * akp - sn * akq;
+                    a[k][q] = sn * akp + cs * akq;
+                }
+                for (int k = 0; k < 3; ++k) {
+                    double apk = a[p][k], aqk = a[q][k];
+                    a[p][k] = cs * apk - sn * aqk;
+                    a[q][k] = sn * apk + cs * aqk;
+                }
+                for (int k = 0; k < 3; ++k) {
+                    double vkp = vecs[k][p], vkq = vecs[k][q];
+                    vecs[k][p] = cs * vkp - sn * vkq;
+                    vecs[k][q] = sn * vkp + cs * vkq;
+                }
+            }
+        }
+    }
+
+    for (int i = 0; i < 3; ++i) vals[i] = a[i][i];
+
+    // --- sort ascending ---
+    for (int i = 0; i < 2; ++i)
+        for (int j = i + 1; j < 3; ++j)
+            if (vals[j] < vals[i]) {
+                std::swap(vals[i], vals[j]);
+                for (int k = 0; k < 3; ++k) std::swap(vecs[k][i], vecs[k][j]);
+            }
+}
+
+// ------------------------------------------------------------
+// fitPCA()
+//   Least-squares plane from accumulated moments.
+// ------------------------------------------------------------
+inline Result fitPCA(const Moments &m, double offset)
+{
+    Result r;
+    if (m.w < 3.0) return r;
+
+    double vals[3], vecs[3][3];
+    eigenSym3(m.c, vals, vecs);
+
+    double n[3] = {vecs[0][0], vecs[1][0], vecs[2][0]};
+    if (n[2] < 0) for (double &v : n) v = -v;
+
+    // plane: n·p' = D with p' = (X, Y, Z + offset)
+    double mu[3] = {m.mean[0], m.mean[1], m.mean[2] + offset};
+    double D = n[0] * mu[0] + n[1] * mu[1] + n[2] * mu[2];
+    if (D == 0.0) return r;
+
+    r.ax = n[0] / D;
+    r.ay = n[1] / D;
+    r.az = n[2] / D;
+    r.chi2 = vals[0] > 0.0 ? vals[0] : 0.0;
+    for (int i = 0; i < 3; ++i) {
+        r.normal[i] = n[i];
+        r.centroid[i] = m.mean[i];
+    }
+
+    // --- Parameter errors ---
+    // At the minimum the Hessian of χ²(a) = (aᵀSa - 2a·s + N)/|a|² is
+    // H = 2(S - χ²·I)/|a|², with S = Σ p'p'ᵀ.  Minuit2 reports
+    // V = 2·H⁻¹ = |a|²(S - χ²·I)⁻¹ for an error definition of 1.
+    double M[3][3];
+    for (int i = 0; i < 3; ++i)
+        for (int j = 0; j < 3; ++j)
+            M[i][j] = m.c[i][j] + m.w * mu[i] * mu[j] - (i == j ? r.chi2 : 0.0);
+
+    double cof00 = M[1][1] * M[2][2] - M[1][2] * M[2][1];
+    double cof11 = M[0][0] * M[2][2] - M[0][2] * M[2][0];
+    double cof22 = M[0][0] * M[1][1] - M[0][1] * M[1][0];
+    double det = M[0][0] * cof00
+               - M[0][1] * (M[1][0] * M[2][2] - M[1][2] * M[2][0])
+               + M[0][2] * (M[1][0] * M[2][1] - M[1][1] * M[2][0]);
+    if (det > 0.0) {
+        double moda2 = r.ax * r.ax + r.ay * r.ay + r.az * r.az;
+        r.axErr = std::sqrt(std::fabs(moda2 * cof00 / det));
+        r.ayErr = std::sqrt(std::fabs(moda2 * cof11 / det));
+        r.azErr = std::sqrt(std::fabs(moda2 * cof22 / det));
+    }
+
+    r.valid = true;
+    return r;
+}
+
+} // namespace PlaneFit
+
+#endif // PLANE_FIT_H
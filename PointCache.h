@@ -0,0 +1,266 @@
+/*
+ * PointCache.h
+ *
+ * ------------------------------------------------------------
+ * Purpose:
+ *     Binary sidecar cache of a parsed scan, so repeated analyses of
+ *     the same CSV (parameter sweeps over binning, offsets, fit
+ *     options) skip text parsing entirely.
+ *
+ * Overview:
+ *     - On first read flatnessScan writes <input>.fscache next to the
+ *       input: a fixed 256-byte header followed by float64 columns
+ *       (x, y, z, optional i/j/k normals) and int64 labels, each
+ *       column 64-byte aligned.
+ *     - The header holds the point count, the coordinate bounds and a
+ *       fingerprint of the source file.  Later runs mmap the sidecar
+ *       and, if the fingerprint still matches, analyze the columns in
+ *       place (PointView over the mapping, no copy, no parsing).
+ *     - The fingerprint is FNV-1a 64 over the source size, its
+ *       modification time and its first and last kHashWindow bytes,
+ *       so checking it costs two small reads whatever the file size.
+ *     - The sidecar is written to a temporary file of its own
+ *       (mkstemp(), <input>.fscache.XXXXXX) and renamed, so a crashed
+ *       run never leaves a half-written cache and concurrent writers of
+ *       the same input (a --serve pool, a parameter sweep) never write
+ *       into each other's file: the last rename wins, whole.
+ *
+ * Usage:
+ *     #include "PointCache.h"
+ *
+ *     PointCache::Mapped cache;
+ *     if (cache.open(input)) analyze(cache.view());
+ *     else { PointCloud c = readPointCloud(input); PointCache::write(input, c); }
+ *
+ * Notes:
+ *     Coordinates stay float64: float32 would lose the micron digits
+ *     of coordinates in the hundreds of millimetres.  The layout is
+ *     native little-endian (checked through kByteOrder on open).
+ *
+ * ------------------------------------------------------------
+ * Author:    Luciano Ristori
+ * Created:   Oct 2025
+ * License:   MIT / open use
+ * ------------------------------------------------------------
+ */
+
+#ifndef POINT_CACHE_H
+#define POINT_CACHE_H
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <fstream>
+#include <cstdio>
+#include <cstring>
+#include <cstdint>
+#include <cstddef>
+#include <limits>
+#include <algorithm>
+
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "MappedFile.h"
+#include "PointCloud.h"
+
+namespace PointCache {
+
+static_assert(sizeof(long) == 8, "PointCache stores labels as 64-bit long");
+
+enum Column { kX = 0, kY, kZ, kI, kJ, kK, kLabel, kNumColumns };
+
+constexpr char kMagic[8] = {'F', 'S', 'C', 'A', 'C', 'H', 'E', '\0'};
+constexpr uint32_t kVersion = 1;
+constexpr uint32_t kByteOrder = 0x01020304;
+constexpr size_t kAlign = 64;
+constexpr size_t kHashWindow = 64 * 1024;
+
+struct Header {
+    char magic[8];
+    uint32_t version;
+    uint32_t byteOrder;
+    uint64_t count;
+    uint64_t sourceHash;
+    double lo[3], hi[3];
+    uint64_t offset[kNumColumns];  // byte offset of each column, 0 if absent
+};
+static_assert(sizeof(Header) <= 256, "header must fit its 256-byte slot");
+constexpr size_t kHeaderBytes = 256;
+
+inline std::string sidecarPath(const std::string &input) { return input + ".fscache"; }
+
+// --- FNV-1a 64 ---
+inline uint64_t fnv1a(const void *data, size_t n, uint64_t h = 14695981039346656037ull)
+{
+    const unsigned char *p = static_cast<const unsigned char *>(data);
+    for (size_t q = 0; q < n; ++q) {
+        h ^= p[q];
+        h *= 1099511628211ull;
+    }
+    return h;
+}
+
+// ------------------------------------------------------------
+// sourceHash()
+//   Fingerprint of the input file; false if it cannot be read.
+// ------------------------------------------------------------
+inline bool sourceHash(const std::string &input, uint64_t &hash)
+{
+    struct stat st;
+    if (::stat(input.c_str(), &st) != 0) return false;
+    uint64_t size = static_cast<uint64_t>(st.st_size);
+#if defined(__APPLE__)
+    int64_t mtime[2] = {int64_t(st.st_mtimespec.tv_sec), int64_t(st.st_mtimespec.tv_nsec)};
+#else
+    int64_t mtime[2] = {int64_t(st.st_mtim.tv_sec), int64_t(st.st_mtim.tv_nsec)};
+#endif
+    uint64_t h = fnv1a(&size, sizeof(size));
+    h = fnv1a(mtime, sizeof(mtime), h);
+
+    std::ifstream in(input, std::ios::binary);
+    if (!in) return false;
+    std::vector<char> buf(kHashWindow);
+    in.read(buf.data(), static_cast<std::streamsize>(buf.size()));
+    h = fnv1a(buf.data(), static_cast<size_t>(in.gcount()), h);
+    if (size > 2 * kHashWindow) {
+        in.clear();
+        in.seekg(static_cast<std::streamoff>(size - kHashWindow));
+        in.read(buf.data(), static_cast<std::streamsize>(buf.size()));
+        h = fnv1a(buf.data(), static_cast<size_t>(in.gcount()), h);
+    }
+    hash = h;
+    return true;
+}
+
+// ------------------------------------------------------------
+// write()
+//   Stores cloud as the sidecar of input; false on any I/O error.
+// ------------------------------------------------------------
+inline bool write(const std::string &input, const PointCloud &cloud)
+{
+    Header hdr;
+    std::memset(&hdr, 0, sizeof(hdr));
+    std::memcpy(hdr.magic, kMagic, sizeof(kMagic));
+    hdr.version = kVersion;
+    hdr.byteOrder = kByteOrder;
+    hdr.count = cloud.size();
+    if (!sourceHash(input, hdr.sourceHash)) return false;
+
+    const std::vector<double> *cols[6] = {&cloud.x, &cloud.y, &cloud.z,
+                                          &cloud.i, &cloud.j, &cloud.k};
+    for (int c = 0; c < 3; ++c) {
+        const std::vector<double> &v = *cols[c];
+        hdr.lo[c] = v.empty() ? 0.0 : *std::min_element(v.begin(), v.end());
+        hdr.hi[c] = v.empty() ? 0.0 : *std::max_element(v.begin(), v.end());
+    }
+
+    const size_t colBytes = cloud.size() * 8;
+    const size_t stride = (colBytes + kAlign - 1) / kAlign * kAlign;
+    uint64_t pos = kHeaderBytes;
+    for (int c = 0; c < kNumColumns; ++c) {
+        bool present = (c < 3) || (c < kLabel ? cloud.hasNormals() : cloud.hasLabels());
+        if (!present) continue;
+        hdr.offset[c] = pos;
+        pos += stride;
+    }
+
+    std::string path = sidecarPath(input);
+    std::string tmp = path + ".XXXXXX";
+    {
+        int fd = ::mkstemp(&tmp[0]);
+        if (fd < 0) return false;
+        ::fchmod(fd, 0644);                  // mkstemp() creates it 0600
+        ::close(fd);
+        std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+        if (!out) {
+            std::remove(tmp.c_str());
+            return false;
+        }
+        char slot[kHeaderBytes] = {};
+        std::memcpy(slot, &hdr, sizeof(hdr));
+        out.write(slot, sizeof(slot));
+        static const char zeros[kAlign] = {};
+        for (int c = 0; c < kNumColumns; ++c) {
+            if (!hdr.offset[c]) continue;
+            const char *data = (c == kLabel)
+                ? reinterpret_cast<const char *>(cloud.label.data())
+                : reinterpret_cast<const char *>(cols[c]->data());
+            out.write(data, static_cast<std::streamsize>(colBytes));
+            out.write(zeros, static_cast<std::streamsize>(stride - colBytes));
+        }
+        if (!out) {
+            out.close();
+            std::remove(tmp.c_str());
+            return false;
+        }
+    }
+    if (std::rename(tmp.c_str(), path.c_str()) != 0) {
+        std::remove(tmp.c_str());
+        return false;
+    }
+    return true;
+}
+
+// ------------------------------------------------------------
+// Mapped
+//   A validated, memory-mapped sidecar.
+// ------------------------------------------------------------
+class Mapped {
+public:
+    // Maps the sidecar of input; false if absent, stale or malformed
+    bool open(const std::string &input) {
+        view_ = PointView();
+        file_.reset();
+        uint64_t hash = 0;
+        if (!sourceHash(input, hash)) return false;
+
+        std::unique_ptr<MappedFile> f(new MappedFile(sidecarPath(input)));
+        if (!f->ok() || f->size() < kHeaderBytes) return false;
+        std::memcpy(&hdr_, f->data(), sizeof(hdr_));
+        if (std::memcmp(hdr_.magic, kMagic, sizeof(kMagic)) != 0 ||
+            hdr_.version != kVersion || hdr_.byteOrder != kByteOrder ||
+            hdr_.sourceHash != hash)
+            return false;
+
+        const uint64_t colBytes = hdr_.count * 8;
+        for (int c = 0; c < kNumColumns; ++c) {
+            uint64_t off = hdr_.offset[c];
+            if (!off) {
+                if (c < kI) return false;       // x, y, z are mandatory
+                continue;
+            }
+            if (off % kAlign != 0 || off + colBytes > f->size()) return false;
+        }
+        if ((hdr_.offset[kI] != 0) != (hdr_.offset[kJ] != 0) ||
+            (hdr_.offset[kI] != 0) != (hdr_.offset[kK] != 0))
+            return false;
+
+        const size_t n = static_cast<size_t>(hdr_.count);
+        auto col = [&](int c) {
+            return hdr_.offset[c]
+                ? Span<double>(reinterpret_cast<const double *>(f->data() + hdr_.offset[c]), n)
+                : Span<double>();
+        };
+        view_.x = col(kX); view_.y = col(kY); view_.z = col(kZ);
+        view_.i = col(kI); view_.j = col(kJ); view_.k = col(kK);
+        if (hdr_.offset[kLabel])
+            view_.label = Span<long>(reinterpret_cast<const long *>(f->data() + hdr_.offset[kLabel]), n);
+        file_ = std::move(f);
+        return true;
+    }
+
+    bool ok() const { return file_ != nullptr; }
+    const PointView &view() const { return view_; }
+    const Header &header() const { return hdr_; }
+
+private:
+    std::unique_ptr<MappedFile> file_;
+    Header hdr_;
+    PointView view_;
+};
+
+} // namespace PointCache
+
+#endif // POINT_CACHE_H
@@ -0,0 +1,363 @@
+/*
+ * PointCloud.h
+ *
+ * ------------------------------------------------------------
+ * Purpose:
+ *     Structure-of-arrays storage for measured surface points.
+ *     Each coordinate lives in its own contiguous column, so the
+ *     fit, histogram and grid code can loop over plain arrays
+ *     instead of one heap-allocated coords vector per point.
+ *
+ * Overview:
+ *     - PointCloud holds x, y, z plus optional i, j, k normals and
+ *       optional integer point labels (empty columns when absent).
+ *     - Span<T> is a minimal read-only view (pointer + size) used to
+ *       hand columns to the analysis code without copying; PointView
+ *       bundles the spans of one scan.
+ *     - readPointCloud() loads a text/CSV file in one read, counts
+ *       the lines to size every column once, and parses the numbers
+ *       in place (no per-line std::string).
+ *     - Layout<Field...> fixes the column order of a file at compile
+ *       time: rows are parsed with a constant field count into a
+ *       std::array and stored without per-point branching.  The
+ *       first data line picks one of the four layouts below
+ *       (withLayout()), or the caller names one
+ *       (readPointCloud<Layouts::LabelXYZ>()), so every program
+ *       takes X and Y from the same columns.
+ *
+ * Accepted line formats (separators: comma, semicolon, blanks):
+ *       X Y Z
+ *       label X Y Z
+ *       X Y Z I J K
+ *       label X Y Z I J K        (ASTRAL CMM export)
+ *     Lines containing non-numeric fields (headers, timestamps) or
+ *     any other column count are skipped.
+ *
+ * Usage:
+ *     #include "PointCloud.h"
+ *
+ *     PointCloud cloud = readPointCloud("scan.csv");
+ *     for (size_t n = 0; n < cloud.size(); ++n)
+ *         use(cloud.x[n], cloud.y[n], cloud.z[n]);
+ *
+ *     PointCloud labeled = readPointCloud<Layouts::LabelXYZ>("grid.txt");
+ *
+ * ------------------------------------------------------------
+ * Author:    Luciano Ristori
+ * Created:   Oct 2025
+ * License:   MIT / open use
+ * ------------------------------------------------------------
+ */
+
+#ifndef POINT_CLOUD_H
+#define POINT_CLOUD_H
+
+#include <vector>
+#include <array>
+#include <string>
+#include <fstream>
+#include <iostream>
+#include <algorithm>
+#include <cstdlib>
+#include <cstddef>
+
+// ------------------------------------------------------------
+// Span
+//   Read-only view of a contiguous column.
+// ------------------------------------------------------------
+template <class T>
+struct Span {
+    const T *ptr = nullptr;
+    size_t n = 0;
+
+    Span() = default;
+    Span(const T *p, size_t count) : ptr(p), n(count) {}
+    Span(const std::vector<T> &v) : ptr(v.data()), n(v.size()) {}
+
+    const T &operator[](size_t idx) const { return ptr[idx]; }
+    const T *data() const { return ptr; }
+    const T *begin() const { return ptr; }
+    const T *end() const { return ptr + n; }
+    size_t size() const { return n; }
+    bool empty() const { return n == 0; }
+};
+
+struct PointView;
+
+// ------------------------------------------------------------
+// PointCloud
+// ------------------------------------------------------------
+struct PointCloud {
+    std::vector<double> x, y, z;
+    std::vector<double> i, j, k;   // surface normals (optional)
+    std::vector<long> label;       // point labels (optional)
+
+    size_t size() const { return x.size(); }
+    bool empty() const { return x.empty(); }
+    bool hasNormals() const { return !i.empty(); }
+    bool hasLabels() const { return !label.empty(); }
+
+    void reserve(size_t n, bool normals, bool labels) {
+        x.reserve(n); y.reserve(n); z.reserve(n);
+        if (normals) { i.reserve(n); j.reserve(n); k.reserve(n); }
+        if (labels) label.reserve(n);
+    }
+
+    Span<double> xs() const { return Span<double>(x); }
+    Span<double> ys() const { return Span<double>(y); }
+    Span<double> zs() const { return Span<double>(z); }
+
+    // Empties every column but keeps the allocations (chunked reading)
+    void clear() {
+        x.clear(); y.clear(); z.clear();
+        i.clear(); j.clear(); k.clear();
+        label.clear();
+    }
+
+    PointView view() const;
+};
+
+// ------------------------------------------------------------
+// PointView
+//   Read-only columns of a scan, either a PointCloud's vectors or
+//   external storage such as a memory-mapped cache (PointCache.h).
+//   Same accessors as PointCloud, so analysis code takes either.
+// ------------------------------------------------------------
+struct PointView {
+    Span<double> x, y, z;
+    Span<double> i, j, k;          // empty when absent
+    Span<long> label;              // empty when absent
+
+    size_t size() const { return x.size(); }
+    bool empty() const { return x.empty(); }
+    bool hasNormals() const { return !i.empty(); }
+    bool hasLabels() const { return !label.empty(); }
+
+    Span<double> xs() const { return x; }
+    Span<double> ys() const { return y; }
+    Span<double> zs() const { return z; }
+};
+
+inline PointView PointCloud::view() const
+{
+    PointView v;
+    v.x = x; v.y = y; v.z = z;
+    v.i = i; v.j = j; v.k = k;
+    v.label = label;
+    return v;
+}
+
+// ------------------------------------------------------------
+// Layout
+//   Column order of a point file, fixed at compile time, e.g.
+//   Layout<Field::Label, Field::X, Field::Y, Field::Z>.
+// ------------------------------------------------------------
+enum class Field { Label, X, Y, Z, I, J, K };
+
+template <Field... F>
+struct Layout {
+    static constexpr int kFields = sizeof...(F);
+    static constexpr bool kLabels = ((F == Field::Label) || ...);
+    static constexpr bool kNormals = ((F == Field::I) || ...);
+    using Row = std::array<double, kFields>;
+
+    // Exactly kFields numeric fields in [p, eol); eol as for parsePointLine()
+    static bool parse(const char *p, const char *eol, Row &v) {
+        for (int f = 0; f < kFields; ++f) {
+            p = skip(p, eol);
+            if (p == eol) return false;
+            char *stop = nullptr;
+            v[f] = std::strtod(p, &stop);
+            if (stop == p || stop > eol) return false;
+            p = stop;
+        }
+        return skip(p, eol) == eol;
+    }
+
+    static void reserve(PointCloud &cloud, size_t n) { cloud.reserve(n, kNormals, kLabels); }
+
+    static void append(PointCloud &cloud, const Row &v) {
+        int f = 0;
+        (store<F>(cloud, v[f++]), ...);
+    }
+
+private:
+    static const char *skip(const char *q, const char *eol) {
+        while (q < eol && (*q == ' ' || *q == '\t' || *q == ',' ||
+                           *q == ';' || *q == '\r')) ++q;
+        return q;
+    }
+
+    template <Field G>
+    static void store(PointCloud &cloud, double v) {
+        if constexpr (G == Field::Label) cloud.label.push_back(static_cast<long>(v));
+        else if constexpr (G == Field::X) cloud.x.push_back(v);
+        else if constexpr (G == Field::Y) cloud.y.push_back(v);
+        else if constexpr (G == Field::Z) cloud.z.push_back(v);
+        else if constexpr (G == Field::I) cloud.i.push_back(v);
+        else if constexpr (G == Field::J) cloud.j.push_back(v);
+        else cloud.k.push_back(v);
+    }
+};
+
+namespace Layouts {
+using XYZ         = Layout<Field::X, Field::Y, Field::Z>;
+using LabelXYZ    = Layout<Field::Label, Field::X, Field::Y, Field::Z>;
+using XYZIJK      = Layout<Field::X, Field::Y, Field::Z, Field::I, Field::J, Field::K>;
+using LabelXYZIJK = Layout<Field::Label, Field::X, Field::Y, Field::Z,
+                           Field::I, Field::J, Field::K>;   // ASTRAL CMM export
+}
+
+// ------------------------------------------------------------
+// withLayout()
+//   Calls f(L()) with the layout of nv fields (3, 4, 6 or 7);
+//   false for any other count.
+// ------------------------------------------------------------
+template <class Fn>
+inline bool withLayout(int nv, Fn &&f)
+{
+    switch (nv) {
+    case 3: f(Layouts::XYZ()); return true;
+    case 4: f(Layouts::LabelXYZ()); return true;
+    case 6: f(Layouts::XYZIJK()); return true;
+    case 7: f(Layouts::LabelXYZIJK()); return true;
+    default: return false;
+    }
+}
+
+// ------------------------------------------------------------
+// parseLines()
+//   Appends the lines of [p, end) that match layout L and returns
+//   the number of lines visited.  *end must be '\n' or '\0'.
+// ------------------------------------------------------------
+template <class L>
+inline size_t parseLines(const char *p, const char *end, PointCloud &cloud)
+{
+    typename L::Row v;
+    size_t lines = 0;
+    while (p < end) {
+        const char *eol = p;
+        while (eol < end && *eol != '\n') ++eol;
+        ++lines;
+        if (L::parse(p, eol, v)) L::append(cloud, v);
+        p = eol + 1;
+    }
+    return lines;
+}
+
+// ------------------------------------------------------------
+// parsePointLine()
+//   Parses up to 8 numeric fields of the line [p, eol) into v and
+//   returns their count, or -1 if a field is not numeric.  The byte
+//   at eol must be '\n' or '\0' so that strtod stops there.
+// ------------------------------------------------------------
+inline int parsePointLine(const char *p, const char *eol, double v[8])
+{
+    int nv = 0;
+    const char *q = p;
+    while (q < eol) {
+        while (q < eol && (*q == ' ' || *q == '\t' || *q == ',' ||
+                           *q == ';' || *q == '\r')) ++q;
+        if (q >= eol) break;
+        char *stop = nullptr;
+        double val = std::strtod(q, &stop);
+        if (stop == q || stop > eol || nv == 8) return -1;
+        v[nv++] = val;
+        q = stop;
+    }
+    return nv;
+}
+
+// ------------------------------------------------------------
+// appendPoint()
+//   Appends a line of nv fields (3, 4, 6 or 7) to the cloud.  The
+//   first point fixes the layout; returns false for lines that do
+//   not match it or have any other field count.
+// ------------------------------------------------------------
+inline bool appendPoint(PointCloud &cloud, const double v[8], int nv)
+{
+    if (nv != 3 && nv != 4 && nv != 6 && nv != 7) return false;
+    bool labels = (nv == 4 || nv == 7);
+    bool normals = (nv >= 6);
+    // Keep columns consistent: the first data line fixes the layout
+    if (labels != cloud.hasLabels() && !cloud.empty()) return false;
+    if (normals != cloud.hasNormals() && !cloud.empty()) return false;
+
+    return withLayout(nv, [&](auto layout) {
+        using L = decltype(layout);
+        typename L::Row row;
+        std::copy(v, v + L::kFields, row.begin());
+        L::append(cloud, row);
+    });
+}
+
+// ------------------------------------------------------------
+// readPointText()
+//   Whole file into buf with a terminating '\0' (stops strtod at
+//   the end of the buffer); false if it cannot be read or is empty.
+// ------------------------------------------------------------
+inline bool readPointText(const std::string &filename, std::string &buf)
+{
+    std::ifstream in(filename, std::ios::binary);
+    if (!in) {
+        std::cerr << "Error: cannot open file " << filename << std::endl;
+        return false;
+    }
+    in.seekg(0, std::ios::end);
+    std::streamoff fileSize = in.tellg();
+    in.seekg(0, std::ios::beg);
+    if (fileSize <= 0) return false;
+
+    buf.assign(static_cast<size_t>(fileSize), '\0');
+    in.read(&buf[0], fileSize);
+    return true;
+}
+
+// ------------------------------------------------------------
+// readPointCloud<L>()
+//   Reads a text/CSV point file of known layout L; lines of any
+//   other form are skipped.
+// ------------------------------------------------------------
+template <class L>
+inline PointCloud readPointCloud(const std::string &filename)
+{
+    PointCloud cloud;
+    std::string buf;
+    if (!readPointText(filename, buf)) return cloud;
+    L::reserve(cloud, std::count(buf.begin(), buf.end(), '\n') + 1);
+    parseLines<L>(buf.c_str(), buf.c_str() + buf.size(), cloud);
+    return cloud;
+}
+
+// ------------------------------------------------------------
+// readPointCloud()
+//   Reads a whole text/CSV point file into a PointCloud; the first
+//   data line fixes the layout.
+// ------------------------------------------------------------
+inline PointCloud readPointCloud(const std::string &filename)
+{
+    PointCloud cloud;
+    std::string buf;
+    if (!readPointText(filename, buf)) return cloud;
+    size_t nLines = std::count(buf.begin(), buf.end(), '\n') + 1;
+
+    const char *p = buf.c_str();
+    const char *end = p + buf.size();
+    while (p < end) {
+        const char *eol = p;
+        while (eol < end && *eol != '\n') ++eol;
+
+        double v[8];
+        int nv = parsePointLine(p, eol, v);
+        bool found = withLayout(nv, [&](auto layout) {
+            using L = decltype(layout);
+            L::reserve(cloud, nLines);
+            parseLines<L>(p, end, cloud);
+        });
+        if (found) break;
+        p = eol + 1;
+    }
+    return cloud;
+}
+
+#endif // POINT_CLOUD_H
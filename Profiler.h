@@ -0,0 +1,218 @@
+/*
+ * Profiler.h
+ *
+ * ------------------------------------------------------------
+ * Purpose:
+ *     Lightweight per-stage instrumentation for flatnessScan
+ *     (--profile): wall time, heap allocations and peak resident
+ *     memory of each numbered stage of the pipeline, plus named
+ *     counters (e.g. Minuit2 function calls).
+ *
+ * Overview:
+ *     - A Profile collects Stage records and counters; recording is
+ *       mutex-protected, so stages running on other threads (the
+ *       background ROOT writer, multi-file workers) may report into
+ *       the same Profile.
+ *     - A Scope times one stage from construction to next() or
+ *       destruction.  Every Scope call accepts a null Profile and then
+ *       does nothing, so the instrumentation stays in place when
+ *       profiling is off.
+ *     - Allocations are counted by noteAllocation(), called from the
+ *       program's replacement operator new; counting is off (one
+ *       relaxed load per allocation) until enableAllocationCounting().
+ *       The counters are process-wide: stages that overlap in time
+ *       (concurrent scans, writer thread and display) share them.
+ *     - Peak RSS is the process high-water mark from getrusage()
+ *       when the stage ends.
+ *     - print() writes a table, writeJson() a JSON object.
+ *
+ * Usage:
+ *     #include "Profiler.h"
+ *
+ *     Profiler::Profile prof;
+ *     {
+ *         Profiler::Scope s(&prof, "read");
+ *         ...
+ *         s.next("fit");
+ *         ...
+ *     }
+ *     prof.count("minuit_fcn_calls", n);
+ *     prof.print(std::cout);
+ *
+ * ------------------------------------------------------------
+ * Author:    Luciano Ristori
+ * Created:   Oct 2025
+ * License:   MIT / open use
+ * ------------------------------------------------------------
+ */
+
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <string>
+#include <vector>
+#include <map>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstddef>
+#include <iostream>
+#include <iomanip>
+
+#include <sys/resource.h>
+
+namespace Profiler {
+
+namespace detail {
+inline std::atomic<bool> counting{false};
+inline std::atomic<uint64_t> allocations{0};
+inline std::atomic<uint64_t> allocatedBytes{0};
+}
+
+// Called by operator new; a no-op until counting is enabled
+inline void noteAllocation(size_t bytes)
+{
+    if (!detail::counting.load(std::memory_order_relaxed)) return;
+    detail::allocations.fetch_add(1, std::memory_order_relaxed);
+    detail::allocatedBytes.fetch_add(bytes, std::memory_order_relaxed);
+}
+
+inline void enableAllocationCounting() { detail::counting.store(true); }
+
+// Process high-water resident set size [bytes]
+inline uint64_t peakRssBytes()
+{
+    struct rusage ru;
+    if (::getrusage(RUSAGE_SELF, &ru) != 0) return 0;
+#if defined(__APPLE__)
+    return static_cast<uint64_t>(ru.ru_maxrss);           // bytes on macOS
+#else
+    return static_cast<uint64_t>(ru.ru_maxrss) * 1024;    // kilobytes on Linux
+#endif
+}
+
+struct Stage {
+    std::string name;
+    double ms = 0.0;
+    uint64_t allocations = 0;
+    uint64_t allocatedBytes = 0;
+    uint64_t peakRss = 0;        // [bytes] at the end of the stage
+};
+
+class Profile {
+public:
+    void record(const Stage &s) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stages_.push_back(s);
+    }
+
+    void count(const std::string &counter, uint64_t n) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        counters_[counter] += n;
+    }
+
+    void print(std::ostream &os) const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        std::ios::fmtflags flags = os.flags();
+        std::streamsize prec = os.precision();
+        double total = 0.0;
+        os << "\n--- Profile -------------------------------------------------------\n"
+           << std::left << std::setw(18) << "  stage" << std::right
+           << std::setw(12) << "time [ms]" << std::setw(12) << "allocs"
+           << std::setw(14) << "alloc [MB]" << std::setw(15) << "peak RSS [MB]" << "\n"
+           << std::fixed;
+        for (const Stage &s : stages_) {
+            total += s.ms;
+            os << "  " << std::left << std::setw(16) << s.name << std::right
+               << std::setprecision(2) << std::setw(12) << s.ms
+               << std::setw(12) << s.allocations
+               << std::setprecision(1) << std::setw(14) << s.allocatedBytes / 1048576.0
+               << std::setw(15) << s.peakRss / 1048576.0 << "\n";
+        }
+        os << "  " << std::left << std::setw(16) << "total" << std::right
+           << std::setprecision(2) << std::setw(12) << total << "\n";
+        for (const auto &c : counters_)
+            os << "  " << c.first << ": " << c.second << "\n";
+        os << "-------------------------------------------------------------------\n";
+        os.flags(flags);
+        os.precision(prec);
+    }
+
+    void writeJson(std::ostream &os) const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        os << "{\"stages\": [";
+        for (size_t k = 0; k < stages_.size(); ++k) {
+            const Stage &s = stages_[k];
+            os << (k ? ", " : "") << "{\"name\": \"" << s.name << "\", \"ms\": " << s.ms
+               << ", \"allocations\": " << s.allocations
+               << ", \"allocated_bytes\": " << s.allocatedBytes
+               << ", \"peak_rss_bytes\": " << s.peakRss << "}";
+        }
+        os << "], \"counters\": {";
+        bool first = true;
+        for (const auto &c : counters_) {
+            os << (first ? "" : ", ") << "\"" << c.first << "\": " << c.second;
+            first = false;
+        }
+        os << "}}";
+    }
+
+private:
+    mutable std::mutex mutex_;
+    std::vector<Stage> stages_;
+    std::map<std::string, uint64_t> counters_;
+};
+
+// ------------------------------------------------------------
+// Scope
+//   Times a stage until next() (which starts the following stage)
+//   or destruction.  Does nothing when profile is null.
+// ------------------------------------------------------------
+class Scope {
+public:
+    Scope(Profile *profile, const char *name) : profile_(profile) { start(name); }
+    ~Scope() { stop(); }
+
+    Scope(const Scope &) = delete;
+    Scope &operator=(const Scope &) = delete;
+
+    void next(const char *name) {
+        stop();
+        start(name);
+    }
+
+    void stop() {
+        if (!profile_ || !running_) return;
+        running_ = false;
+        Stage s;
+        s.name = name_;
+        s.ms = std::chrono::duration<double, std::milli>(Clock::now() - t0_).count();
+        s.allocations = detail::allocations.load(std::memory_order_relaxed) - allocs0_;
+        s.allocatedBytes = detail::allocatedBytes.load(std::memory_order_relaxed) - bytes0_;
+        s.peakRss = peakRssBytes();
+        profile_->record(s);
+    }
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    void start(const char *name) {
+        if (!profile_) return;
+        name_ = name;
+        running_ = true;
+        allocs0_ = detail::allocations.load(std::memory_order_relaxed);
+        bytes0_ = detail::allocatedBytes.load(std::memory_order_relaxed);
+        t0_ = Clock::now();
+    }
+
+    Profile *profile_;
+    const char *name_ = "";
+    bool running_ = false;
+    uint64_t allocs0_ = 0, bytes0_ = 0;
+    Clock::time_point t0_;
+};
+
+} // namespace Profiler
+
+#endif // PROFILER_H
@@ -0,0 +1,276 @@
+/*
+ * Resample.h
+ *
+ * ------------------------------------------------------------
+ * Purpose:
+ *     Confidence intervals on the flatness figures themselves (σ and
+ *     peak-to-valley), for flatnessScan --resample: Minuit2 errors
+ *     describe the plane parameters, not the flatness.
+ *
+ * Overview:
+ *     - bootstrap[:K]  K replicates (default 200), each a multinomial
+ *       resample of the N points: the counts are drawn, every point
+ *       with count w > 0 is added to PlaneFit::Moments with weight w,
+ *       and the plane is refitted in closed form.  σ = sqrt(χ²/W)
+ *       comes from the fit; the peak-to-valley needs one more pass
+ *       over the drawn points.  Interval: 2.5 / 97.5 percentiles.
+ *     - jackknife[:G]  delete-a-group jackknife over G interleaved
+ *       groups (default 20, point i in group i % G).  The moments of
+ *       each group are accumulated once; replicate g merges the other
+ *       G-1 groups (O(G), no pass over the points for the fit).
+ *       Interval: estimate ± 1.96 SE, with
+ *       SE² = (G-1)/G Σ (θ_g - θ̄)².
+ *     - Replicates run on nThreads std::threads; replicate k draws
+ *       from its own generator seeded by (seed, k), so the result
+ *       does not depend on the number of threads.
+ *     - Peak-to-valley is an extreme-value statistic: a bootstrap
+ *       sample never contains points beyond the scan's own extremes,
+ *       so its interval sits at or below the estimate; the jackknife
+ *       interval is symmetric and the more useful of the two for it.
+ *     - skip[i] != 0 excludes point i (e.g. rejected by the robust
+ *       fit), as in the main figures.
+ *
+ * Usage:
+ *     #include "Resample.h"
+ *
+ *     Resample::Spec spec;
+ *     Resample::parse("bootstrap:500", spec);
+ *     Resample::Result rs = Resample::run(x, y, z, n, offset, spec, sigma, ptv, nThreads);
+ *     // rs.sigma.lo, rs.sigma.hi, rs.peakToValley.se, rs.sigmaReplicates ...
+ *
+ * ------------------------------------------------------------
+ * Author:    Luciano Ristori
+ * Created:   Oct 2025
+ * License:   MIT / open use
+ * ------------------------------------------------------------
+ */
+
+#ifndef RESAMPLE_H
+#define RESAMPLE_H
+
+#include <vector>
+#include <string>
+#include <thread>
+#include <random>
+#include <limits>
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstdint>
+#include <cstddef>
+
+#include "PlaneFit.h"
+#include "Kernels.h"
+
+namespace Resample {
+
+constexpr double kZ95 = 1.959963985;     // two-sided 95% normal quantile
+
+enum class Method { Bootstrap, Jackknife };
+
+struct Spec {
+    bool enabled = false;
+    Method method = Method::Bootstrap;
+    int replicates = 200;        // bootstrap K, or jackknife groups G
+    uint64_t seed = 12345;
+};
+
+struct Interval {
+    double estimate = 0.0;       // [mm] value of the full scan
+    double lo = 0.0, hi = 0.0;   // [mm] 95% interval
+    double se = 0.0;             // [mm] standard error
+};
+
+struct Result {
+    bool valid = false;
+    Method method = Method::Bootstrap;
+    int replicates = 0;
+    Interval sigma;
+    Interval peakToValley;
+    std::vector<double> sigmaReplicates;
+    std::vector<double> ptvReplicates;
+};
+
+inline const char *methodName(Method m) { return m == Method::Bootstrap ? "bootstrap" : "jackknife"; }
+
+// ------------------------------------------------------------
+// parse()
+//   "bootstrap[:K]" (K ≥ 10) or "jackknife[:G]" (G ≥ 2).
+// ------------------------------------------------------------
+inline bool parse(const std::string &text, Spec &spec)
+{
+    std::string name = text.substr(0, text.find(':'));
+    if (name == "bootstrap") { spec.method = Method::Bootstrap; spec.replicates = 200; }
+    else if (name == "jackknife") { spec.method = Method::Jackknife; spec.replicates = 20; }
+    else return false;
+    if (name.size() < text.size()) {
+        char *end = nullptr;
+        long k = std::strtol(text.c_str() + name.size() + 1, &end, 10);
+        if (*end != '\0' || end == text.c_str() + name.size() + 1) return false;
+        if (k < (spec.method == Method::Bootstrap ? 10 : 2) || k > 1000000) return false;
+        spec.replicates = static_cast<int>(k);
+    }
+    spec.enabled = true;
+    return true;
+}
+
+namespace detail {
+
+// Runs f(k) for k < n on nThreads threads, contiguous ranges
+template <class F>
+void parallelFor(size_t n, unsigned nThreads, F f)
+{
+    unsigned nt = static_cast<unsigned>(std::min<size_t>(std::max(1u, nThreads), n));
+    if (nt <= 1) {
+        for (size_t k = 0; k < n; ++k) f(k);
+        return;
+    }
+    std::vector<std::thread> threads;
+    threads.reserve(nt);
+    for (unsigned t = 0; t < nt; ++t) {
+        size_t k0 = n * t / nt, k1 = n * (t + 1) / nt;
+        threads.emplace_back([=, &f] { for (size_t k = k0; k < k1; ++k) f(k); });
+    }
+    for (auto &th : threads) th.join();
+}
+
+// Peak-to-valley of the residuals from fit over points with weight[i] > 0
+// (all points when weight is null), skipping skip[i] != 0
+inline double peakToValley(const double *x, const double *y, const double *z, size_t n,
+                           const PlaneFit::Result &fit, double offset,
+                           const unsigned *weight, const char *skip)
+{
+    const Kernels::Plane p = Kernels::makePlane(fit.ax, fit.ay, fit.az, offset);
+    double lo = std::numeric_limits<double>::max(), hi = -lo;
+    for (size_t i = 0; i < n; ++i) {
+        if ((weight && !weight[i]) || (skip && skip[i])) continue;
+        double d = p.ax * x[i] + p.ay * y[i] + p.az * z[i] + p.c;
+        lo = std::min(lo, d);
+        hi = std::max(hi, d);
+    }
+    return hi >= lo ? (hi - lo) * p.inv : 0.0;
+}
+
+inline Interval percentile(std::vector<double> v, double estimate)
+{
+    Interval iv;
+    iv.estimate = estimate;
+    std::sort(v.begin(), v.end());
+    auto at = [&](double q) {
+        double pos = q * (v.size() - 1);
+        size_t k = static_cast<size_t>(pos);
+        double f = pos - k;
+        return k + 1 < v.size() ? v[k] * (1 - f) + v[k + 1] * f : v[k];
+    };
+    iv.lo = at(0.025);
+    iv.hi = at(0.975);
+    double mean = 0.0, m2 = 0.0;
+    for (size_t k = 0; k < v.size(); ++k) {
+        double d = v[k] - mean;
+        mean += d / (k + 1);
+        m2 += d * (v[k] - mean);
+    }
+    iv.se = v.size() > 1 ? std::sqrt(m2 / (v.size() - 1)) : 0.0;
+    return iv;
+}
+
+inline Interval jackknife(const std::vector<double> &v, double estimate)
+{
+    Interval iv;
+    iv.estimate = estimate;
+    const double g = static_cast<double>(v.size());
+    double mean = 0.0;
+    for (double t : v) mean += t;
+    mean /= g;
+    double s2 = 0.0;
+    for (double t : v) s2 += (t - mean) * (t - mean);
+    iv.se = std::sqrt((g - 1) / g * s2);
+    iv.lo = std::max(0.0, estimate - kZ95 * iv.se);
+    iv.hi = estimate + kZ95 * iv.se;
+    return iv;
+}
+
+} // namespace detail
+
+// ------------------------------------------------------------
+// run()
+//   sigma and ptv are the full-scan figures the interval is about.
+// ------------------------------------------------------------
+inline Result run(const double *x, const double *y, const double *z, size_t n, double offset,
+                  const Spec &spec, double sigma, double ptv, unsigned nThreads = 1,
+                  const char *skip = nullptr)
+{
+    Result rs;
+    rs.method = spec.method;
+    rs.replicates = spec.replicates;
+    const size_t K = static_cast<size_t>(spec.replicates);
+    rs.sigmaReplicates.assign(K, 0.0);
+    rs.ptvReplicates.assign(K, 0.0);
+    std::vector<char> good(K, 0);
+
+    std::vector<size_t> kept;                 // indices of the points in play
+    kept.reserve(n);
+    for (size_t i = 0; i < n; ++i)
+        if (!skip || !skip[i]) kept.push_back(i);
+    if (kept.size() < 3 * (spec.method == Method::Jackknife ? K : 1)) return rs;
+
+    if (spec.method == Method::Bootstrap) {
+        detail::parallelFor(K, nThreads, [&](size_t k) {
+            std::mt19937_64 rng(spec.seed + 0x9E3779B97F4A7C15ull * (k + 1));
+            std::uniform_int_distribution<size_t> pick(0, kept.size() - 1);
+            std::vector<unsigned> w(n, 0);
+            for (size_t m = 0; m < kept.size(); ++m) ++w[kept[pick(rng)]];
+            PlaneFit::Moments mom;
+            for (size_t i : kept)
+                if (w[i]) mom.add(x[i], y[i], z[i], w[i]);
+            PlaneFit::Result fit = PlaneFit::fitPCA(mom, offset);
+            if (!fit.valid) return;
+            rs.sigmaReplicates[k] = std::sqrt(fit.chi2 / mom.w);
+            rs.ptvReplicates[k] = detail::peakToValley(x, y, z, n, fit, offset, w.data(), skip);
+            good[k] = 1;
+        });
+    } else {
+        // Moments of each group once; replicate g merges all the others
+        std::vector<PlaneFit::Moments> group(K);
+        for (size_t m = 0; m < kept.size(); ++m) {
+            size_t i = kept[m];
+            group[m % K].add(x[i], y[i], z[i]);
+        }
+        detail::parallelFor(K, nThreads, [&](size_t g) {
+            PlaneFit::Moments mom;
+            for (size_t h = 0; h < K; ++h)
+                if (h != g) mom.merge(group[h]);
+            PlaneFit::Result fit = PlaneFit::fitPCA(mom, offset);
+            if (!fit.valid) return;
+            rs.sigmaReplicates[g] = std::sqrt(fit.chi2 / mom.w);
+            // Peak-to-valley over the points outside group g
+            const Kernels::Plane p = Kernels::makePlane(fit.ax, fit.ay, fit.az, offset);
+            double lo = std::numeric_limits<double>::max(), hi = -lo;
+            for (size_t m = 0; m < kept.size(); ++m) {
+                if (m % K == g) continue;
+                size_t i = kept[m];
+                double d = p.ax * x[i] + p.ay * y[i] + p.az * z[i] + p.c;
+                lo = std::min(lo, d);
+                hi = std::max(hi, d);
+            }
+            rs.ptvReplicates[g] = (hi - lo) * p.inv;
+            good[g] = 1;
+        });
+    }
+
+    for (char g : good)
+        if (!g) return rs;
+    if (spec.method == Method::Bootstrap) {
+        rs.sigma = detail::percentile(rs.sigmaReplicates, sigma);
+        rs.peakToValley = detail::percentile(rs.ptvReplicates, ptv);
+    } else {
+        rs.sigma = detail::jackknife(rs.sigmaReplicates, sigma);
+        rs.peakToValley = detail::jackknife(rs.ptvReplicates, ptv);
+    }
+    rs.valid = true;
+    return rs;
+}
+
+} // namespace Resample
+
+#endif // RESAMPLE_H
@@ -0,0 +1,150 @@
+/*
+ * ScanAccumulator.h
+ *
+ * ------------------------------------------------------------
+ * Purpose:
+ *     Single-pass statistics for a surface scan.  Everything the
+ *     plane fit, the coordinate ranges and the flatness summary need
+ *     is collected while the points are visited once, instead of
+ *     walking (and copying) the data for each step.
+ *
+ * Overview:
+ *     - ScanAccumulator::add(x, y, z) updates
+ *         count, centroid and centered cross-moments (PlaneFit::Moments)
+ *         per-coordinate minimum and maximum
+ *     - residuals(ax, ay, az, offset) returns mean, σ and RMS of the
+ *       orthogonal residuals for ANY plane in closed form, because a
+ *       residual is linear in the point coordinates:
+ *           mean = (a·μ' - 1) / |a|
+ *           var  = aᵀ C a / (|a|² N)
+ *     - RunningStats is a one-dimensional Welford accumulator (mean,
+ *       variance, min, max) for quantities that need a per-point pass,
+ *       e.g. the residual peak-to-valley during histogram filling.
+ *
+ * Usage:
+ *     #include "ScanAccumulator.h"
+ *
+ *     ScanAccumulator acc;
+ *     for (...) acc.add(x, y, z);
+ *     PlaneFit::Result fit = PlaneFit::fitPCA(acc.moments, offset);
+ *     ScanAccumulator::Residuals r = acc.residuals(fit.ax, fit.ay, fit.az, offset);
+ *
+ * Notes:
+ *     Accumulators built on separate subsets can be combined with
+ *     merge(), which is exact (Chan et al. pairwise update).
+ *
+ * ------------------------------------------------------------
+ * Author:    Luciano Ristori
+ * Created:   Oct 2025
+ * License:   MIT / open use
+ * ------------------------------------------------------------
+ */
+
+#ifndef SCAN_ACCUMULATOR_H
+#define SCAN_ACCUMULATOR_H
+
+#include <cmath>
+#include <cstddef>
+#include <limits>
+#include <algorithm>
+
+#include "PlaneFit.h"
+
+// ------------------------------------------------------------
+// RunningStats
+//   Welford mean/variance plus extrema of a scalar stream.
+// ------------------------------------------------------------
+struct RunningStats {
+    size_t n = 0;
+    double mean = 0.0;
+    double m2 = 0.0;
+    double min = std::numeric_limits<double>::max();
+    double max = std::numeric_limits<double>::lowest();
+
+    void add(double v) {
+        ++n;
+        double d = v - mean;
+        mean += d / n;
+        m2 += d * (v - mean);
+        if (v < min) min = v;
+        if (v > max) max = v;
+    }
+
+    void merge(const RunningStats &o) {
+        if (o.n == 0) return;
+        if (n == 0) { *this = o; return; }
+        size_t nNew = n + o.n;
+        double d = o.mean - mean;
+        m2 += o.m2 + d * d * double(n) * double(o.n) / nNew;
+        mean += d * double(o.n) / nNew;
+        n = nNew;
+        min = std::min(min, o.min);
+        max = std::max(max, o.max);
+    }
+
+    double variance() const { return n > 0 ? m2 / n : 0.0; }
+    double sigma() const { return std::sqrt(variance()); }
+    double peakToValley() const { return n > 0 ? max - min : 0.0; }
+};
+
+// ------------------------------------------------------------
+// ScanAccumulator
+// ------------------------------------------------------------
+struct ScanAccumulator {
+    PlaneFit::Moments moments;
+    double lo[3] = {std::numeric_limits<double>::max(),
+                    std::numeric_limits<double>::max(),
+                    std::numeric_limits<double>::max()};
+    double hi[3] = {std::numeric_limits<double>::lowest(),
+                    std::numeric_limits<double>::lowest(),
+                    std::numeric_limits<double>::lowest()};
+
+    struct Residuals {
+        double mean = 0.0;    // [mm]
+        double sigma = 0.0;   // spread around the mean [mm]
+        double rms = 0.0;     // sqrt(χ²/N), the σ printed by flatnessScan [mm]
+    };
+
+    void add(double x, double y, double z) {
+        moments.add(x, y, z);
+        const double p[3] = {x, y, z};
+        for (int i = 0; i < 3; ++i) {
+            if (p[i] < lo[i]) lo[i] = p[i];
+            if (p[i] > hi[i]) hi[i] = p[i];
+        }
+    }
+
+    void merge(const ScanAccumulator &o) {
+        moments.merge(o.moments);
+        for (int i = 0; i < 3; ++i) {
+            lo[i] = std::min(lo[i], o.lo[i]);
+            hi[i] = std::max(hi[i], o.hi[i]);
+        }
+    }
+
+    size_t count() const { return moments.count(); }
+
+    // Residual statistics of the plane ax*X + ay*Y + az*(Z+offset) = 1
+    Residuals residuals(double ax, double ay, double az, double offset) const {
+        Residuals r;
+        if (moments.w <= 0.0) return r;
+        const double a[3] = {ax, ay, az};
+        double moda2 = ax * ax + ay * ay + az * az;
+        if (moda2 == 0.0) return r;
+
+        double amu = ax * moments.mean[0] + ay * moments.mean[1]
+                   + az * (moments.mean[2] + offset);
+        double aCa = 0.0;
+        for (int i = 0; i < 3; ++i)
+            for (int j = 0; j < 3; ++j)
+                aCa += a[i] * moments.c[i][j] * a[j];
+
+        double var = std::max(0.0, aCa / (moda2 * moments.w));
+        r.mean = (amu - 1.0) / std::sqrt(moda2);
+        r.sigma = std::sqrt(var);
+        r.rms = std::sqrt(var + r.mean * r.mean);
+        return r;
+    }
+};
+
+#endif // SCAN_ACCUMULATOR_H
@@ -0,0 +1,139 @@
+/*
+ * ScanHistograms.h
+ *
+ * ------------------------------------------------------------
+ * Purpose:
+ *     The histograms every flatnessScan run writes, booked and
+ *     filled in one place so the benchmark (bench.cpp) times exactly
+ *     what the program does.
+ *
+ * Overview:
+ *     - book() creates hX, hY, hZ and hDeviations, binned by
+ *       Binning::make() from the accumulated moments and ranges and
+ *       from the residual statistics.
+ *     - fill() adds a block of points to them; called once for an
+ *       in-memory scan, once per chunk for --stream.
+ *     - maps() turns a filled FlatnessMap into hZMap and hZRMSMap,
+ *       titled in grid-frame coordinates X', Y' when the grid is
+ *       rotated.
+ *
+ * Usage:
+ *     #include "ScanHistograms.h"
+ *
+ *     std::vector<TH1D*> h = ScanHistograms::book(spec, acc, residStats, n);
+ *     ScanHistograms::fill(h, x, y, z, residuals, n);
+ *     TH2D *hZ, *hZRms;
+ *     ScanHistograms::maps(map, grid, hZ, hZRms);
+ *
+ * Notes:
+ *     The histograms are owned by the caller.
+ *
+ * ------------------------------------------------------------
+ * Author:    Luciano Ristori
+ * Created:   Oct 2025
+ * License:   MIT / open use
+ * ------------------------------------------------------------
+ */
+
+#ifndef SCAN_HISTOGRAMS_H
+#define SCAN_HISTOGRAMS_H
+
+#include <vector>
+#include <string>
+#include <sstream>
+#include <iomanip>
+#include <cmath>
+#include <cstddef>
+
+#include "TH1D.h"
+#include "TH2D.h"
+
+#include "Binning.h"
+#include "ScanAccumulator.h"
+#include "GridFinder.h"
+#include "FlatnessMap.h"
+
+namespace ScanHistograms {
+
+// ------------------------------------------------------------
+// book()
+//   hX, hY, hZ and hDeviations, in that order, empty.
+// ------------------------------------------------------------
+inline std::vector<TH1D*> book(const Binning::Spec &spec, const ScanAccumulator &acc,
+                               const RunningStats &residStats, size_t nPoints)
+{
+    static const char *names[3] = {"hX", "hY", "hZ"};
+    static const char *titles[3] = {"X Coordinate Distribution", "Y Coordinate Distribution",
+                                    "Z Coordinate Distribution"};
+    static const char *axes[3] = {"X [mm]", "Y [mm]", "Z [mm]"};
+    std::vector<TH1D*> hists;
+
+    for (int i = 0; i < 3; ++i) {
+        double sigma = std::sqrt(acc.moments.c[i][i] / acc.moments.w);
+        Binning::Axis axis = Binning::make(spec, acc.lo[i], acc.hi[i], sigma, nPoints);
+        auto *h = new TH1D(names[i], titles[i], axis.nBins, axis.lo, axis.hi);
+        h->GetXaxis()->SetTitle(axes[i]);
+        h->GetYaxis()->SetTitle("Counts");
+        hists.push_back(h);
+    }
+
+    Binning::Axis dAxis = Binning::make(spec, residStats.min, residStats.max,
+                                        residStats.sigma(), nPoints);
+    auto *hDev = new TH1D("hDeviations", "Deviations from 3D Plane Fit",
+                          dAxis.nBins, dAxis.lo, dAxis.hi);
+    hDev->GetXaxis()->SetTitle("Residual [mm]");
+    hDev->GetYaxis()->SetTitle("Counts");
+    hists.push_back(hDev);
+    return hists;
+}
+
+// ------------------------------------------------------------
+// fill()
+//   n points and their residuals into hists[0..3] from book().
+// ------------------------------------------------------------
+inline void fill(const std::vector<TH1D*> &hists, const double *x, const double *y,
+                 const double *z, const double *residuals, size_t n)
+{
+    hists[0]->FillN(static_cast<int>(n), x, nullptr);
+    hists[1]->FillN(static_cast<int>(n), y, nullptr);
+    hists[2]->FillN(static_cast<int>(n), z, nullptr);
+    hists[3]->FillN(static_cast<int>(n), residuals, nullptr);
+}
+
+// ------------------------------------------------------------
+// maps()
+//   hZMap (cell means) and hZRMSMap (cell RMS) of a filled map;
+//   empty cells are left at zero.
+// ------------------------------------------------------------
+inline void maps(const FlatnessMap &map, const GridFinder::Result &grid,
+                 TH2D *&hZ, TH2D *&hZRms)
+{
+    std::string zTitle = "Flatness Map;X [mm];Y [mm];Z [mm]";
+    std::string rmsTitle = "Per-cell Z RMS;X [mm];Y [mm];RMS Z [mm]";
+    if (grid.angle != 0.0) {
+        std::ostringstream frame;
+        frame << std::setprecision(4) << " (grid frame, rotated "
+              << grid.angle * 180.0 / GridFinder::kPi << " deg);X' [mm];Y' [mm];";
+        zTitle = "Flatness Map" + frame.str() + "Z [mm]";
+        rmsTitle = "Per-cell Z RMS" + frame.str() + "RMS Z [mm]";
+    }
+    hZ = new TH2D("hZMap", zTitle.c_str(),
+                  grid.Nx, grid.xMin - grid.dx/2, grid.xMax + grid.dx/2,
+                  grid.Ny, grid.yMin - grid.dy/2, grid.yMax + grid.dy/2);
+    hZRms = new TH2D("hZRMSMap", rmsTitle.c_str(),
+                     grid.Nx, grid.xMin - grid.dx/2, grid.xMax + grid.dx/2,
+                     grid.Ny, grid.yMin - grid.dy/2, grid.yMax + grid.dy/2);
+
+    for (int iy = 0; iy < map.Ny; ++iy)
+        for (int ix = 0; ix < map.Nx; ++ix) {
+            if (!map.count[map.index(ix, iy)]) continue;
+            hZ->SetBinContent(ix + 1, iy + 1, map.mean(ix, iy));
+            hZRms->SetBinContent(ix + 1, iy + 1, map.rms(ix, iy));
+        }
+    hZ->SetStats(0);  // disables stats box for this histogram
+    hZRms->SetStats(0);
+}
+
+} // namespace ScanHistograms
+
+#endif // SCAN_HISTOGRAMS_H
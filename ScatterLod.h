@@ -0,0 +1,147 @@
+/*
+ * ScatterLod.h
+ *
+ * ------------------------------------------------------------
+ * Purpose:
+ *     Level-of-detail selection for the Y vs X scatter plot of very
+ *     large scans: at most a fixed number of points is ever handed to
+ *     ROOT, whatever the scan size, and zooming in brings back full
+ *     resolution once the visible window holds few enough points.
+ *
+ * Overview:
+ *     - The points are bucketed on a kBuckets × kBuckets grid over
+ *       their bounding box by one counting sort (O(N), one index
+ *       array), built lazily on the first select().
+ *     - select() visits only the buckets overlapping the window,
+ *       counts the points inside it and, if there are more than
+ *       maxPoints, keeps every k-th in bucket order.  Each bucket
+ *       thus contributes in proportion to its density, and the same
+ *       window always gives the same points.
+ *     - The coordinates are not copied: the columns must outlive the
+ *       object.
+ *
+ * Usage:
+ *     #include "ScatterLod.h"
+ *
+ *     ScatterLod lod(x, y, n);
+ *     std::vector<double> sx, sy;
+ *     size_t stride = lod.select(x0, x1, y0, y1, 50000, sx, sy);
+ *
+ * ------------------------------------------------------------
+ * Author:    Luciano Ristori
+ * Created:   Oct 2025
+ * License:   MIT / open use
+ * ------------------------------------------------------------
+ */
+
+#ifndef SCATTER_LOD_H
+#define SCATTER_LOD_H
+
+#include <vector>
+#include <limits>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstddef>
+
+class ScatterLod {
+public:
+    static constexpr int kBuckets = 256;     // per axis
+    static constexpr size_t kDefaultMaxPoints = 100000;
+
+    ScatterLod(const double *px, const double *py, size_t n) : px_(px), py_(py), n_(n) {}
+
+    size_t size() const { return n_; }
+
+    double xMin() const { build(); return x0_; }
+    double xMax() const { build(); return x1_; }
+    double yMin() const { build(); return y0_; }
+    double yMax() const { build(); return y1_; }
+
+    // ------------------------------------------------------------
+    // select()
+    //   Points inside [x0, x1] × [y0, y1] into sx, sy, decimated to at
+    //   most maxPoints; returns the stride used (1 = full resolution).
+    // ------------------------------------------------------------
+    size_t select(double x0, double x1, double y0, double y1, size_t maxPoints,
+                  std::vector<double> &sx, std::vector<double> &sy) const {
+        build();
+        sx.clear();
+        sy.clear();
+        if (n_ == 0 || x1 < x0 || y1 < y0) return 1;
+        const int bx0 = bucketX(x0), bx1 = bucketX(x1);
+        const int by0 = bucketY(y0), by1 = bucketY(y1);
+        auto inside = [&](uint32_t i) {
+            return px_[i] >= x0 && px_[i] <= x1 && py_[i] >= y0 && py_[i] <= y1;
+        };
+        auto forEach = [&](auto f) {
+            for (int by = by0; by <= by1; ++by)
+                for (int bx = bx0; bx <= bx1; ++bx) {
+                    size_t b = size_t(bx) + size_t(kBuckets) * size_t(by);
+                    bool edge = bx == bx0 || bx == bx1 || by == by0 || by == by1;
+                    for (uint32_t k = start_[b]; k < start_[b + 1]; ++k)
+                        if (!edge || inside(order_[k])) f(order_[k]);
+                }
+        };
+
+        size_t count = 0;
+        forEach([&](uint32_t) { ++count; });
+        const size_t stride = maxPoints > 0 && count > maxPoints
+                            ? (count + maxPoints - 1) / maxPoints : 1;
+        sx.reserve(count / stride + 1);
+        sy.reserve(count / stride + 1);
+        size_t m = 0;
+        forEach([&](uint32_t i) {
+            if (m++ % stride) return;
+            sx.push_back(px_[i]);
+            sy.push_back(py_[i]);
+        });
+        return stride;
+    }
+
+private:
+    int bucketX(double x) const { return clampBucket((x - x0_) * sxInv_); }
+    int bucketY(double y) const { return clampBucket((y - y0_) * syInv_); }
+    static int clampBucket(double t) {
+        if (!(t > 0)) return 0;
+        return t >= kBuckets ? kBuckets - 1 : static_cast<int>(t);
+    }
+
+    void build() const {
+        if (built_) return;
+        built_ = true;
+        x0_ = y0_ = std::numeric_limits<double>::max();
+        x1_ = y1_ = -std::numeric_limits<double>::max();
+        for (size_t i = 0; i < n_; ++i) {
+            x0_ = std::min(x0_, px_[i]);  x1_ = std::max(x1_, px_[i]);
+            y0_ = std::min(y0_, py_[i]);  y1_ = std::max(y1_, py_[i]);
+        }
+        if (n_ == 0) x0_ = x1_ = y0_ = y1_ = 0.0;
+        sxInv_ = x1_ > x0_ ? kBuckets / (x1_ - x0_) : 0.0;
+        syInv_ = y1_ > y0_ ? kBuckets / (y1_ - y0_) : 0.0;
+
+        // Counting sort of the point indices by bucket
+        const size_t nb = size_t(kBuckets) * kBuckets;
+        start_.assign(nb + 1, 0);
+        std::vector<uint32_t> bucket(n_);
+        for (size_t i = 0; i < n_; ++i) {
+            bucket[i] = static_cast<uint32_t>(bucketX(px_[i]) + size_t(kBuckets) * bucketY(py_[i]));
+            ++start_[bucket[i] + 1];
+        }
+        for (size_t b = 0; b < nb; ++b) start_[b + 1] += start_[b];
+        order_.resize(n_);
+        std::vector<uint32_t> fill(start_.begin(), start_.end() - 1);
+        for (size_t i = 0; i < n_; ++i) order_[fill[bucket[i]]++] = static_cast<uint32_t>(i);
+    }
+
+    const double *px_;
+    const double *py_;
+    size_t n_;
+    mutable bool built_ = false;
+    mutable double x0_ = 0, x1_ = 0, y0_ = 0, y1_ = 0;
+    mutable double sxInv_ = 0, syInv_ = 0;
+    mutable std::vector<uint32_t> start_;    // bucket b holds order_[start_[b] .. start_[b+1])
+    mutable std::vector<uint32_t> order_;
+};
+
+#endif // SCATTER_LOD_H
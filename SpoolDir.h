@@ -0,0 +1,230 @@
+/*
+ * SpoolDir.h
+ *
+ * ------------------------------------------------------------
+ * Purpose:
+ *     Job queue on a watched spool directory, for the long-running
+ *     flatnessScan --serve mode: a client (e.g. the MES) drops a job
+ *     file, the server analyzes it in its already initialized ROOT
+ *     process and leaves the JSON summary next to it.
+ *
+ * Overview:
+ *     <spool>/<name>.job          queued job, written by the client
+ *     <spool>/running/<name>.<pid>@<host>.job
+ *                                 claimed by server <pid> on <host>
+ *     <spool>/done/<name>.json    summary of a finished job (and .log)
+ *     <spool>/failed/<name>.json  {"error": ...} of a failed job (and .log)
+ *
+ *     - A job file holds the arguments of one flatnessScan run, split
+ *       on blanks and newlines; "double quotes" keep a path with
+ *       blanks together, lines starting with '#' are comments.
+ *       Relative paths are taken from the server's working directory.
+ *     - Clients should write <name>.tmp and rename it to <name>.job,
+ *       so that a job is never read half written.
+ *     - claim() is a rename into running/ under the server's own tag,
+ *       atomic on one file system: several servers can share a spool
+ *       directory and each job runs once.  open() puts back in the queue
+ *       only the jobs whose owner is gone (same host, no such process);
+ *       those of a live server, or of another host, are left alone.
+ *     - finish() moves the job file to done/ or failed/ and writes the
+ *       .log, then the .json through a temporary file: the .json
+ *       appearing is the completion signal.
+ *     - Plain POSIX directory polling (no inotify / kqueue), so the
+ *       same code runs on macOS and Linux.
+ *
+ * Usage:
+ *     #include "SpoolDir.h"
+ *
+ *     SpoolDir spool("/var/spool/flatness");
+ *     std::string error;
+ *     if (!spool.open(error)) ...
+ *     for (const std::string &name : spool.pending())
+ *         if (spool.claim(name)) {
+ *             std::vector<std::string> args = spool.arguments(name);
+ *             ...
+ *             spool.finish(name, ok, json, log);
+ *         }
+ *
+ * ------------------------------------------------------------
+ * Author:    Luciano Ristori
+ * Created:   Oct 2025
+ * License:   MIT / open use
+ * ------------------------------------------------------------
+ */
+
+#ifndef SPOOL_DIR_H
+#define SPOOL_DIR_H
+
+#include <vector>
+#include <string>
+#include <fstream>
+#include <algorithm>
+#include <utility>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+
+#include <dirent.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+class SpoolDir {
+public:
+    explicit SpoolDir(const std::string &root) : root_(root) {
+        while (root_.size() > 1 && root_.back() == '/') root_.pop_back();
+        char host[256] = {};
+        if (::gethostname(host, sizeof host - 1) != 0 || !*host) std::strcpy(host, "localhost");
+        host_ = host;
+        owner_ = std::to_string(::getpid()) + "@" + host_;
+    }
+
+    const std::string &root() const { return root_; }
+
+    // ------------------------------------------------------------
+    // open()
+    //   Creates running/, done/ and failed/ if needed and requeues
+    //   the jobs left in running/ by a server of this host that is no
+    //   longer running; false (with a message) on error.
+    // ------------------------------------------------------------
+    bool open(std::string &error) {
+        struct stat st;
+        if (::stat(root_.c_str(), &st) != 0 || !S_ISDIR(st.st_mode)) {
+            error = "spool directory " + root_ + " does not exist";
+            return false;
+        }
+        for (const char *sub : {"running", "done", "failed"}) {
+            std::string d = root_ + "/" + sub;
+            if (::mkdir(d.c_str(), 0775) != 0 && errno != EEXIST) {
+                error = "cannot create " + d + ": " + std::strerror(errno);
+                return false;
+            }
+        }
+        for (const auto &claimed : jobsIn(root_ + "/running")) {
+            std::string name;
+            if (ownerGone(claimed, name))
+                std::rename(jobPath("running", claimed).c_str(), jobPath("", name).c_str());
+        }
+        return true;
+    }
+
+    // Queued job names, oldest first (modification time, then name)
+    std::vector<std::string> pending() const {
+        std::vector<std::pair<long long, std::string>> jobs;
+        for (const auto &name : jobsIn(root_)) {
+            struct stat st;
+            if (::stat(jobPath("", name).c_str(), &st) == 0 && S_ISREG(st.st_mode))
+                jobs.emplace_back(static_cast<long long>(st.st_mtime), name);
+        }
+        std::sort(jobs.begin(), jobs.end());
+        std::vector<std::string> names;
+        for (auto &j : jobs) names.push_back(j.second);
+        return names;
+    }
+
+    // Moves the job to running/; false if another server took it first
+    bool claim(const std::string &name) {
+        return std::rename(jobPath("", name).c_str(), runningPath(name).c_str()) == 0;
+    }
+
+    // Arguments of a claimed job
+    std::vector<std::string> arguments(const std::string &name) const {
+        std::ifstream in(runningPath(name));
+        std::vector<std::string> args;
+        std::string line;
+        while (std::getline(in, line)) {
+            size_t p = line.find_first_not_of(" \t\r");
+            if (p == std::string::npos || line[p] == '#') continue;
+            std::string arg;
+            bool quoted = false, any = false;
+            for (; p < line.size(); ++p) {
+                char c = line[p];
+                if (c == '"') { quoted = !quoted; any = true; }
+                else if (!quoted && (c == ' ' || c == '\t' || c == '\r')) {
+                    if (any) args.push_back(arg);
+                    arg.clear();
+                    any = false;
+                } else { arg += c; any = true; }
+            }
+            if (any) args.push_back(arg);
+        }
+        return args;
+    }
+
+    // File of job `name` under done/ (e.g. resultPath(name, ".root"))
+    std::string resultPath(const std::string &name, const std::string &ext) const {
+        return root_ + "/done/" + name + ext;
+    }
+
+    // ------------------------------------------------------------
+    // finish()
+    //   Files a claimed job under done/ (ok) or failed/ with its log
+    //   and JSON; false if the JSON could not be written.
+    // ------------------------------------------------------------
+    bool finish(const std::string &name, bool ok, const std::string &json, const std::string &log) {
+        const char *sub = ok ? "done" : "failed";
+        std::string base = root_ + "/" + sub + "/" + name;
+        std::rename(runningPath(name).c_str(), (base + ".job").c_str());
+        {
+            std::ofstream lf(base + ".log");
+            lf << log;
+        }
+        std::string tmp = base + ".json.tmp";
+        {
+            std::ofstream js(tmp);
+            js << json;
+            if (!js) return false;
+        }
+        return std::rename(tmp.c_str(), (base + ".json").c_str()) == 0;
+    }
+
+private:
+    std::string jobPath(const char *sub, const std::string &name) const {
+        return root_ + (*sub ? "/" : "") + sub + "/" + name + ".job";
+    }
+
+    // running/ file of a job claimed by this server
+    std::string runningPath(const std::string &name) const {
+        return jobPath("running", name + "." + owner_);
+    }
+
+    // ------------------------------------------------------------
+    // ownerGone()
+    //   `claimed` is <name>.<pid>@<host> as found in running/; true
+    //   (with `name` set) if <host> is this host and process <pid> no
+    //   longer exists.  Untagged files are left alone.
+    // ------------------------------------------------------------
+    bool ownerGone(const std::string &claimed, std::string &name) const {
+        size_t at = claimed.rfind('@');
+        if (at == std::string::npos || claimed.compare(at + 1, std::string::npos, host_) != 0)
+            return false;
+        size_t dot = claimed.rfind('.', at);
+        if (dot == std::string::npos || dot == 0 || dot + 1 == at) return false;
+        std::string pid = claimed.substr(dot + 1, at - dot - 1);
+        if (pid.size() > 9 || pid.find_first_not_of("0123456789") != std::string::npos) return false;
+        if (::kill(static_cast<pid_t>(std::stol(pid)), 0) == 0 || errno != ESRCH) return false;
+        name = claimed.substr(0, dot);
+        return true;
+    }
+
+    // Names of the *.job files of a directory, without the suffix
+    static std::vector<std::string> jobsIn(const std::string &dir) {
+        std::vector<std::string> names;
+        DIR *d = ::opendir(dir.c_str());
+        if (!d) return names;
+        while (const dirent *e = ::readdir(d)) {
+            std::string f = e->d_name;
+            if (f.size() > 4 && f[0] != '.' && f.compare(f.size() - 4, 4, ".job") == 0)
+                names.push_back(f.substr(0, f.size() - 4));
+        }
+        ::closedir(d);
+        return names;
+    }
+
+    std::string root_;
+    std::string host_;
+    std::string owner_;                  // <pid>@<host> of this server
+};
+
+#endif // SPOOL_DIR_H
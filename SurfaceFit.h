@@ -0,0 +1,401 @@
+/*
+ * SurfaceFit.h
+ *
+ * ------------------------------------------------------------
+ * Purpose:
+ *     Higher-order surface model for flatnessScan
+ *     (--surface=legendre:<order>).  A plane cannot tell bow or
+ *     twist from noise; a 2D Legendre expansion of Z separates them
+ *     into modes:
+ *
+ *         Z(u, v) = Σ_{p+q ≤ order} c_pq · P_p(u) · P_q(v)
+ *
+ *     with u, v the in-plane coordinates scaled to [-1, 1] over the
+ *     data extent: c_00 is the piston, c_10 / c_01 the tilts, c_20 /
+ *     c_02 the bows along X / Y and c_11 the twist.
+ *
+ * Overview:
+ *     - The least-squares problem is solved by QR: rows are folded
+ *       into the triangular factor R one at a time by Givens
+ *       rotations (LeastSquares), so the design matrix is never
+ *       stored and memory is O(modes²) whatever the number of rows.
+ *     - On a regular grid the rows are the occupied cells of the
+ *       flatness map (per-cell mean Z, each cell weighted equally),
+ *       so R depends only on the grid geometry: Nx, Ny, pitch,
+ *       origin, rotation and which cells are occupied.  R is cached
+ *       per geometry (DesignCache, the kCacheEntries most recently
+ *       used); a later scan on the same grid recipe costs one product Aᵀz and two M×M triangular solves
+ *       (RᵀR c = Aᵀz, the semi-normal equations).
+ *     - Without a grid the points themselves are the rows (no cache).
+ *     - rms[k] is the RMS of what is left after removing every mode
+ *       of total degree ≤ k, so the table shows what each order
+ *       explains.
+ *
+ * Usage:
+ *     #include "SurfaceFit.h"
+ *
+ *     SurfaceFit::Spec spec;
+ *     SurfaceFit::parse("legendre:4", spec);
+ *     SurfaceFit::Result s = SurfaceFit::fitGrid(map, spec.order);
+ *     // s.modes[m].p, s.modes[m].q, s.coeff[m], s.rms[k]
+ *     double zk = SurfaceFit::evaluate(s, u, v, k);   // model up to degree k
+ *
+ * ------------------------------------------------------------
+ * Author:    Luciano Ristori
+ * Created:   Oct 2025
+ * License:   MIT / open use
+ * ------------------------------------------------------------
+ */
+
+#ifndef SURFACE_FIT_H
+#define SURFACE_FIT_H
+
+#include <vector>
+#include <string>
+#include <mutex>
+#include <memory>
+#include <cmath>
+#include <algorithm>
+#include <cstdlib>
+#include <cstdint>
+#include <cstddef>
+
+#include "GridFinder.h"
+#include "FlatnessMap.h"
+#include "PointCache.h"
+
+namespace SurfaceFit {
+
+constexpr int kMaxOrder = 8;
+constexpr size_t kCacheEntries = 16;     // R factors kept by DesignCache
+
+struct Spec {
+    bool enabled = false;
+    int order = 4;
+};
+
+struct Mode {
+    int p = 0;      // degree in u (X)
+    int q = 0;      // degree in v (Y)
+};
+
+struct Result {
+    bool valid = false;
+    bool cached = false;             // R taken from DesignCache
+    int order = 0;
+    size_t rows = 0;                 // cells or points fitted
+    double uLo = 0, uHi = 1, vLo = 0, vHi = 1;   // extent mapped to [-1, 1]
+    std::vector<Mode> modes;
+    std::vector<double> coeff;       // [mm], one per mode
+    std::vector<double> rms;         // [mm], rms[k] after removing degree ≤ k
+};
+
+// ------------------------------------------------------------
+// parse()
+//   "legendre:<order>", 1 ≤ order ≤ kMaxOrder; false if malformed.
+// ------------------------------------------------------------
+inline bool parse(const std::string &text, Spec &spec)
+{
+    if (text.rfind("legendre:", 0) != 0) return false;
+    char *end = nullptr;
+    long order = std::strtol(text.c_str() + 9, &end, 10);
+    if (text.size() == 9 || *end != '\0' || order < 1 || order > kMaxOrder) return false;
+    spec.enabled = true;
+    spec.order = static_cast<int>(order);
+    return true;
+}
+
+// Modes by increasing total degree, u degree first
+inline std::vector<Mode> makeModes(int order)
+{
+    std::vector<Mode> modes;
+    for (int d = 0; d <= order; ++d)
+        for (int p = d; p >= 0; --p)
+            modes.push_back({p, d - p});
+    return modes;
+}
+
+// P_0(t) .. P_order(t) by the Bonnet recursion
+inline void legendre(double t, int order, double *P)
+{
+    P[0] = 1.0;
+    if (order > 0) P[1] = t;
+    for (int n = 1; n < order; ++n)
+        P[n + 1] = ((2 * n + 1) * t * P[n] - n * P[n - 1]) / (n + 1);
+}
+
+// ------------------------------------------------------------
+// LeastSquares
+//   Row-by-row Givens QR of min Σ w (a·c - z)²: R (upper triangular,
+//   m × m) and Qᵀz, O(m²) per row.
+// ------------------------------------------------------------
+struct LeastSquares {
+    int m = 0;
+    std::vector<double> R;           // row-major m × m
+    std::vector<double> qtz;
+
+    explicit LeastSquares(int nModes) : m(nModes), R(size_t(nModes) * nModes, 0.0), qtz(nModes, 0.0) {}
+
+    void addRow(double *a, double z) {
+        for (int k = 0; k < m; ++k) {
+            if (a[k] == 0.0) continue;
+            double &rkk = R[size_t(k) * m + k];
+            double h = std::hypot(rkk, a[k]);
+            double c = rkk / h, s = a[k] / h;
+            rkk = h;
+            for (int j = k + 1; j < m; ++j) {
+                double &rkj = R[size_t(k) * m + j];
+                double t = rkj;
+                rkj = c * t + s * a[j];
+                a[j] = -s * t + c * a[j];
+            }
+            double t = qtz[k];
+            qtz[k] = c * t + s * z;
+            z = -s * t + c * z;
+        }
+    }
+
+    // Full rank within a relative tolerance
+    bool wellConditioned() const {
+        double big = 0.0;
+        for (int k = 0; k < m; ++k) big = std::max(big, std::fabs(R[size_t(k) * m + k]));
+        for (int k = 0; k < m; ++k)
+            if (!(std::fabs(R[size_t(k) * m + k]) > 1e-10 * big)) return false;
+        return big > 0.0;
+    }
+};
+
+// Solves R c = y in place (back substitution)
+inline void solveUpper(const std::vector<double> &R, int m, std::vector<double> &y)
+{
+    for (int k = m - 1; k >= 0; --k) {
+        double s = y[k];
+        for (int j = k + 1; j < m; ++j) s -= R[size_t(k) * m + j] * y[j];
+        y[k] = s / R[size_t(k) * m + k];
+    }
+}
+
+// Solves Rᵀ y = b in place (forward substitution)
+inline void solveUpperTransposed(const std::vector<double> &R, int m, std::vector<double> &b)
+{
+    for (int k = 0; k < m; ++k) {
+        double s = b[k];
+        for (int j = 0; j < k; ++j) s -= R[size_t(j) * m + k] * b[j];
+        b[k] = s / R[size_t(k) * m + k];
+    }
+}
+
+// ------------------------------------------------------------
+// DesignCache
+//   R factors of grid designs, keyed by a fingerprint of the grid
+//   geometry, occupancy and order.  Holds the kCacheEntries most
+//   recently used, so a --serve process or a long DriftMap series
+//   does not grow without bound.  Thread-safe (multi-file runs).
+// ------------------------------------------------------------
+class DesignCache {
+public:
+    static DesignCache &instance() {
+        static DesignCache cache;
+        return cache;
+    }
+
+    std::shared_ptr<const std::vector<double>> find(uint64_t key) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (Entry &e : entries_)
+            if (e.key == key) {
+                e.used = ++clock_;
+                return e.R;
+            }
+        return nullptr;
+    }
+
+    void insert(uint64_t key, std::shared_ptr<const std::vector<double>> R) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        Entry *slot = nullptr;
+        for (Entry &e : entries_)
+            if (e.key == key) slot = &e;
+        if (!slot && entries_.size() < kCacheEntries) {
+            entries_.emplace_back();
+            slot = &entries_.back();
+        }
+        if (!slot)          // full: replace the least recently used
+            slot = &*std::min_element(entries_.begin(), entries_.end(),
+                                      [](const Entry &a, const Entry &b) { return a.used < b.used; });
+        slot->key = key;
+        slot->used = ++clock_;
+        slot->R = std::move(R);
+    }
+
+private:
+    struct Entry {
+        uint64_t key = 0;
+        uint64_t used = 0;               // clock_ at the last find() / insert()
+        std::shared_ptr<const std::vector<double>> R;
+    };
+
+    std::mutex mutex_;
+    uint64_t clock_ = 0;
+    std::vector<Entry> entries_;
+};
+
+inline uint64_t gridKey(const FlatnessMap &map, int order)
+{
+    const double geom[6] = {map.xMin, map.yMin, map.dx, map.dy, map.cosAngle, map.sinAngle};
+    const int dims[3] = {map.Nx, map.Ny, order};
+    uint64_t h = PointCache::fnv1a(geom, sizeof(geom));
+    h = PointCache::fnv1a(dims, sizeof(dims), h);
+    std::vector<unsigned char> occupied(map.count.size());
+    for (size_t k = 0; k < occupied.size(); ++k) occupied[k] = map.count[k] ? 1 : 0;
+    return PointCache::fnv1a(occupied.data(), occupied.size(), h);
+}
+
+// ------------------------------------------------------------
+// evaluate()
+//   Model at (u, v) (unscaled coordinates) from the modes of total
+//   degree ≤ maxDegree.
+// ------------------------------------------------------------
+inline double evaluate(const Result &s, double u, double v, int maxDegree)
+{
+    double Pu[kMaxOrder + 1], Pv[kMaxOrder + 1];
+    legendre(2.0 * (u - s.uLo) / (s.uHi - s.uLo) - 1.0, s.order, Pu);
+    legendre(2.0 * (v - s.vLo) / (s.vHi - s.vLo) - 1.0, s.order, Pv);
+    double z = 0.0;
+    for (size_t m = 0; m < s.modes.size(); ++m) {
+        const Mode &md = s.modes[m];
+        if (md.p + md.q > maxDegree) break;
+        z += s.coeff[m] * Pu[md.p] * Pv[md.q];
+    }
+    return z;
+}
+
+namespace detail {
+
+// Design row of (u, v) into a
+inline void designRow(const Result &s, double u, double v, double *a)
+{
+    double Pu[kMaxOrder + 1], Pv[kMaxOrder + 1];
+    legendre(2.0 * (u - s.uLo) / (s.uHi - s.uLo) - 1.0, s.order, Pu);
+    legendre(2.0 * (v - s.vLo) / (s.vHi - s.vLo) - 1.0, s.order, Pv);
+    for (size_t m = 0; m < s.modes.size(); ++m)
+        a[m] = Pu[s.modes[m].p] * Pv[s.modes[m].q];
+}
+
+// Residual RMS after each degree, over rows supplied by forEach(f(u, v, z))
+template <class ForEach>
+void residualRms(Result &s, ForEach forEach)
+{
+    std::vector<double> sum2(s.order + 1, 0.0);
+    std::vector<double> a(s.modes.size());
+    forEach([&](double u, double v, double z) {
+        designRow(s, u, v, a.data());
+        double left = z;
+        size_t m = 0;
+        for (int d = 0; d <= s.order; ++d) {
+            for (; m < s.modes.size() && s.modes[m].p + s.modes[m].q == d; ++m)
+                left -= s.coeff[m] * a[m];
+            sum2[d] += left * left;
+        }
+    });
+    s.rms.resize(s.order + 1);
+    for (int d = 0; d <= s.order; ++d) s.rms[d] = std::sqrt(sum2[d] / s.rows);
+}
+
+} // namespace detail
+
+// ------------------------------------------------------------
+// fitGrid()
+//   Fits the per-cell mean Z of a filled FlatnessMap (cell centers in
+//   grid-frame coordinates), reusing the cached R of the same grid.
+// ------------------------------------------------------------
+inline Result fitGrid(const FlatnessMap &map, int order)
+{
+    Result s;
+    s.order = order;
+    s.modes = makeModes(order);
+    const int m = static_cast<int>(s.modes.size());
+    s.uLo = map.xMin;  s.uHi = map.xMin + (map.Nx - 1) * map.dx;
+    s.vLo = map.yMin;  s.vHi = map.yMin + (map.Ny - 1) * map.dy;
+    if (map.Nx < 2 || map.Ny < 2) return s;
+
+    auto forEachCell = [&](auto f) {
+        for (int iy = 0; iy < map.Ny; ++iy)
+            for (int ix = 0; ix < map.Nx; ++ix)
+                if (map.count[map.index(ix, iy)])
+                    f(map.xMin + ix * map.dx, map.yMin + iy * map.dy, map.mean(ix, iy));
+    };
+    forEachCell([&](double, double, double) { ++s.rows; });
+    if (s.rows < size_t(m)) return s;
+
+    const uint64_t key = gridKey(map, order);
+    std::shared_ptr<const std::vector<double>> R = DesignCache::instance().find(key);
+    std::vector<double> a(m);
+    if (R) {
+        // Cached geometry: Aᵀz, then RᵀR c = Aᵀz
+        std::vector<double> atz(m, 0.0);
+        forEachCell([&](double u, double v, double z) {
+            detail::designRow(s, u, v, a.data());
+            for (int k = 0; k < m; ++k) atz[k] += a[k] * z;
+        });
+        solveUpperTransposed(*R, m, atz);
+        solveUpper(*R, m, atz);
+        s.coeff = std::move(atz);
+        s.cached = true;
+    } else {
+        LeastSquares ls(m);
+        forEachCell([&](double u, double v, double z) {
+            detail::designRow(s, u, v, a.data());
+            ls.addRow(a.data(), z);
+        });
+        if (!ls.wellConditioned()) return s;
+        s.coeff = ls.qtz;
+        solveUpper(ls.R, m, s.coeff);
+        DesignCache::instance().insert(key, std::make_shared<const std::vector<double>>(ls.R));
+    }
+    detail::residualRms(s, forEachCell);
+    s.valid = true;
+    return s;
+}
+
+// ------------------------------------------------------------
+// fitPoints()
+//   Fits Z of the points directly (no grid); skip[i] != 0 excludes
+//   point i (e.g. rejected by the robust fit).
+// ------------------------------------------------------------
+inline Result fitPoints(const double *x, const double *y, const double *z, size_t n,
+                        int order, const char *skip = nullptr)
+{
+    Result s;
+    s.order = order;
+    s.modes = makeModes(order);
+    const int m = static_cast<int>(s.modes.size());
+    if (n == 0) return s;
+    s.uLo = s.uHi = x[0];
+    s.vLo = s.vHi = y[0];
+    for (size_t i = 0; i < n; ++i) {
+        s.uLo = std::min(s.uLo, x[i]);  s.uHi = std::max(s.uHi, x[i]);
+        s.vLo = std::min(s.vLo, y[i]);  s.vHi = std::max(s.vHi, y[i]);
+    }
+    if (!(s.uHi > s.uLo) || !(s.vHi > s.vLo)) return s;
+
+    auto forEachPoint = [&](auto f) {
+        for (size_t i = 0; i < n; ++i)
+            if (!skip || !skip[i]) f(x[i], y[i], z[i]);
+    };
+    LeastSquares ls(m);
+    std::vector<double> a(m);
+    forEachPoint([&](double u, double v, double w) {
+        detail::designRow(s, u, v, a.data());
+        ls.addRow(a.data(), w);
+        ++s.rows;
+    });
+    if (s.rows < size_t(m) || !ls.wellConditioned()) return s;
+    s.coeff = ls.qtz;
+    solveUpper(ls.R, m, s.coeff);
+    detail::residualRms(s, forEachPoint);
+    s.valid = true;
+    return s;
+}
+
+} // namespace SurfaceFit
+
+#endif // SURFACE_FIT_H
@@ -0,0 +1,111 @@
+/*
+ * ThreadPool.h
+ *
+ * ------------------------------------------------------------
+ * Purpose:
+ *     Small fixed-size worker pool used by flatnessScan to process
+ *     independent tasks (e.g. one scan per task) concurrently.
+ *
+ * Usage:
+ *     #include "ThreadPool.h"
+ *
+ *     ThreadPool pool(4);
+ *     for (auto &f : files)
+ *         pool.submit([&f] { process(f); });
+ *     pool.wait();                 // blocks until every task has run
+ *
+ * Notes:
+ *     - Tasks are started in submission order.
+ *     - An exception escaping a task terminates the program, as for
+ *       any std::thread; tasks are expected to report their own errors.
+ *     - defaultThreads() is std::thread::hardware_concurrency(), or 1
+ *       when the platform cannot tell.
+ *
+ * ------------------------------------------------------------
+ * Author:    Luciano Ristori
+ * Created:   Oct 2025
+ * License:   MIT / open use
+ * ------------------------------------------------------------
+ */
+
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+
+class ThreadPool {
+public:
+    explicit ThreadPool(unsigned nThreads = defaultThreads()) {
+        if (nThreads == 0) nThreads = 1;
+        for (unsigned t = 0; t < nThreads; ++t)
+            workers_.emplace_back([this] { run(); });
+    }
+
+    ~ThreadPool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stopping_ = true;
+        }
+        wake_.notify_all();
+        for (auto &w : workers_) w.join();
+    }
+
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+
+    void submit(std::function<void()> task) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            tasks_.push_back(std::move(task));
+            ++pending_;
+        }
+        wake_.notify_one();
+    }
+
+    // Block until all submitted tasks have finished
+    void wait() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        idle_.wait(lock, [this] { return pending_ == 0; });
+    }
+
+    size_t size() const { return workers_.size(); }
+
+    static unsigned defaultThreads() {
+        unsigned n = std::thread::hardware_concurrency();
+        return n ? n : 1;
+    }
+
+private:
+    void run() {
+        for (;;) {
+            std::function<void()> task;
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                wake_.wait(lock, [this] { return stopping_ || !tasks_.empty(); });
+                if (tasks_.empty()) return;   // stopping and drained
+                task = std::move(tasks_.front());
+                tasks_.pop_front();
+            }
+            task();
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                if (--pending_ == 0) idle_.notify_all();
+            }
+        }
+    }
+
+    std::vector<std::thread> workers_;
+    std::deque<std::function<void()>> tasks_;
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    std::condition_variable idle_;
+    size_t pending_ = 0;
+    bool stopping_ = false;
+};
+
+#endif // THREAD_POOL_H
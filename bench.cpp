@@ -0,0 +1,372 @@
+/*
+ * bench.cpp
+ *
+ * ------------------------------------------------------------
+ * Purpose:
+ *     Benchmark harness for the flatnessScan pipeline.  Generates
+ *     synthetic scans, runs every stage of the analysis on them and
+ *     reports the wall time of each stage, so performance regressions
+ *     can be tracked from build to build and the stages worth
+ *     parallelizing can be picked from numbers instead of guesses.
+ *
+ * Workflow:
+ *     For each surface shape and each size (decades from 10^2 points
+ *     up to --max-points):
+ *
+ *     1. A synthetic surface is sampled on a rectangular 300 × 200 mm
+ *        grid and written as "label,X,Y,Z" CSV to --dir:
+ *            flat     z = noise
+ *            tilted   z = 1e-4·x + 5e-5·y + noise
+ *            warped   bow (u² + v²) and twist (u·v), 20/10 µm, + noise
+ *            sparse   flat, with a fraction --missing of cells absent
+ *        Noise is Gaussian with σ = --noise µm.
+ *
+ *     2. The stages of flatnessScan are timed separately, with the
+ *        same headers and calls as the main program (the histograms
+ *        and maps through ScanHistograms.h, as flatnessScan does):
+ *            read     readPointCloud()
+ *            pca      ScanAccumulator sweep + PlaneFit::fitPCA()
+ *            minuit   Minuit2 on Kernels::chi2() (up to --minuit-max)
+ *            grid     GridFinder::analyze()
+ *            hist     residuals, summary, ScanHistograms::book() + fill()
+ *            map      FlatnessMap fill + ScanHistograms::maps()
+ *            write    TFile write of histograms, TGraph and maps
+ *        The best of --repeat runs of each stage is reported.
+ *
+ * Command line usage:
+ *        ./bench [--max-points=<n>] [--noise=<um>] [--missing=<frac>]
+ *                [--shapes=flat,tilted,warped,sparse] [--repeat=<n>]
+ *                [--minuit-max=<n>] [--threads=<n>] [--dir=<path>]
+ *                [--json=<file>] [--keep] [--seed=<n>]
+ *
+ * Example:
+ *        make bench && ./bench --max-points=10000000 --json=bench.json
+ *
+ * Notes:
+ *     - Defaults: up to 10^6 points, 2 µm noise, 20% missing cells,
+ *       best of 3, single-threaded kernels.  10^8 points need ~4 GB
+ *       of CSV in --dir and several GB of memory.
+ *     - --json writes one object per (shape, size) with the times in
+ *       milliseconds, for comparison across revisions.
+ *
+ * ------------------------------------------------------------
+ * Author:    Luciano Ristori
+ * Created:   Oct 2025
+ * License:   MIT / open use
+ * ------------------------------------------------------------
+ */
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+#include <chrono>
+#include <random>
+#include <limits>
+#include <iomanip>
+#include <algorithm>
+#include <functional>
+
+#include "TFile.h"
+#include "TH1.h"
+#include "TH1D.h"
+#include "TH2D.h"
+#include "TGraph.h"
+#include "TROOT.h"
+#include "Compression.h"
+
+#include "Math/Minimizer.h"
+#include "Math/Factory.h"
+#include "Math/Functor.h"
+
+#include "PointCloud.h"
+#include "GridFinder.h"
+#include "FlatnessMap.h"
+#include "Binning.h"
+#include "PlaneFit.h"
+#include "ScanAccumulator.h"
+#include "Kernels.h"
+#include "ScatterLod.h"
+#include "ScanHistograms.h"
+
+// Same offset as flatnessScan
+const double offset = 400.0;
+
+const char *kStages[] = {"read", "pca", "minuit", "grid", "hist", "map", "write"};
+const int kNumStages = 7;
+
+struct BenchOptions {
+    size_t maxPoints = 1000000;
+    double noise = 2.0;                   // [µm]
+    double missing = 0.2;                 // fraction of absent cells (sparse)
+    std::vector<std::string> shapes = {"flat", "tilted", "warped", "sparse"};
+    int repeat = 3;
+    size_t minuitMax = 1000000;           // skip Minuit2 above this many points
+    unsigned threads = 1;                 // Kernels threads
+    std::string dir = "/tmp";
+    std::string jsonFile;
+    bool keep = false;
+    unsigned seed = 12345;
+};
+
+//------------------------------------------------------------------------------
+// writeSurface()
+//   Writes a synthetic scan of about nPoints points; returns the number
+//   of points written.
+//------------------------------------------------------------------------------
+
+size_t writeSurface(const std::string &path, const std::string &shape, size_t nPoints,
+                    const BenchOptions &opt) {
+    const double lx = 300.0, ly = 200.0;   // [mm]
+    size_t nx = std::max<size_t>(2, static_cast<size_t>(std::lround(std::sqrt(nPoints * lx / ly))));
+    size_t ny = std::max<size_t>(2, (nPoints + nx - 1) / nx);
+    const double dx = lx / (nx - 1), dy = ly / (ny - 1);
+
+    std::mt19937_64 rng(opt.seed);
+    std::normal_distribution<double> gauss(0.0, opt.noise * 1e-3);
+    std::uniform_real_distribution<double> uniform(0.0, 1.0);
+
+    FILE *f = std::fopen(path.c_str(), "w");
+    if (!f) return 0;
+    std::vector<char> buf(1 << 20);
+    std::setvbuf(f, buf.data(), _IOFBF, buf.size());
+
+    size_t written = 0;
+    for (size_t iy = 0; iy < ny; ++iy) {
+        for (size_t ix = 0; ix < nx; ++ix) {
+            if (shape == "sparse" && uniform(rng) < opt.missing) continue;
+            double x = ix * dx, y = iy * dy;
+            double u = 2.0 * x / lx - 1.0, v = 2.0 * y / ly - 1.0;
+            double z = gauss(rng);
+            if (shape == "tilted") z += 1e-4 * x + 5e-5 * y;
+            else if (shape == "warped") z += 0.020 * (u * u + v * v) + 0.010 * u * v;
+            std::fprintf(f, "%zu,%.4f,%.4f,%.6f\n", ++written, x, y, z);
+        }
+    }
+    std::fclose(f);
+    return written;
+}
+
+//------------------------------------------------------------------------------
+// Stage timing
+//------------------------------------------------------------------------------
+
+// Best wall time [ms] of repeat runs of stage
+double timeStage(int repeat, const std::function<void()> &stage) {
+    double best = std::numeric_limits<double>::max();
+    for (int k = 0; k < repeat; ++k) {
+        auto t0 = std::chrono::steady_clock::now();
+        stage();
+        auto t1 = std::chrono::steady_clock::now();
+        best = std::min(best, std::chrono::duration<double, std::milli>(t1 - t0).count());
+    }
+    return best;
+}
+
+struct BenchRow {
+    std::string shape;
+    size_t nPoints = 0;
+    bool regular = false;
+    double ms[kNumStages];
+};
+
+BenchRow runBench(const std::string &path, const std::string &shape, const BenchOptions &opt) {
+    BenchRow row;
+    row.shape = shape;
+    for (double &t : row.ms) t = -1.0;
+
+    PointCloud cloud;
+    row.ms[0] = timeStage(opt.repeat, [&] { cloud = readPointCloud(path); });
+    const size_t n = cloud.size();
+    const double *px = cloud.x.data(), *py = cloud.y.data(), *pz = cloud.z.data();
+    row.nPoints = n;
+    if (n < 4) return row;
+
+    ScanAccumulator acc;
+    PlaneFit::Result fit;
+    row.ms[1] = timeStage(opt.repeat, [&] {
+        acc = ScanAccumulator();
+        for (size_t i = 0; i < n; ++i) acc.add(px[i], py[i], pz[i]);
+        fit = PlaneFit::fitPCA(acc.moments, offset);
+    });
+    if (!fit.valid) return row;
+
+    if (n <= opt.minuitMax) {
+        row.ms[2] = timeStage(opt.repeat, [&] {
+            ROOT::Math::Minimizer *min = ROOT::Math::Factory::CreateMinimizer("Minuit2", "");
+            min->SetMaxFunctionCalls(1000000);
+            min->SetMaxIterations(1000);
+            min->SetTolerance(0.001);
+            min->SetPrintLevel(0);
+            ROOT::Math::Functor f([&](const double *a) {
+                return Kernels::chi2(px, py, pz, n, a[0], a[1], a[2], offset, opt.threads);
+            }, 3);
+            min->SetFunction(f);
+            min->SetVariable(0, "ax", 0.0, 0.001);
+            min->SetVariable(1, "ay", 0.0, 0.001);
+            min->SetVariable(2, "az", 1.0 / offset, 0.001);
+            min->Minimize();
+            delete min;
+        });
+    }
+
+    GridFinder::Result grid;
+    row.ms[3] = timeStage(opt.repeat, [&] { grid = GridFinder::analyze(px, py, n); });
+    row.regular = grid.regularX && grid.regularY;
+
+    // Histograms as in flatnessScan: residual range sets the hDeviations binning
+    Binning::Spec binning;
+    std::vector<TH1D*> hists;
+    std::vector<double> residuals(n);
+    row.ms[4] = timeStage(opt.repeat, [&] {
+        for (auto h : hists) delete h;
+        hists.clear();
+        Kernels::residuals(px, py, pz, n, fit.ax, fit.ay, fit.az, offset,
+                           residuals.data(), opt.threads);
+        RunningStats rs = Kernels::summarize(residuals.data(), n, opt.threads);
+        hists = ScanHistograms::book(binning, acc, rs, n);
+        ScanHistograms::fill(hists, px, py, pz, residuals.data(), n);
+    });
+
+    TH2D *hZ = nullptr, *hZRms = nullptr;
+    if (row.regular) {
+        row.ms[5] = timeStage(opt.repeat, [&] {
+            delete hZ; delete hZRms;
+            FlatnessMap map(grid);
+            for (size_t i = 0; i < n; ++i) map.add(px[i], py[i], pz[i]);
+            ScanHistograms::maps(map, grid, hZ, hZRms);
+        });
+    }
+
+    // g2_xy as flatnessScan writes it: decimated above ScatterLod::kDefaultMaxPoints
+    ScatterLod lod(px, py, n);
+    std::vector<double> sx, sy;
+    lod.select(lod.xMin(), lod.xMax(), lod.yMin(), lod.yMax(), ScatterLod::kDefaultMaxPoints, sx, sy);
+    TGraph g2(static_cast<int>(sx.size()), sx.data(), sy.data());
+    g2.SetName("g2_xy");
+    std::string rootPath = path.substr(0, path.size() - 4) + ".root";
+    row.ms[6] = timeStage(opt.repeat, [&] {
+        TFile out(rootPath.c_str(), "RECREATE", "",
+                  ROOT::CompressionSettings(ROOT::RCompressionSetting::EAlgorithm::kZSTD, 5));
+        for (auto h : hists) out.WriteTObject(h);
+        out.WriteTObject(&g2);
+        if (hZ) out.WriteTObject(hZ);
+        if (hZRms) out.WriteTObject(hZRms);
+        out.Close();
+    });
+    if (!opt.keep) std::remove(rootPath.c_str());
+
+    for (auto h : hists) delete h;
+    delete hZ;
+    delete hZRms;
+    return row;
+}
+
+//------------------------------------------------------------------------------
+// Main program
+//------------------------------------------------------------------------------
+
+int main(int argc, char *argv[]) {
+
+    BenchOptions opt;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        auto value = [&](const char *prefix) { return arg.substr(std::string(prefix).size()); };
+        if (arg.rfind("--max-points=", 0) == 0) {
+            opt.maxPoints = static_cast<size_t>(std::atof(value("--max-points=").c_str()));
+        } else if (arg.rfind("--noise=", 0) == 0) {
+            opt.noise = std::atof(value("--noise=").c_str());
+        } else if (arg.rfind("--missing=", 0) == 0) {
+            opt.missing = std::atof(value("--missing=").c_str());
+        } else if (arg.rfind("--shapes=", 0) == 0) {
+            opt.shapes.clear();
+            std::stringstream ss(value("--shapes="));
+            for (std::string s; std::getline(ss, s, ',');) opt.shapes.push_back(s);
+        } else if (arg.rfind("--repeat=", 0) == 0) {
+            opt.repeat = std::max(1, std::atoi(value("--repeat=").c_str()));
+        } else if (arg.rfind("--minuit-max=", 0) == 0) {
+            opt.minuitMax = static_cast<size_t>(std::atof(value("--minuit-max=").c_str()));
+        } else if (arg.rfind("--threads=", 0) == 0) {
+            opt.threads = static_cast<unsigned>(std::max(1, std::atoi(value("--threads=").c_str())));
+        } else if (arg.rfind("--dir=", 0) == 0) {
+            opt.dir = value("--dir=");
+        } else if (arg.rfind("--json=", 0) == 0) {
+            opt.jsonFile = value("--json=");
+        } else if (arg.rfind("--seed=", 0) == 0) {
+            opt.seed = static_cast<unsigned>(std::atoi(value("--seed=").c_str()));
+        } else if (arg == "--keep") {
+            opt.keep = true;
+        } else {
+            std::cerr << "Usage: " << argv[0]
+                      << " [--max-points=<n>] [--noise=<um>] [--missing=<frac>]"
+                      << " [--shapes=flat,tilted,warped,sparse] [--repeat=<n>]"
+                      << " [--minuit-max=<n>] [--threads=<n>] [--dir=<path>]"
+                      << " [--json=<file>] [--keep] [--seed=<n>]" << std::endl;
+            return 1;
+        }
+    }
+    for (const auto &s : opt.shapes) {
+        if (s != "flat" && s != "tilted" && s != "warped" && s != "sparse") {
+            std::cerr << "Unknown shape: " << s << std::endl;
+            return 1;
+        }
+    }
+
+    gROOT->SetBatch(kTRUE);
+    TH1::AddDirectory(kFALSE);
+
+    std::cout << std::left << std::setw(8) << "shape" << std::right << std::setw(11) << "points"
+              << std::setw(5) << "grid";
+    for (int s = 0; s < kNumStages; ++s) std::cout << std::setw(11) << kStages[s];
+    std::cout << "    [ms, best of " << opt.repeat << "]" << std::endl;
+
+    std::vector<BenchRow> rows;
+    for (const auto &shape : opt.shapes) {
+        for (size_t n = 100; n <= opt.maxPoints; n *= 10) {
+            std::string path = opt.dir + "/bench_" + shape + "_" + std::to_string(n) + ".csv";
+            if (writeSurface(path, shape, n, opt) == 0) {
+                std::cerr << "Error: cannot write " << path << std::endl;
+                return 1;
+            }
+            BenchRow row = runBench(path, shape, opt);
+            if (!opt.keep) std::remove(path.c_str());
+
+            std::cout << std::left << std::setw(8) << row.shape << std::right
+                      << std::setw(11) << row.nPoints << std::setw(5) << (row.regular ? "yes" : "no")
+                      << std::fixed << std::setprecision(2);
+            for (double t : row.ms) {
+                if (t < 0) std::cout << std::setw(11) << "-";
+                else std::cout << std::setw(11) << t;
+            }
+            std::cout << std::endl;
+            rows.push_back(row);
+        }
+    }
+
+    if (!opt.jsonFile.empty()) {
+        std::ofstream js(opt.jsonFile);
+        if (!js) {
+            std::cerr << "Error: cannot write " << opt.jsonFile << std::endl;
+            return 1;
+        }
+        js << "[\n";
+        for (size_t r = 0; r < rows.size(); ++r) {
+            js << "  {\"shape\": \"" << rows[r].shape << "\", \"points\": " << rows[r].nPoints
+               << ", \"regular_grid\": " << (rows[r].regular ? "true" : "false")
+               << ", \"threads\": " << opt.threads << ", \"ms\": {";
+            for (int s = 0; s < kNumStages; ++s) {
+                js << (s ? ", " : "") << "\"" << kStages[s] << "\": ";
+                if (rows[r].ms[s] < 0) js << "null";
+                else js << rows[r].ms[s];
+            }
+            js << "}}" << (r + 1 < rows.size() ? "," : "") << "\n";
+        }
+        js << "]\n";
+        std::cout << "Timings written to " << opt.jsonFile << std::endl;
+    }
+    return 0;
+}
@@ -1,5 +1,5 @@
 //
-// Build:  clang++ -std=c++17 flatnessScan.cpp Points.cpp `root-config --cflags --libs` -o flatnessScan
+// Build:  clang++ -std=c++17 flatnessScan.cpp `root-config --cflags --libs` -o flatnessScan
 //
 //------------------------------------------------------------------------------
 // File: flatnessScan.cpp
@@ -14,24 +14,107 @@
 //     1. Reads a text file containing one point per line. Each line is expected
 //        to contain four values: an integer point index followed by the
 //        X, Y, and Z coordinates in millimeters.
-//     2. Stores the coordinates in a vector of Point objects (see Points.h).
-//     3. Uses the ROOT Minuit2 minimizer to determine the parameters (ax, ay, az)
-//        of the best-fit plane defined by the equation:
+//     2. Stores the coordinates in structure-of-arrays columns (see PointCloud.h).
+//        ASTRAL CMM CSV exports are memory mapped and parsed in place
+//        (see AstralCsv.h).
+//     3. Determines the parameters (ax, ay, az) of the best-fit plane defined
+//        by the equation:
 //
 //             ax * X + ay * Y + az * (Z + offset) = 1
 //
 //        minimizing the total χ² = Σ [ (ax*X + ay*Y + az*(Z+offset) - 1)² / (ax²+ay²+az²) ]
 //
+//        Two fit engines are available (--fit=pca|minuit):
+//          pca    - closed form, smallest eigenvector of the centered
+//                   covariance matrix built in one pass (default, see PlaneFit.h)
+//          minuit - iterative Minuit2 minimization of chi2Func (cross-check)
+//
+//        With --robust=clip[:K] the plane is refit with K·σ clipping
+//        (default K = 3); rejected points are listed and the residuals of
+//        the kept points go to hDeviationsClipped (see RobustFit.h).
+//
+//        The minimum-zone flatness (ISO 1101: smallest gap between two
+//        parallel planes enclosing all points) and its limiting points are
+//        evaluated next, seeded by the fitted plane (see MinimumZone.h).
+//
 //     4. Computes the resulting χ², standard deviation, and plane normal
 //        normalization (|a| and 1/|a|), and prints them to the console.
 //     5. Fills ROOT histograms for each coordinate (X, Y, Z) and for the
-//        deviation of each point from the fitted plane.
+//        deviation of each point from the fitted plane.  Bin counts follow
+//        the --binning policy (see Binning.h); hDeviations is binned over
+//        the residual range, not the Z range.
 //     6. Produces a 2D scatter plot of Y vs. X and displays all histograms
-//        and the scatter plot in interactive ROOT canvases.
-//     7. Detects whether the data lie on a regular (Nx × Ny) grid. If so,
-//        constructs a 2D “flatness map” histogram colored by Z values.
-//     8. Writes all histograms and the TGraph to an output ROOT file
-//        ("output.root") and displays all results.
+//        and the scatter plot in interactive ROOT canvases.  Above 10⁵
+//        points the graph is an even level-of-detail subset, reselected
+//        from the full scan when the canvas is zoomed (see ScatterLod.h).
+//     7. Detects whether the data lie on a regular (Nx × Ny) grid, aligned
+//        with X/Y or rotated in the plane (mapped in grid coordinates). If so,
+//        constructs a 2D “flatness map” histogram colored by Z values
+//        (per-cell mean) and a companion per-cell RMS map (see FlatnessMap.h).
+//     8. Writes every object once to an output ROOT file ("output.root",
+//        ZSTD-compressed unless --compression says otherwise) and displays
+//        all results; interactively the file is written on a background
+//        thread, from detached copies, while the canvases are drawn.  With --batch nothing is
+//        displayed: a JSON summary (fit, σ, peak-to-valley, grid) is written
+//        next to the ROOT file and the program exits.  Several inputs are
+//        processed concurrently on a worker pool, one directory per scan.
+//
+//   With --tree every point is also written to a TTree "points" (label,
+//   x, y, z, i, j, k, residual, grid cell) for RDataFrame analyses.
+//
+//   With --follow[=<idle s>] the input is tailed while the CMM is still
+//   writing it: the plane fit, hDeviations and hZMap are updated live, and
+//   the normal analysis runs once the file stops growing or the live canvas
+//   is closed (see followScan()).
+//
+//   With --surface=legendre:<order> Z is also fitted by a 2D Legendre
+//   expansion up to that total degree (bow, twist, ...): coefficients go
+//   to hSurfaceModes and the residual after each order to
+//   hSurfaceResidual_<k>; the least-squares factor of a grid is cached
+//   and reused by later scans on the same grid (see SurfaceFit.h).
+//
+//   With --pyramid the flatness map is also written coarsened by 2, 4, ...
+//   (hZMap_<f>, hZRMSMap_<f>), from summed-area tables of the per-cell
+//   sums (see FlatnessPyramid.h); --local uses the same tables.
+//
+//   With --local=<W>[x<H>][:<tol µm>] a plane is fitted in every W × H mm
+//   window of the grid from summed-area moment tables (O(1) per window,
+//   tiles on a thread pool); the RMS about it is mapped in hLocalFlatness
+//   and the worst window is reported (see LocalFlatness.h).
+//
+//   When the input carries I, J, K normals (ASTRAL exports) the residuals
+//   are also measured along each reported normal, ball centers compensated
+//   by --probe-radius=<mm>, and histogrammed against the tilt of the normal
+//   from the plane's (hNormalDeviations, hNormalAngle, hDeviationVsAngle) to
+//   spot bad probe hits; --no-normals skips it (see NormalResiduals.h).
+//
+//   With --resample=bootstrap[:K]|jackknife[:G] the 95% confidence
+//   intervals of σ and peak-to-valley are estimated by closed-form refits
+//   of resampled moments, on all cores (see Resample.h); the bounds are
+//   stored as SigmaCILow/High and PeakToValleyCILow/High.
+//
+//   With --compare[=grid|label] the inputs are repeated scans of one
+//   surface: each is streamed once and matched to the first (reference)
+//   scan by grid cell or by point label; the per-cell temporal mean and σ
+//   and the latest − reference difference map are written (see
+//   runCompare(), DriftMap.h).
+//
+//   With --serve=<spool dir> the program stays up as a server with ROOT
+//   initialized once: job files (the arguments of one run) dropped in the
+//   spool directory are analyzed concurrently on a bounded pool and their
+//   JSON summaries written to done/ (see runServe(), SpoolDir.h).
+//
+//   With --profile[=<file.json>] the wall time, heap allocations and peak
+//   RSS of every stage, and the Minuit2 function calls, are printed after
+//   the run and added to the JSON summary (see Profiler.h).
+//
+//   The first in-memory read of an input writes a binary sidecar
+//   <input>.fscache; later runs map it and skip parsing while the input is
+//   unchanged (see PointCache.h, --no-cache to disable).
+//
+//   With --stream[=<MB>] the input is never held in memory: it is read twice
+//   in fixed-size chunks (moments and fit, then residual histograms and map),
+//   for scans larger than RAM (see analyzeStream(), ChunkedReader.h).
 //
 // Input:
 //   A text file (e.g. "points.csv") with four columns per line:
@@ -39,15 +122,17 @@
 //
 // Output:
 //   - Console summary of fit results (χ², plane coefficients, flatness).
+//   - JSON summary of the same quantities (--batch or --summary=<file>).
 //   - ROOT file "output.root" containing histograms and scatter plots.
 //   - ROOT canvases displaying coordinate distributions and residuals.
 //
 // Usage example:
 //   $ ./flatnessScan my_points.csv
+//   $ ./flatnessScan my_points.csv out.root --fit=minuit
 //
 // Dependencies:
 //   - ROOT framework (TFile, TH1D, TH2D, TGraph, TCanvas, TApplication, Minimizer)
-//   - Points.h / Points.cpp for reading input data
+//   - PointCloud.h / AstralCsv.h for reading input data
 //   - GridFinder.h for grid detection
 //
 // Author: Luciano Ristori
@@ -68,8 +153,24 @@
 #include <limits>
 #include <iomanip>
 #include <cmath>
+#include <cstdio>
+#include <cctype>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <random>
+#include <thread>
+#include <new>
+#include <chrono>
+#include <unordered_map>
+#include <atomic>
+#include <csignal>
+
+#include <glob.h>
+#include <sys/stat.h>
 
 #include "TFile.h"
+#include "Compression.h"
 #include "TH1D.h"
 #include "TH2D.h"
 #include "TCanvas.h"
@@ -78,13 +179,39 @@
 #include "TGraph.h"
 #include "TStyle.h"
 #include "TColor.h"
+#include "TParameter.h"
+#include "TTree.h"
+#include "TSystem.h"
+#include "TTimer.h"
+#include "TH1F.h"
 
 #include "Math/Minimizer.h"
 #include "Math/Factory.h"
 #include "Math/Functor.h"
 
-#include "Points.h"
+#include "PointCloud.h"
+#include "AstralCsv.h"
 #include "GridFinder.h"
+#include "FlatnessMap.h"
+#include "Binning.h"
+#include "ThreadPool.h"
+#include "PlaneFit.h"
+#include "ScanAccumulator.h"
+#include "Kernels.h"
+#include "RobustFit.h"
+#include "MinimumZone.h"
+#include "ChunkedReader.h"
+#include "PointCache.h"
+#include "Profiler.h"
+#include "SurfaceFit.h"
+#include "DriftMap.h"
+#include "Resample.h"
+#include "ScatterLod.h"
+#include "FlatnessPyramid.h"
+#include "LocalFlatness.h"
+#include "SpoolDir.h"
+#include "NormalResiduals.h"
+#include "ScanHistograms.h"
 
 //------------------------------------------------------------------------------
 // Program version (update when functionality changes)
@@ -95,9 +222,17 @@ using std::cout;
 using std::endl;
 using std::vector;
 
-std::vector<double> X, Y, Z;
 double offset = 400.0;
 
+// Heap allocations are counted for --profile (see Profiler.h)
+void *operator new(std::size_t size) {
+    Profiler::noteAllocation(size);
+    if (void *p = std::malloc(size ? size : 1)) return p;
+    throw std::bad_alloc();
+}
+void operator delete(void *p) noexcept { std::free(p); }
+void operator delete(void *p, std::size_t) noexcept { std::free(p); }
+
 //------------------------------------------------------------------------------
 // Helper classes for formatted console output
 //------------------------------------------------------------------------------
@@ -136,238 +271,1209 @@ private:
 // χ² Function for plane fitting
 //------------------------------------------------------------------------------
 
-double chi2Func(const double *x) {
-    double ax = x[0], ay = x[1], az = x[2];
-    double chi2 = 0.0;
+// X, Y, Z are views into the scan's PointCloud columns (no copy); each
+// scan binds its own columns, so concurrent fits do not share state.
+// The sum is evaluated by the vectorized, fixed-order kernel in Kernels.h.
+double chi2Func(const double *x, Span<double> X, Span<double> Y, Span<double> Z,
+                unsigned nThreads = 1) {
+    return Kernels::chi2(X.data(), Y.data(), Z.data(), X.size(),
+                         x[0], x[1], x[2], offset, nThreads);
+}
 
-    for (size_t i = 0; i < X.size(); ++i) {
-        double delta = ax*X[i] + ay*Y[i] + az*(Z[i] + offset) - 1.0;
-        chi2 += delta * delta / (ax*ax + ay*ay + az*az);
-    }
-    return chi2;
+//------------------------------------------------------------------------------
+// Run options and per-scan results
+//------------------------------------------------------------------------------
+
+struct Options {
+    std::string fitEngine = "pca";      // "pca" or "minuit"
+    Binning::Spec binning;
+    bool batch = false;                 // no TApplication, no canvases
+    std::string summaryFile;            // JSON summary ("" = <output>.json in batch mode)
+    unsigned jobs = 0;                  // worker threads for multi-file runs (0 = all cores)
+    bool splitOutput = false;           // one ROOT file per scan instead of directories
+    unsigned kernelThreads = 1;         // threads for the χ²/residual kernels of one scan
+    RobustFit::Spec robust;             // --robust=clip[:K]
+    size_t streamChunkBytes = 0;        // --stream[=<MB>]: out-of-core chunk size (0 = in memory)
+    bool cache = true;                  // read/write the <input>.fscache sidecar (--no-cache)
+    bool tree = false;                  // --tree: per-point TTree "points" in the output
+    int compression = ROOT::CompressionSettings(ROOT::RCompressionSetting::EAlgorithm::kZSTD, 5);
+                                        // --compression=<algo>[:<level>] for TFile
+    bool follow = false;                // --follow: tail a file the CMM is still writing
+    double followIdle = 300;            // --follow=<s>: stop after this long without new rows
+    bool profile = false;               // --profile: per-stage timing and memory
+    std::string profileFile;            // --profile=<file.json>: profile alone as JSON
+    SurfaceFit::Spec surface;           // --surface=legendre:<order>
+    std::string compare;                // --compare[=grid|label]: "" = off
+    Resample::Spec resample;            // --resample=bootstrap[:K]|jackknife[:G]
+    bool pyramid = false;               // --pyramid: coarser hZMap / hZRMSMap levels
+    LocalFlatness::Spec local;          // --local=<W>[x<H>][:<tol µm>]
+    std::string serve;                  // --serve=<spool dir>: "" = off
+    bool normals = true;                // residuals along I, J, K when present (--no-normals)
+    double probeRadius = 0.0;           // --probe-radius=<mm>: ball centers reported
+};
+
+struct ScanResult {
+    std::string input;
+    std::string output;                 // ROOT file (or file:directory) written
+    std::string failure;                // why the analysis stopped (also in the log)
+    size_t nPoints = 0;
+    double ax = 0, ay = 0, az = 0;
+    double ax_e = 0, ay_e = 0, az_e = 0;
+    double chi2 = 0;                    // [mm²]
+    double sigma = 0;                   // RMS orthogonal residual [mm]
+    double peakToValley = 0;            // [mm]
+    double minimumZone = 0;             // ISO 1101 minimum-zone flatness [mm]
+    std::vector<long> zoneUpper;        // limiting points (labels, or 1-based rows)
+    std::vector<long> zoneLower;
+    GridFinder::Result grid;
+
+    // Robust mode: points clipped from the fit (labels, or 1-based rows)
+    bool robust = false;
+    double robustKSigma = 0;
+    int robustIterations = 0;
+    std::vector<long> rejectedLabels;
+
+    std::vector<TH1D*> hists;           // hX, hY, hZ, hDeviations[, hDeviationsClipped]
+    TGraph *g2 = nullptr;
+    TH2D *hZ = nullptr;
+    TH2D *hZRms = nullptr;
+    std::vector<TH2D*> hZPyramid;       // --pyramid: hZMap_<f>, hZRMSMap_<f> for f = 2, 4, ...
+
+    // --surface: Legendre modes and the residual map after each order
+    SurfaceFit::Result surface;
+    TH1D *hSurfaceModes = nullptr;
+    std::vector<TH2D*> hSurfaceResidual;   // [k - 1]: after removing degree ≤ k
+
+    // --local: RMS about a plane fitted in every W × H window, worst window
+    LocalFlatness::Result local;        // rms[] dropped once hLocalFlatness is filled
+    double localX = 0, localY = 0;      // worst window center [mm], machine X/Y
+    TH2D *hLocal = nullptr;
+
+    // I, J, K present: residuals along the reported normals, tilt of the normals
+    NormalResiduals::Result normals;    // residual[], angle[] dropped once filled
+    TH1D *hNormalDeviations = nullptr;
+    TH1D *hNormalAngle = nullptr;
+    TH2D *hDeviationVsAngle = nullptr;
+
+    // --resample: 95% intervals on σ and peak-to-valley, replicate distributions
+    Resample::Result resample;
+    TH1D *hResampleSigma = nullptr;
+    TH1D *hResamplePtV = nullptr;
+
+    std::shared_ptr<Profiler::Profile> profile;   // --profile (null when off)
+};
+
+// Logs why a scan cannot be analyzed and keeps it for the --serve summary
+bool scanFailed(ScanResult &r, std::ostream &log, const std::string &why) {
+    log << why << endl;
+    r.failure = why;
+    return false;
 }
 
 //------------------------------------------------------------------------------
-// Main program
+// loadScan()
+//   A valid <input>.fscache sidecar is memory mapped and used in place
+//   (see PointCache.h).  Otherwise ASTRAL CMM exports (POINT,X,Y,Z,I,J,K
+//   header) take the memory-mapped fast path and anything else goes
+//   through the generic text reader; the parsed scan is then cached.
 //------------------------------------------------------------------------------
 
-int main(int argc, char *argv[]) {
+// Storage behind a scan's PointView: parsed columns or a mapped cache
+struct ScanInput {
+    PointCloud cloud;
+    PointCache::Mapped cache;
+    PointView view;
+};
+
+bool loadScan(const std::string &filename, const Options &opt, ScanInput &in,
+              std::ostream &log) {
+    if (opt.cache && in.cache.open(filename)) {
+        in.view = in.cache.view();
+        log << "Read " << in.view.size() << " valid points (cached in "
+            << PointCache::sidecarPath(filename) << ")." << endl;
+        return !in.view.empty();
+    }
+
+    PointCloud &cloud = in.cloud;
+    AstralCsv::Report astral;
+    cloud = AstralCsv::read(filename, &astral, log);
+    if (!astral.headerFound)
+        cloud = readPointCloud(filename);
+    else if (astral.rejected > 0)
+        log << "Warning: " << astral.rejected << " unparsable rows skipped." << endl;
+
+    if (cloud.empty()) {
+        log << "No valid points found in " << filename << "." << endl;
+        return false;
+    }
+    in.view = cloud.view();
+    log << "Read " << cloud.size() << " valid points." << endl;
+
+    if (opt.cache && !PointCache::write(filename, cloud))
+        log << "Note: could not write cache " << PointCache::sidecarPath(filename) << endl;
+    return true;
+}
 
-// Usage:
-//
-//   ./flatnessScan input.csv [output.root]
-//
 //------------------------------------------------------------------------------
-// 1. Parse command-line arguments and initialize ROOT application.
+// Shared pieces of analyzeScan() and analyzeStream()
 //------------------------------------------------------------------------------
-////
-// If no output file is specified, defaults to "output.root".
-// If the name given does not end with ".root", the extension is added automatically.
-//
 
-	if (argc < 2) {
-		std::cerr << "Usage: " << argv[0] << " input.csv [output.root]" << std::endl;
-		return 1;
-	}
-	
-	cout << "\n====================================\n";
-	cout << " FlatnessScan " << FLATNESSSCAN_VERSION << " — Luciano Ristori\n";
-	cout << " Built: " << __DATE__ << " " << __TIME__ << endl;
-	cout << "====================================\n";
+// Plane fit summary box, σ and minimum zone
+void printFitSummary(std::ostream &log, const ScanResult &r, bool zoneValid) {
+    {
+        ScientificPrecision sp(log, 2);
+        log << "\n----------------------------------\n";
+        log << "  Plane fit summary\n";
+        log << "  ax = " << r.ax << " ± " << r.ax_e << "\n";
+        log << "  ay = " << r.ay << " ± " << r.ay_e << "\n";
+        log << "  az = " << r.az << " ± " << r.az_e << "\n";
+        log << "  χ² = " << r.chi2 << " mm²\n";
+    }
 
-	std::string filename = argv[1];
-	std::string outname = (argc >= 3) ? argv[2] : "output.root";
+    {
+        FloatingPointPrecision fpp(log, 4);
+        log << "  σ = " << 1000. * r.sigma << " µm\n";
+        if (zoneValid) {
+            log << "  minimum zone = " << 1000. * r.minimumZone << " µm  (limiting points: upper";
+            for (long l : r.zoneUpper) log << " " << l;
+            log << ", lower";
+            for (long l : r.zoneLower) log << " " << l;
+            log << ")\n";
+        } else {
+            log << "  minimum zone: not evaluated\n";
+        }
+        log << "----------------------------------\n";
+    }
 
-	// Append ".root" if missing (case-insensitive)
-	if (outname.size() < 5 || 
-		(outname.substr(outname.size() - 5) != ".root" &&
-		 outname.substr(outname.size() - 5) != ".ROOT")) {
-		outname += ".root";
-	}
+    double moda = sqrt(r.ax*r.ax + r.ay*r.ay + r.az*r.az);
+    double invModa = 1.0 / moda;
+    log << "\n|a| = " << moda << "   1/|a| = " << invModa << " [mm]" << endl;
+    log << "Offset: " << offset << " [mm]" << endl;
+}
 
-	// Initialize ROOT GUI
-	TApplication app("app", &argc, argv);
-	gROOT->SetBatch(false); // enable GUI
-	TH1::AddDirectory(kTRUE);
+// hZMap / hZRMSMap from a filled FlatnessMap; a rotated grid is mapped in
+// grid-frame coordinates X', Y'
+void mapHistograms(const FlatnessMap &map, const GridFinder::Result &grid, ScanResult &r,
+                   std::ostream &log) {
+    if (grid.angle != 0.0) {
+        FloatingPointPrecision fpp(log, 4);
+        log << "Grid rotated by " << grid.angle * 180.0 / GridFinder::kPi
+            << " deg from the X/Y axes: flatness map in grid coordinates." << endl;
+    }
+    ScanHistograms::maps(map, grid, r.hZ, r.hZRms);
+}
 
-    // 2. Read 3D points from input file
-    
-    int n = 3;
-    std::vector<Point> points = readPoints(filename, n);
-    if (points.empty()) {
-        std::cerr << "No valid points found. Exiting." << std::endl;
-        return 1;
+// --pyramid: hZMap_<f> / hZRMSMap_<f>, the map coarsened by f = 2, 4, ...
+// while at least 2 × 2 blocks remain; block sums come from the summed-area
+// tables of FlatnessPyramid, the RMS is that of all points in the block
+void pyramidHistograms(const FlatnessPyramid &pyr, const GridFinder::Result &grid, ScanResult &r,
+                       std::ostream &log) {
+    const FlatnessMap &map = pyr.map();
+    const char *axes = grid.angle != 0.0 ? ";X' [mm];Y' [mm];" : ";X [mm];Y [mm];";
+    int f = 2;
+    for (; (map.Nx + f - 1) / f >= 2 && (map.Ny + f - 1) / f >= 2; f *= 2) {
+        FlatnessMap c = pyr.coarse(f);
+        const double x0 = grid.xMin - grid.dx / 2, y0 = grid.yMin - grid.dy / 2;
+        const std::string tag = std::to_string(f);
+        TH2D *hZ = new TH2D(("hZMap_" + tag).c_str(),
+                            ("Flatness Map, " + tag + "#times" + tag + " cells" + axes + "Z [mm]").c_str(),
+                            c.Nx, x0, x0 + c.Nx * c.dx, c.Ny, y0, y0 + c.Ny * c.dy);
+        TH2D *hRms = new TH2D(("hZRMSMap_" + tag).c_str(),
+                              ("Z RMS, " + tag + "#times" + tag + " cells" + axes + "RMS Z [mm]").c_str(),
+                              c.Nx, x0, x0 + c.Nx * c.dx, c.Ny, y0, y0 + c.Ny * c.dy);
+        for (int iy = 0; iy < c.Ny; ++iy)
+            for (int ix = 0; ix < c.Nx; ++ix) {
+                if (!c.count[c.index(ix, iy)]) continue;
+                hZ->SetBinContent(ix + 1, iy + 1, c.mean(ix, iy));
+                hRms->SetBinContent(ix + 1, iy + 1, c.rms(ix, iy));
+            }
+        hZ->SetStats(0);
+        hRms->SetStats(0);
+        r.hZPyramid.push_back(hZ);
+        r.hZPyramid.push_back(hRms);
     }
+    if (f > 2) log << "Map pyramid: " << (r.hZPyramid.size() / 2) << " levels, down to "
+                   << f / 2 << " × " << f / 2 << " cells per bin." << endl;
+}
 
-    for (auto &p : points) {
-        X.push_back(p.coords[0]);
-        Y.push_back(p.coords[1]);
-        Z.push_back(p.coords[2]);
+// --local: hLocalFlatness, the RMS about the local plane of the window
+// centered on each cell, and the worst window (see LocalFlatness.h)
+void localFlatness(const FlatnessPyramid &pyr, const GridFinder::Result &grid, const Options &opt,
+                   ScanResult &r, std::ostream &log) {
+    const FlatnessMap &map = pyr.map();
+    int wx, wy;
+    LocalFlatness::windowCells(opt.local, map, wx, wy);
+    r.local = LocalFlatness::scan(pyr, wx, wy, opt.kernelThreads, opt.local.tolerance);
+    LocalFlatness::Result &lf = r.local;
+    if (!lf.valid) {
+        log << "Warning: no " << wx << " × " << wy << " cell window fits the "
+            << map.Nx << " × " << map.Ny << " grid — skipping local flatness." << endl;
+        return;
     }
 
-    cout << "Read " << points.size() << " valid points." << endl;
+    const std::string axes = grid.angle != 0.0 ? ";X' [mm];Y' [mm];" : ";X [mm];Y [mm];";
+    std::ostringstream title;
+    title << "Local flatness, " << opt.local.width << " #times " << opt.local.height
+          << " mm windows" << axes << "RMS about local plane [mm]";
+    TH2D *h = new TH2D("hLocalFlatness", title.str().c_str(),
+                       grid.Nx, grid.xMin - grid.dx/2, grid.xMax + grid.dx/2,
+                       grid.Ny, grid.yMin - grid.dy/2, grid.yMax + grid.dy/2);
+    for (int iy = 0; iy < map.Ny; ++iy)
+        for (int ix = 0; ix < map.Nx; ++ix) {
+            double v = lf.rms[map.index(ix, iy)];
+            if (v >= 0.0) h->SetBinContent(ix + 1, iy + 1, v);
+        }
+    h->SetStats(0);
+    r.hLocal = h;
+    lf.rms = std::vector<double>();
+
+    // Worst window center, back from the grid frame to machine X/Y
+    double u = map.xMin + lf.worstIx * map.dx, v = map.yMin + lf.worstIy * map.dy;
+    r.localX = map.cosAngle * u - map.sinAngle * v;
+    r.localY = map.sinAngle * u + map.cosAngle * v;
+    FloatingPointPrecision fpp(log, 4);
+    log << "\nLocal flatness (" << opt.local.width << " × " << opt.local.height << " mm = "
+        << wx << " × " << wy << " cells, " << lf.windows << " windows):\n"
+        << "  worst RMS about local plane = " << 1000. * lf.worst << " µm, window centered at X = "
+        << r.localX << ", Y = " << r.localY << " mm\n";
+    if (opt.local.tolerance > 0)
+        log << "  " << lf.over << " windows above " << 1000. * opt.local.tolerance << " µm — "
+            << (lf.over ? "FAIL" : "PASS") << "\n";
+    log << std::flush;
+}
 
-    // 3. Fit a 3D plane using Minuit2
-    
-    cout << "\nFitting 3D plane..." << endl;
-    ROOT::Math::Minimizer* min =
-        ROOT::Math::Factory::CreateMinimizer("Minuit2", "");
+// Most points a scatter TGraph holds, on screen and in the output file
+const size_t kScatterMaxPoints = ScatterLod::kDefaultMaxPoints;
 
-    min->SetMaxFunctionCalls(1000000);
-    min->SetMaxIterations(1000);
-    min->SetTolerance(0.001);
-    min->SetPrintLevel(0);
+// g2_xy: Y vs X, or above kScatterMaxPoints an evenly decimated subset
+// (see ScatterLod.h); full resolution stays in the input and --tree
+TGraph *scatterGraph(const double *x, const double *y, size_t n, const std::string &title) {
+    TGraph *g2;
+    if (n <= kScatterMaxPoints) {
+        g2 = new TGraph(static_cast<int>(n), x, y);
+        g2->SetTitle(title.c_str());
+    } else {
+        ScatterLod lod(x, y, n);
+        std::vector<double> sx, sy;
+        size_t stride = lod.select(lod.xMin(), lod.xMax(), lod.yMin(), lod.yMax(),
+                                   kScatterMaxPoints, sx, sy);
+        g2 = new TGraph(static_cast<int>(sx.size()), sx.data(), sy.data());
+        g2->SetTitle((title + " (1 in " + std::to_string(stride) + ")").c_str());
+    }
+    g2->SetName("g2_xy");
+    return g2;
+}
 
-    ROOT::Math::Functor f(&chi2Func, 3);
-    double step[3] = {0.001, 0.001, 0.001};
-    double variable[3] = {0.0, 0.0, 1.0 / offset};
-    min->SetFunction(f);
+// --surface: prints the Legendre modes and the RMS left after each order,
+// books hSurfaceModes and, on a grid (map given), hSurfaceResidual_<k>
+void surfaceHistograms(const FlatnessMap *map, const GridFinder::Result &grid, ScanResult &r,
+                       std::ostream &log) {
+    const SurfaceFit::Result &s = r.surface;
+    if (!s.valid) {
+        log << "Warning: Legendre surface fit failed (too few cells or points for order "
+            << s.order << ")." << endl;
+        return;
+    }
+    {
+        FloatingPointPrecision fpp(log, 3);
+        log << "\nLegendre surface fit, order " << s.order << " (" << s.rows
+            << (map ? " cells" : " points") << (s.cached ? ", cached design" : "") << "):\n";
+        for (size_t m = 0; m < s.modes.size(); ++m)
+            log << "  c" << s.modes[m].p << s.modes[m].q << " = "
+                << std::setw(10) << 1000. * s.coeff[m] << " µm\n";
+        for (int k = 0; k <= s.order; ++k)
+            log << "  RMS after order " << k << " = " << 1000. * s.rms[k] << " µm\n";
+    }
 
-    min->SetVariable(0, "ax", variable[0], step[0]);
-    min->SetVariable(1, "ay", variable[1], step[1]);
-    min->SetVariable(2, "az", variable[2], step[2]);
-    min->Minimize();
+    const int m = static_cast<int>(s.modes.size());
+    TH1D *hModes = new TH1D("hSurfaceModes", "Legendre Surface Modes;mode c_{pq};Coefficient [mm]",
+                            m, 0, m);
+    for (int k = 0; k < m; ++k) {
+        std::string label = "c" + std::to_string(s.modes[k].p) + std::to_string(s.modes[k].q);
+        hModes->GetXaxis()->SetBinLabel(k + 1, label.c_str());
+        hModes->SetBinContent(k + 1, s.coeff[k]);
+    }
+    hModes->SetStats(0);
+    r.hSurfaceModes = hModes;
+    if (!map) return;
 
-    const double *res = min->X();
-    const double *err = min->Errors();
+    const char *axes = grid.angle != 0.0 ? ";X' [mm];Y' [mm];" : ";X [mm];Y [mm];";
+    for (int k = 1; k <= s.order; ++k) {
+        std::string name = "hSurfaceResidual_" + std::to_string(k);
+        std::string title = "Residual after Legendre order " + std::to_string(k) + axes + "#DeltaZ [mm]";
+        TH2D *h = new TH2D(name.c_str(), title.c_str(),
+                           grid.Nx, grid.xMin - grid.dx/2, grid.xMax + grid.dx/2,
+                           grid.Ny, grid.yMin - grid.dy/2, grid.yMax + grid.dy/2);
+        for (int iy = 0; iy < map->Ny; ++iy)
+            for (int ix = 0; ix < map->Nx; ++ix) {
+                if (!map->count[map->index(ix, iy)]) continue;
+                double u = map->xMin + ix * map->dx, v = map->yMin + iy * map->dy;
+                h->SetBinContent(ix + 1, iy + 1, map->mean(ix, iy) - SurfaceFit::evaluate(s, u, v, k));
+            }
+        h->SetStats(0);
+        r.hSurfaceResidual.push_back(h);
+    }
+}
 
-    double ax = res[0], ay = res[1], az = res[2];
-    double ax_e = err[0], ay_e = err[1], az_e = err[2];
-    double minChi2 = min->MinValue();
+// Residuals along the reported normals (see NormalResiduals.h): summary,
+// hNormalDeviations, hNormalAngle and hDeviationVsAngle, where hits with
+// a tilted normal (edges, chips, dirt) stand out
+const int kDeviationVsAngleBins = 100;   // per axis
 
+void normalHistograms(const Options &opt, const PointView &cloud, const char *skip,
+                      ScanResult &r, std::ostream &log) {
+    NormalResiduals::Result &nr = r.normals;
+    nr = NormalResiduals::compute(cloud.x.data(), cloud.y.data(), cloud.z.data(),
+                                  cloud.i.data(), cloud.j.data(), cloud.k.data(), cloud.size(),
+                                  r.ax, r.ay, r.az, offset, opt.probeRadius,
+                                  NormalResiduals::kDefaultMaxAngle, skip, opt.kernelThreads);
+    if (!nr.valid) {
+        log << "Warning: too few usable I, J, K normals — skipping residuals along the normals.\n";
+        return;
+    }
+    const RunningStats &rs = nr.residualStats, &as = nr.angleStats;
     {
-        ScientificPrecision sp(cout, 2);
-        cout << "\n----------------------------------\n";
-        cout << "  Plane fit summary\n";
-        cout << "  ax = " << ax << " ± " << ax_e << "\n";
-        cout << "  ay = " << ay << " ± " << ay_e << "\n";
-        cout << "  az = " << az << " ± " << az_e << "\n";
+        FloatingPointPrecision fpp(log, 4);
+        log << "\nResiduals along the reported normals";
+        if (opt.probeRadius != 0.0) log << " (probe radius " << opt.probeRadius << " mm compensated)";
+        log << ":\n  σ = " << 1000. * rs.sigma() << " µm, peak-to-valley = "
+            << 1000. * rs.peakToValley() << " µm\n"
+            << "  normal tilt: mean " << as.mean << " deg, max " << as.max << " deg";
+        if (nr.grazing || nr.nullNormals)
+            log << "; " << nr.grazing << " points beyond " << NormalResiduals::kDefaultMaxAngle
+                << " deg and " << nr.nullNormals << " without a normal left out";
+        log << endl;
     }
 
+    Binning::Axis axis = Binning::make(opt.binning, rs.min, rs.max, rs.sigma(), nr.used);
+    TH1D *h = new TH1D("hNormalDeviations", "Deviations along the Reported Normals",
+                       axis.nBins, axis.lo, axis.hi);
+    h->GetXaxis()->SetTitle("Residual along normal [mm]");
+    h->GetYaxis()->SetTitle("Counts");
+    h->FillN(static_cast<int>(nr.used), nr.residual.data(), nullptr);
+    r.hNormalDeviations = h;
+
+    const double aMax = std::max(as.max * 1.05, 1e-3);
+    Binning::Axis aAxis = Binning::make(opt.binning, 0.0, aMax, as.sigma(), nr.used);
+    TH1D *ha = new TH1D("hNormalAngle", "Tilt of the Reported Normals from the Plane Normal",
+                        aAxis.nBins, 0.0, aMax);
+    ha->GetXaxis()->SetTitle("Angle [deg]");
+    ha->GetYaxis()->SetTitle("Counts");
+    ha->FillN(static_cast<int>(nr.used), nr.angle.data(), nullptr);
+    r.hNormalAngle = ha;
+
+    TH2D *h2 = new TH2D("hDeviationVsAngle", "Residual along Normal vs Normal Tilt;"
+                        "Angle [deg];Residual along normal [mm];Counts",
+                        kDeviationVsAngleBins, 0.0, aMax,
+                        kDeviationVsAngleBins, axis.lo, axis.hi);
+    h2->FillN(static_cast<int>(nr.used), nr.angle.data(), nr.residual.data(), nullptr);
+    h2->SetStats(0);
+    r.hDeviationVsAngle = h2;
+
+    nr.residual = std::vector<double>();
+    nr.angle = std::vector<double>();
+}
+
+// --resample: prints the intervals and books the replicate distributions
+void resampleHistograms(const Options &opt, ScanResult &r, std::ostream &log) {
+    const Resample::Result &rs = r.resample;
+    if (!rs.valid) {
+        log << "Warning: " << Resample::methodName(rs.method)
+            << " failed (too few points or degenerate replicates)." << endl;
+        return;
+    }
     {
-        FloatingPointPrecision fpp(cout, 4);
-        cout << "  σ = " << 1000. * sqrt(minChi2 / X.size()) << " µm\n";
-        cout << "----------------------------------\n";
+        FloatingPointPrecision fpp(log, 4);
+        log << "\n" << Resample::methodName(rs.method) << " (" << rs.replicates
+            << (rs.method == Resample::Method::Bootstrap ? " replicates" : " groups")
+            << "), 95% intervals:\n"
+            << "  σ              = " << 1000. * rs.sigma.estimate << " µm  ["
+            << 1000. * rs.sigma.lo << ", " << 1000. * rs.sigma.hi << "]  SE "
+            << 1000. * rs.sigma.se << " µm\n"
+            << "  peak-to-valley = " << 1000. * rs.peakToValley.estimate << " µm  ["
+            << 1000. * rs.peakToValley.lo << ", " << 1000. * rs.peakToValley.hi << "]  SE "
+            << 1000. * rs.peakToValley.se << " µm" << endl;
     }
 
-    double moda = sqrt(ax*ax + ay*ay + az*az);
-    double invModa = 1.0 / moda;
-    cout << "\n|a| = " << moda << "   1/|a| = " << invModa << " [mm]" << endl;
-    cout << "Offset: " << offset << " [mm]" << endl;
+    auto book = [&](const char *name, const char *title, const std::vector<double> &v) {
+        auto mm = std::minmax_element(v.begin(), v.end());
+        RunningStats st = Kernels::summarize(v.data(), v.size());
+        Binning::Axis axis = Binning::make(opt.binning, *mm.first, *mm.second, st.sigma(), v.size());
+        TH1D *h = new TH1D(name, title, axis.nBins, axis.lo, axis.hi);
+        h->FillN(static_cast<int>(v.size()), v.data(), nullptr);
+        h->GetYaxis()->SetTitle("Replicates");
+        return h;
+    };
+    r.hResampleSigma = book("hResampleSigma", "Resampled #sigma;#sigma [mm]", rs.sigmaReplicates);
+    r.hResamplePtV = book("hResamplePtV", "Resampled peak-to-valley;Peak-to-valley [mm]",
+                          rs.ptvReplicates);
+}
 
-    // 4. Determine coordinate ranges
-    
-    std::vector<double> mins(n, std::numeric_limits<double>::max());
-    std::vector<double> maxs(n, std::numeric_limits<double>::lowest());
-    for (const auto &p : points)
-        for (int i = 0; i < n; ++i) {
-            if (p.coords[i] < mins[i]) mins[i] = p.coords[i];
-            if (p.coords[i] > maxs[i]) maxs[i] = p.coords[i];
+//------------------------------------------------------------------------------
+// analyzeScan()
+//   Steps 3-7: plane fit, histograms, scatter plot and flatness map.
+//   Console output goes to log so concurrent scans do not interleave.
+//------------------------------------------------------------------------------
+
+bool analyzeScan(const PointView &cloud, const Options &opt, ScanResult &r,
+                 std::ostream &log) {
+
+    const size_t nPoints = cloud.size();
+    const double *px = cloud.x.data();
+    const double *py = cloud.y.data();
+    const double *pz = cloud.z.data();
+    r.nPoints = nPoints;
+    Profiler::Scope stage(r.profile.get(), "moments+ranges");
+
+    // Single sweep over the columns: fit moments and coordinate ranges
+    ScanAccumulator acc;
+    for (size_t i = 0; i < nPoints; ++i)
+        acc.add(px[i], py[i], pz[i]);
+
+    const Span<double> xs = cloud.xs(), ys = cloud.ys(), zs = cloud.zs();
+
+    // 3. Fit a 3D plane (closed form or Minuit2)
+
+    stage.next("fit");
+    double ax, ay, az, ax_e, ay_e, az_e, minChi2;
+
+    if (opt.fitEngine == "minuit") {
+        log << "\nFitting 3D plane (Minuit2)..." << endl;
+        ROOT::Math::Minimizer* min =
+            ROOT::Math::Factory::CreateMinimizer("Minuit2", "");
+
+        min->SetMaxFunctionCalls(1000000);
+        min->SetMaxIterations(1000);
+        min->SetTolerance(0.001);
+        min->SetPrintLevel(0);
+
+        uint64_t nCalls = 0;
+        ROOT::Math::Functor f([&](const double *a) {
+            ++nCalls;
+            return chi2Func(a, xs, ys, zs, opt.kernelThreads);
+        }, 3);
+        double step[3] = {0.001, 0.001, 0.001};
+        double variable[3] = {0.0, 0.0, 1.0 / offset};
+        min->SetFunction(f);
+
+        min->SetVariable(0, "ax", variable[0], step[0]);
+        min->SetVariable(1, "ay", variable[1], step[1]);
+        min->SetVariable(2, "az", variable[2], step[2]);
+        min->Minimize();
+
+        const double *res = min->X();
+        const double *err = min->Errors();
+
+        ax = res[0]; ay = res[1]; az = res[2];
+        ax_e = err[0]; ay_e = err[1]; az_e = err[2];
+        minChi2 = min->MinValue();
+        delete min;
+        if (r.profile) r.profile->count("minuit_fcn_calls", nCalls);
+    } else {
+        log << "\nFitting 3D plane (closed form)..." << endl;
+        PlaneFit::Result fit = PlaneFit::fitPCA(acc.moments, offset);
+        if (!fit.valid) {
+            return scanFailed(r, log, "Plane fit failed (degenerate point set).");
+        }
+        ax = fit.ax; ay = fit.ay; az = fit.az;
+        ax_e = fit.axErr; ay_e = fit.ayErr; az_e = fit.azErr;
+        minChi2 = fit.chi2;
+    }
+
+    // 3b. Robust refit: sigma-clipping by removing and re-adding only the
+    //     rejected points' moments (see RobustFit.h)
+    auto pointLabel = [&](size_t i) { return cloud.hasLabels() ? cloud.label[i] : long(i + 1); };
+    ScanAccumulator kept = acc;
+    std::vector<char> rejected;
+    if (opt.robust.enabled) {
+        stage.next("robust");
+        RobustFit::Result rob = RobustFit::clip(px, py, pz, nPoints, acc.moments, offset,
+                                                opt.robust, opt.kernelThreads);
+        if (!rob.fit.valid) {
+            return scanFailed(r, log, "Robust plane fit failed (too many points rejected).");
+        }
+        ax = rob.fit.ax; ay = rob.fit.ay; az = rob.fit.az;
+        ax_e = rob.fit.axErr; ay_e = rob.fit.ayErr; az_e = rob.fit.azErr;
+        minChi2 = rob.fit.chi2;
+        kept.moments = rob.moments;
+        rejected = std::move(rob.rejected);
+
+        r.robust = true;
+        r.robustKSigma = opt.robust.kSigma;
+        r.robustIterations = rob.iterations;
+        for (size_t i = 0; i < nPoints; ++i)
+            if (rejected[i])
+                r.rejectedLabels.push_back(pointLabel(i));
+
+        log << "\nRobust refit (" << opt.robust.kSigma << " σ clipping): "
+            << rob.nRejected << " of " << nPoints << " points rejected after "
+            << rob.iterations << " iterations"
+            << (rob.converged ? "" : " (not converged)") << endl;
+        if (!r.rejectedLabels.empty()) {
+            const size_t kMaxListed = 50;
+            log << (cloud.hasLabels() ? "  rejected points:" : "  rejected rows:");
+            for (size_t k = 0; k < r.rejectedLabels.size() && k < kMaxListed; ++k)
+                log << " " << r.rejectedLabels[k];
+            if (r.rejectedLabels.size() > kMaxListed)
+                log << " ... (" << r.rejectedLabels.size() - kMaxListed << " more)";
+            log << endl;
         }
-        
-        cout<<"ranges done" << endl;
+    }
+
+    ScanAccumulator::Residuals resid = kept.residuals(ax, ay, az, offset);
+
+    // 3c. Minimum-zone flatness, seeded by the fitted plane (see MinimumZone.h)
+    stage.next("minimum zone");
+    MinimumZone::Result zone = MinimumZone::evaluate(px, py, pz, nPoints, ax, ay, az, offset,
+                                                     rejected.empty() ? nullptr : rejected.data());
+    if (zone.valid) {
+        r.minimumZone = zone.width;
+        for (size_t i : zone.upper) r.zoneUpper.push_back(pointLabel(i));
+        for (size_t i : zone.lower) r.zoneLower.push_back(pointLabel(i));
+    }
+
+    r.ax = ax; r.ay = ay; r.az = az;
+    r.ax_e = ax_e; r.ay_e = ay_e; r.az_e = az_e;
+    r.chi2 = minChi2;
+    r.sigma = resid.rms;
+    printFitSummary(log, r, zone.valid);
+
+    // 4. Coordinate ranges come from the accumulator (no extra pass)
 
 	// 5. Create histograms for X, Y, Z, and residuals
 	//    → Provides coordinate distributions and flatness residuals for visualization
 
-    TFile outfile(outname.c_str(), "RECREATE");
+    // Residuals first: their range and spread set the hDeviations binning
+    stage.next("histograms");
+    std::vector<double> residuals(nPoints);
+    Kernels::residuals(px, py, pz, nPoints, ax, ay, az, offset,
+                       residuals.data(), opt.kernelThreads);
+    RunningStats residStats = Kernels::summarize(residuals.data(), nPoints, opt.kernelThreads);
+    r.peakToValley = residStats.peakToValley();
 
-    std::vector<TH1D*> hists;
-    
-    cout << "n = " << n << endl;
-
-    for (int i = 0; i < n; ++i) {
-        double min = mins[i], max = maxs[i];
-        if (min == max) { min -= 0.5; max += 0.5; }
-        double margin = 0.5 * (max - min);
-        int nBins = static_cast<int>((max - min + 2 * margin) * 1000 + 0.5);
-
-        std::string hname, htitle, xaxis;
-        
-        if (i == 0) { hname = "hX"; htitle = "X Coordinate Distribution"; xaxis = "X [mm]"; }
-        else if (i == 1) { hname = "hY"; htitle = "Y Coordinate Distribution"; xaxis = "Y [mm]"; }
-        else if (i == 2) { hname = "hZ"; htitle = "Z Coordinate Distribution"; xaxis = "Z [mm]"; }
-        else { hname = "hCoord" + std::to_string(i + 1); htitle = "Coordinate " + std::to_string(i + 1); xaxis = "Value"; }
-
-        auto *h = new TH1D(hname.c_str(), htitle.c_str(),
-                           nBins, min - margin, max + margin);
-        h->GetXaxis()->SetTitle(xaxis.c_str());
-        h->GetYaxis()->SetTitle("Counts");
-        hists.push_back(h);
-
-		// For Z coordinate (i == 2), also create a second histogram
-    	// to store residuals (deviations from the fitted 3D plane).
-        if (i == 2) {
-            auto *hDev = new TH1D("hDeviations", "Deviations from 3D Plane Fit",
-                                  nBins, min - margin, max + margin);
-            hDev->GetXaxis()->SetTitle("Residual [mm]");
-            hDev->GetYaxis()->SetTitle("Counts");
-            hists.push_back(hDev);
-        }
+    // Residuals of the points kept by the robust fit
+    std::vector<double> clipped;
+    RunningStats clippedStats;
+    if (r.robust) {
+        clipped.reserve(nPoints - r.rejectedLabels.size());
+        for (size_t i = 0; i < nPoints; ++i)
+            if (!rejected[i]) clipped.push_back(residuals[i]);
+        clippedStats = Kernels::summarize(clipped.data(), clipped.size(), opt.kernelThreads);
+        r.peakToValley = clippedStats.peakToValley();
     }
-    
-    cout << "histograms done" << endl;
 
-    for (const auto &p : points) {
-        for (int i = 0; i < n; ++i)
-            hists[i]->Fill(p.coords[i]);
-        	double delta = (ax*p.coords[0] + ay*p.coords[1] + az*(p.coords[2] + offset) - 1.0) * invModa;
-        	hists[3]->Fill(delta); 
+    {
+        FloatingPointPrecision fpp(log, 4);
+        log << "Peak-to-valley = " << 1000. * residStats.peakToValley() << " µm";
+        if (r.robust)
+            log << " (all points), " << 1000. * clippedStats.peakToValley() << " µm (clipped)";
+        log << endl;
+    }
+
+    std::vector<TH1D*> &hists = r.hists;
+    hists = ScanHistograms::book(opt.binning, acc, residStats, nPoints);
+
+    if (r.robust) {
+        Binning::Axis cAxis = Binning::make(opt.binning, clippedStats.min, clippedStats.max,
+                                            clippedStats.sigma(), clipped.size());
+        auto *hClip = new TH1D("hDeviationsClipped", "Deviations from Robust Plane Fit (clipped)",
+                               cAxis.nBins, cAxis.lo, cAxis.hi);
+        hClip->GetXaxis()->SetTitle("Residual [mm]");
+        hClip->GetYaxis()->SetTitle("Counts");
+        hists.push_back(hClip);
     }
-    
-    // write code version to histogram file
-    
-    TNamed versionTag("FlatnessScanVersion", FLATNESS_SCAN_VERSION.c_str());
-	versionTag.Write();
 
-    for (auto h : hists) h->Write();
+    // hists = {hX, hY, hZ, hDeviations}
+    ScanHistograms::fill(hists, px, py, pz, residuals.data(), nPoints);
+    if (r.robust)
+        hists[4]->FillN(static_cast<int>(clipped.size()), clipped.data(), nullptr);
 
+    // 5b. Residuals along the I, J, K normals, when the scan carries them
+    if (opt.normals && cloud.hasNormals()) {
+        stage.next("normals");
+        normalHistograms(opt, cloud, rejected.empty() ? nullptr : rejected.data(), r, log);
+    }
+    
     // 6. 2D Scatter plot of Y vs X
     
-    TGraph* g2 = new TGraph(points.size());
-    for (size_t i = 0; i < points.size(); ++i)
-    g2->SetPoint(i, points[i].coords[0], points[i].coords[1]);
-    g2->SetName("g2_xy");
-    g2->SetTitle("Y vs X");
-    g2->Write();
+    stage.next("scatter");
+    r.g2 = scatterGraph(px, py, nPoints, "Y vs X");
+
+    // 6b. Resampled intervals on σ and peak-to-valley (see Resample.h)
+    if (opt.resample.enabled) {
+        stage.next("resample");
+        r.resample = Resample::run(px, py, pz, nPoints, offset, opt.resample, r.sigma,
+                                   r.peakToValley, opt.kernelThreads,
+                                   rejected.empty() ? nullptr : rejected.data());
+        resampleHistograms(opt, r, log);
+    }
 
     // 7. Flatness color map if grid is regular
     
-    std::vector<std::pair<double,double>> xy;
-    xy.reserve(points.size());
-    for (const auto &p : points)
-        xy.emplace_back(p.coords[0], p.coords[1]);
-        
     // Analyze (X, Y) points to determine if they form a regular Nx×Ny grid.
 	// If yes, create a color-coded 2D histogram of Z values — the "flatness map".
 
-    auto grid = GridFinder::analyze(xy);
-    TH2D *hZ = nullptr;
+    stage.next("grid map");
+    r.grid = GridFinder::analyze(px, py, nPoints);
+    const GridFinder::Result &grid = r.grid;
 
     if (grid.regularX && grid.regularY) {
-        hZ = new TH2D("hZMap", "Flatness Map;X [mm];Y [mm];Z [mm]",
-                      grid.Nx, grid.xMin - grid.dx/2, grid.xMax + grid.dx/2,
-                      grid.Ny, grid.yMin - grid.dy/2, grid.yMax + grid.dy/2);
+        // Dense sum/sum²/count per cell, one pass, no per-cell allocation
+        FlatnessMap map(grid);
+        for (size_t i = 0; i < nPoints; ++i)
+            map.add(px[i], py[i], pz[i]);
+        mapHistograms(map, grid, r, log);
+        if (opt.pyramid || opt.local.enabled) {
+            // One set of summed-area tables for both
+            FlatnessPyramid pyr(map);
+            if (opt.pyramid) pyramidHistograms(pyr, grid, r, log);
+            if (opt.local.enabled) {
+                stage.next("local flatness");
+                localFlatness(pyr, grid, opt, r, log);
+            }
+        }
+
+        // Legendre modes of the cell means (design cached per grid geometry)
+        if (opt.surface.enabled) {
+            stage.next("surface");
+            r.surface = SurfaceFit::fitGrid(map, opt.surface.order);
+            surfaceHistograms(&map, grid, r, log);
+        }
+    } else {
+        log << "Warning: points are not on a regular grid — skipping flatness map.\n";
+        if (opt.surface.enabled) {
+            stage.next("surface");
+            r.surface = SurfaceFit::fitPoints(px, py, pz, nPoints, opt.surface.order,
+                                              rejected.empty() ? nullptr : rejected.data());
+            surfaceHistograms(nullptr, grid, r, log);
+        }
+    }
+
+    return true;
+}
+
+//------------------------------------------------------------------------------
+// analyzeStream()
+//   Out-of-core variant of loadScan() + analyzeScan() for inputs larger
+//   than memory (--stream).  The file is read twice in fixed-size chunks:
+//     pass 1  moments and ranges for the closed-form fit, plus a bounded
+//             uniform sample (reservoir) of the points;
+//     pass 2  residuals into the histograms and the dense flatness map.
+//   Memory is the chunk buffer, the sample, the histograms and the map.
+//   The sample provides what needs the points before pass 2: the grid
+//   lines, the hDeviations range and the Y vs X scatter plot.  Grid
+//   missing points are recounted exactly from the flatness map.
+//   Minimum zone and the robust refit need random access and are not
+//   evaluated in this mode.
+//------------------------------------------------------------------------------
 
-        std::map<std::pair<int,int>, std::vector<double>> bins;
+const size_t kStreamSample = size_t(1) << 20;   // points kept for grid and scatter
 
-        for (const auto& p : points) {
-            int ix = static_cast<int>(std::round((p.coords[0] - grid.xMin) / grid.dx));
-            int iy = static_cast<int>(std::round((p.coords[1] - grid.yMin) / grid.dy));
-            bins[{ix, iy}].push_back(p.coords[2]);
+bool analyzeStream(const std::string &filename, const Options &opt, ScanResult &r,
+                   std::ostream &log) {
+    ChunkedReader in(filename, opt.streamChunkBytes, log);
+    if (!in.ok()) return scanFailed(r, log, "Cannot open " + filename + ".");
+
+    // Pass 1: moments, ranges and reservoir sample
+    Profiler::Scope stage(r.profile.get(), "stream pass 1");
+    ScanAccumulator acc;
+    PointCloud chunk, sample;
+    std::mt19937_64 rng(20251007);
+    size_t seen = 0, nChunks = 0;
+    bool normals = false;
+    while (in.next(chunk)) {
+        ++nChunks;
+        normals |= chunk.hasNormals();
+        for (size_t i = 0; i < chunk.size(); ++i, ++seen) {
+            acc.add(chunk.x[i], chunk.y[i], chunk.z[i]);
+            if (seen < kStreamSample) {
+                sample.x.push_back(chunk.x[i]);
+                sample.y.push_back(chunk.y[i]);
+                sample.z.push_back(chunk.z[i]);
+            } else {
+                size_t slot = std::uniform_int_distribution<size_t>(0, seen)(rng);
+                if (slot < kStreamSample) {
+                    sample.x[slot] = chunk.x[i];
+                    sample.y[slot] = chunk.y[i];
+                    sample.z[slot] = chunk.z[i];
+                }
+            }
         }
+    }
+    if (in.rejected() > 0)
+        log << "Warning: " << in.rejected() << " unparsable rows skipped." << endl;
+    const size_t nPoints = seen;
+    r.nPoints = nPoints;
+    if (nPoints < 3)
+        return scanFailed(r, log, "No valid points found in " + filename + ".");
+    log << "Read " << nPoints << " valid points in " << nChunks << " chunks of "
+        << (in.chunkBytes() >> 20) << " MB (streaming)." << endl;
+    if (normals && opt.normals)
+        log << "Note: residuals along the I, J, K normals need the points in memory"
+               " — not evaluated with --stream." << endl;
+
+    // 3. Closed-form fit from the moments
+    if (opt.fitEngine == "minuit")
+        log << "Note: --stream uses the closed-form fit (Minuit needs the points in memory)." << endl;
+    stage.next("fit");
+    log << "\nFitting 3D plane (closed form)..." << endl;
+    PlaneFit::Result fit = PlaneFit::fitPCA(acc.moments, offset);
+    if (!fit.valid) {
+        return scanFailed(r, log, "Plane fit failed (degenerate point set).");
+    }
+    const double ax = fit.ax, ay = fit.ay, az = fit.az;
+    r.ax = ax; r.ay = ay; r.az = az;
+    r.ax_e = fit.axErr; r.ay_e = fit.ayErr; r.az_e = fit.azErr;
+    r.chi2 = fit.chi2;
+    r.sigma = acc.residuals(ax, ay, az, offset).rms;
+    printFitSummary(log, r, false);
+
+    // hDeviations range from the sample's residuals
+    stage.next("sample grid");
+    const size_t nSample = sample.size();
+    std::vector<double> residuals(nSample);
+    Kernels::residuals(sample.x.data(), sample.y.data(), sample.z.data(), nSample,
+                       ax, ay, az, offset, residuals.data(), opt.kernelThreads);
+    RunningStats sampleStats = Kernels::summarize(residuals.data(), nSample, opt.kernelThreads);
+
+    std::vector<TH1D*> &hists = r.hists;
+    hists = ScanHistograms::book(opt.binning, acc, sampleStats, nPoints);
+
+    // Grid lines from the sample
+    r.grid = GridFinder::analyze(sample.x.data(), sample.y.data(), nSample);
+    GridFinder::Result &grid = r.grid;
+    bool regular = grid.regularX && grid.regularY;
+    FlatnessMap map;
+    if (regular) map = FlatnessMap(grid);
 
-        for (const auto& [idx, zs] : bins) {
-            double zmean = std::accumulate(zs.begin(), zs.end(), 0.0) / zs.size();
-            hZ->SetBinContent(idx.first + 1, idx.second + 1, zmean);
+    // Pass 2: residuals into histograms and flatness map
+    stage.next("stream pass 2");
+    in.rewind();
+    RunningStats residStats;
+    while (in.next(chunk)) {
+        const size_t nc = chunk.size();
+        residuals.resize(nc);
+        Kernels::residuals(chunk.x.data(), chunk.y.data(), chunk.z.data(), nc,
+                           ax, ay, az, offset, residuals.data(), opt.kernelThreads);
+        residStats.merge(Kernels::summarize(residuals.data(), nc, opt.kernelThreads));
+        ScanHistograms::fill(hists, chunk.x.data(), chunk.y.data(), chunk.z.data(),
+                             residuals.data(), nc);
+        if (regular)
+            for (size_t i = 0; i < nc; ++i)
+                map.add(chunk.x[i], chunk.y[i], chunk.z[i]);
+    }
+    r.peakToValley = residStats.peakToValley();
+    {
+        FloatingPointPrecision fpp(log, 4);
+        log << "Peak-to-valley = " << 1000. * residStats.peakToValley() << " µm" << endl;
+    }
+
+    // 6. Scatter plot of the sample
+    stage.next("scatter");
+    r.g2 = scatterGraph(sample.x.data(), sample.y.data(), nSample,
+                        nSample < nPoints ? "Y vs X (uniform sample)" : "Y vs X");
+
+    // 7. Flatness map
+    stage.next("grid map");
+    if (regular) {
+        size_t cells = size_t(map.Nx) * size_t(map.Ny);
+        grid.missingPoints = static_cast<int>(cells - map.occupiedCells());
+        mapHistograms(map, grid, r, log);
+        if (opt.pyramid || opt.local.enabled) {
+            // One set of summed-area tables for both
+            FlatnessPyramid pyr(map);
+            if (opt.pyramid) pyramidHistograms(pyr, grid, r, log);
+            if (opt.local.enabled) {
+                stage.next("local flatness");
+                localFlatness(pyr, grid, opt, r, log);
+            }
+        }
+        if (opt.surface.enabled) {
+            stage.next("surface");
+            r.surface = SurfaceFit::fitGrid(map, opt.surface.order);
+            surfaceHistograms(&map, grid, r, log);
         }
-		hZ->SetStats(0);  // disables stats box for this histogram
-        hZ->Write();
     } else {
-        std::cerr << "Warning: points are not on a regular grid — skipping flatness map.\n";
+        log << "Warning: points are not on a regular grid — skipping flatness map.\n";
+        if (opt.surface.enabled)
+            log << "Warning: --stream fits the surface on the grid map only — skipping surface fit.\n";
+    }
+    return true;
+}
+
+// Reads and analyzes one input, in memory or streaming; in keeps the
+// points alive for writeScan()
+bool runScan(const std::string &filename, const Options &opt, ScanInput &in,
+             ScanResult &r, std::ostream &log) {
+    if (opt.streamChunkBytes > 0)
+        return analyzeStream(filename, opt, r, log);
+    Profiler::Scope stage(r.profile.get(), "read");
+    if (!loadScan(filename, opt, in, log)) {
+        r.failure = "No valid points found in " + filename + ".";
+        return false;
+    }
+    stage.stop();
+    return analyzeScan(in.view, opt, r, log);
+}
+
+//------------------------------------------------------------------------------
+// writePointTree()
+//   Per-point TTree "points" for columnar analysis (RDataFrame):
+//   label, x, y, z, [i, j, k,] residual [mm] from the reported plane and
+//   the flatness-map cell index ix + Nx*iy (-1 off grid or without grid).
+//   Written with the output file's compression.
+//------------------------------------------------------------------------------
+
+void writePointTree(TDirectory *dir, const PointView &pts, const ScanResult &r) {
+    const size_t nPoints = pts.size();
+    std::vector<double> residuals(nPoints);
+    Kernels::residuals(pts.x.data(), pts.y.data(), pts.z.data(), nPoints,
+                       r.ax, r.ay, r.az, offset, residuals.data());
+    const GridFinder::Result &g = r.grid;
+    const bool regular = g.regularX && g.regularY && g.Nx > 0 && g.Ny > 0;
+
+    TTree *t = new TTree("points", "Per-point residuals from the plane fit");
+    t->SetDirectory(dir);
+    Long64_t label = 0, cell = -1;
+    Double_t x = 0, y = 0, z = 0, i = 0, j = 0, k = 0, residual = 0;
+    t->Branch("label", &label, "label/L");
+    t->Branch("x", &x, "x/D");
+    t->Branch("y", &y, "y/D");
+    t->Branch("z", &z, "z/D");
+    if (pts.hasNormals()) {
+        t->Branch("i", &i, "i/D");
+        t->Branch("j", &j, "j/D");
+        t->Branch("k", &k, "k/D");
+    }
+    t->Branch("residual", &residual, "residual/D");
+    t->Branch("cell", &cell, "cell/L");
+
+    for (size_t p = 0; p < nPoints; ++p) {
+        label = pts.hasLabels() ? pts.label[p] : Long64_t(p + 1);
+        x = pts.x[p]; y = pts.y[p]; z = pts.z[p];
+        if (pts.hasNormals()) { i = pts.i[p]; j = pts.j[p]; k = pts.k[p]; }
+        residual = residuals[p];
+        cell = -1;
+        if (regular) {   // same cell convention as FlatnessMap::cell()
+            double u, v;
+            g.toGrid(x, y, u, v);
+            long ix = std::lround((u - g.xMin) / g.dx);
+            long iy = std::lround((v - g.yMin) / g.dy);
+            if (ix >= 0 && ix < g.Nx && iy >= 0 && iy < g.Ny)
+                cell = ix + Long64_t(g.Nx) * iy;
+        }
+        t->Fill();
+    }
+    t->Write();
+    delete t;
+}
+
+//------------------------------------------------------------------------------
+// writeScan()
+//   Writes the version tag and the scan's ROOT objects into dir, plus the
+//   per-point tree when points are given (--tree).
+//------------------------------------------------------------------------------
+
+void writeScan(TDirectory *dir, const ScanResult &r, const PointView *points = nullptr) {
+    TNamed versionTag("FlatnessScanVersion", FLATNESS_SCAN_VERSION.c_str());
+    dir->WriteTObject(&versionTag);
+    TParameter<double> zone("MinimumZoneFlatness", r.minimumZone);   // [mm]
+    dir->WriteTObject(&zone);
+    for (auto h : r.hists) dir->WriteTObject(h);
+    if (r.g2) dir->WriteTObject(r.g2);
+    if (r.hZ) dir->WriteTObject(r.hZ);
+    if (r.hZRms) dir->WriteTObject(r.hZRms);
+    for (auto h : r.hZPyramid) dir->WriteTObject(h);
+    if (r.hLocal) {
+        TParameter<double> worst("LocalFlatnessWorst", r.local.worst);   // [mm]
+        dir->WriteTObject(&worst);
+        dir->WriteTObject(r.hLocal);
+    }
+    if (r.hNormalDeviations) {
+        TParameter<double> sigmaN("NormalSigma", r.normals.residualStats.sigma());   // [mm]
+        TParameter<double> ptvN("NormalPeakToValley", r.normals.residualStats.peakToValley());
+        TParameter<double> radius("ProbeRadius", r.normals.probeRadius);
+        dir->WriteTObject(&sigmaN);
+        dir->WriteTObject(&ptvN);
+        dir->WriteTObject(&radius);
+        dir->WriteTObject(r.hNormalDeviations);
+        dir->WriteTObject(r.hNormalAngle);
+        dir->WriteTObject(r.hDeviationVsAngle);
+    }
+    if (r.hSurfaceModes) dir->WriteTObject(r.hSurfaceModes);
+    for (auto h : r.hSurfaceResidual) dir->WriteTObject(h);
+    if (r.resample.valid) {
+        TParameter<double> sLo("SigmaCILow", r.resample.sigma.lo);          // [mm], 95%
+        TParameter<double> sHi("SigmaCIHigh", r.resample.sigma.hi);
+        TParameter<double> pLo("PeakToValleyCILow", r.resample.peakToValley.lo);
+        TParameter<double> pHi("PeakToValleyCIHigh", r.resample.peakToValley.hi);
+        dir->WriteTObject(&sLo);
+        dir->WriteTObject(&sHi);
+        dir->WriteTObject(&pLo);
+        dir->WriteTObject(&pHi);
+    }
+    if (r.hResampleSigma) dir->WriteTObject(r.hResampleSigma);
+    if (r.hResamplePtV) dir->WriteTObject(r.hResamplePtV);
+    if (points) writePointTree(dir, *points, r);
+}
+
+// Detached copies of the scan's ROOT objects, for a writer thread that
+// must not share them with the canvases (release with releaseObjects())
+ScanResult cloneObjects(const ScanResult &r) {
+    ScanResult c = r;
+    for (auto &h : c.hists) h = static_cast<TH1D*>(h->Clone());
+    if (c.g2)    c.g2 = static_cast<TGraph*>(c.g2->Clone());
+    if (c.hZ)    c.hZ = static_cast<TH2D*>(c.hZ->Clone());
+    if (c.hZRms) c.hZRms = static_cast<TH2D*>(c.hZRms->Clone());
+    for (auto &h : c.hZPyramid) h = static_cast<TH2D*>(h->Clone());
+    if (c.hLocal) c.hLocal = static_cast<TH2D*>(c.hLocal->Clone());
+    if (c.hNormalDeviations) {
+        c.hNormalDeviations = static_cast<TH1D*>(c.hNormalDeviations->Clone());
+        c.hNormalAngle = static_cast<TH1D*>(c.hNormalAngle->Clone());
+        c.hDeviationVsAngle = static_cast<TH2D*>(c.hDeviationVsAngle->Clone());
+    }
+    if (c.hSurfaceModes) c.hSurfaceModes = static_cast<TH1D*>(c.hSurfaceModes->Clone());
+    for (auto &h : c.hSurfaceResidual) h = static_cast<TH2D*>(h->Clone());
+    if (c.hResampleSigma) c.hResampleSigma = static_cast<TH1D*>(c.hResampleSigma->Clone());
+    if (c.hResamplePtV) c.hResamplePtV = static_cast<TH1D*>(c.hResamplePtV->Clone());
+    return c;
+}
+
+// Frees the scan's ROOT objects once written
+void releaseObjects(ScanResult &r) {
+    for (auto h : r.hists) delete h;
+    r.hists.clear();
+    delete r.g2;    r.g2 = nullptr;
+    delete r.hZ;    r.hZ = nullptr;
+    delete r.hZRms; r.hZRms = nullptr;
+    for (auto h : r.hZPyramid) delete h;
+    r.hZPyramid.clear();
+    delete r.hLocal; r.hLocal = nullptr;
+    delete r.hNormalDeviations; r.hNormalDeviations = nullptr;
+    delete r.hNormalAngle;      r.hNormalAngle = nullptr;
+    delete r.hDeviationVsAngle; r.hDeviationVsAngle = nullptr;
+    delete r.hSurfaceModes; r.hSurfaceModes = nullptr;
+    for (auto h : r.hSurfaceResidual) delete h;
+    r.hSurfaceResidual.clear();
+    delete r.hResampleSigma; r.hResampleSigma = nullptr;
+    delete r.hResamplePtV;   r.hResamplePtV = nullptr;
+}
+
+//------------------------------------------------------------------------------
+// followScan()
+//   --follow: tails an input that the CMM program is still writing (see
+//   ChunkedReader::poll()).  Every new row updates the fit moments by a
+//   rank-1 addition; every kFollowRedraw seconds the plane is refitted in
+//   closed form, the running σ and peak-to-valley are printed and, unless
+//   in batch mode, the live hDeviations and hZMap are rebuilt and redrawn.
+//   The residuals are recomputed at each update since the plane moves as
+//   rows arrive.  Following ends when the file has not grown for
+//   opt.followIdle seconds (0 = never) or when the live canvas is closed;
+//   analyzeScan() then runs on every row read, so the output is that of a
+//   normal run.
+//------------------------------------------------------------------------------
+
+const double kFollowRedraw = 2.0;     // [s] between live updates
+const unsigned kFollowPoll = 200;     // [ms] between reads of the input
+
+bool followScan(const std::string &filename, const Options &opt, ScanInput &in,
+                ScanResult &r, std::ostream &log) {
+    using Clock = std::chrono::steady_clock;
+    auto elapsed = [](Clock::time_point since) {
+        return std::chrono::duration<double>(Clock::now() - since).count();
+    };
+    auto idle = [&](Clock::time_point since) {
+        return opt.followIdle > 0 && elapsed(since) > opt.followIdle;
+    };
+
+    // The CMM program may not have created the file yet
+    Clock::time_point lastData = Clock::now();
+    struct stat st;
+    while (::stat(filename.c_str(), &st) != 0 || st.st_size == 0) {
+        if (idle(lastData)) {
+            std::cerr << "Error: " << filename << " did not appear." << std::endl;
+            return false;
+        }
+        gSystem->ProcessEvents();
+        gSystem->Sleep(kFollowPoll);
+    }
+    ChunkedReader tail(filename, size_t(1) << 20, log);
+    if (!tail.ok()) return false;
+    log << "Following " << filename
+        << (opt.batch ? "" : " (close the live canvas to finish)") << "..." << endl;
+
+    PointCloud &cloud = in.cloud;
+    PointCloud chunk;
+    ScanAccumulator acc;
+    TCanvas *live = nullptr;
+    TH1D *hDev = nullptr;
+    ScanResult liveMap;                   // hZ / hZRms of the latest update
+    size_t drawn = 0;
+    Clock::time_point lastDraw = Clock::now();
+
+    auto update = [&]() {
+        const size_t n = cloud.size();
+        PlaneFit::Result fit = PlaneFit::fitPCA(acc.moments, offset);
+        if (!fit.valid) return;
+        std::vector<double> residuals(n);
+        Kernels::residuals(cloud.x.data(), cloud.y.data(), cloud.z.data(), n,
+                           fit.ax, fit.ay, fit.az, offset, residuals.data(), opt.kernelThreads);
+        RunningStats rs = Kernels::summarize(residuals.data(), n, opt.kernelThreads);
+        {
+            FloatingPointPrecision fpp(log, 4);
+            log << "[follow] " << n << " points   σ = "
+                << 1000. * acc.residuals(fit.ax, fit.ay, fit.az, offset).rms
+                << " µm   peak-to-valley = " << 1000. * rs.peakToValley() << " µm" << endl;
+        }
+        if (opt.batch) return;
+
+        delete hDev;
+        Binning::Axis axis = Binning::make(opt.binning, rs.min, rs.max, rs.sigma(), n);
+        hDev = new TH1D("hDeviationsLive", "Deviations from 3D Plane Fit (live)",
+                        axis.nBins, axis.lo, axis.hi);
+        hDev->GetXaxis()->SetTitle("Residual [mm]");
+        hDev->GetYaxis()->SetTitle("Counts");
+        hDev->FillN(static_cast<int>(n), residuals.data(), nullptr);
+
+        releaseObjects(liveMap);
+        GridFinder::Result grid = GridFinder::analyze(cloud.x.data(), cloud.y.data(), n);
+        if (grid.regularX && grid.regularY) {
+            FlatnessMap map(grid);
+            for (size_t i = 0; i < n; ++i)
+                map.add(cloud.x[i], cloud.y[i], cloud.z[i]);
+            std::ostringstream quiet;
+            mapHistograms(map, grid, liveMap, quiet);
+        }
+
+        if (!live) {
+            live = new TCanvas("cFollow", "flatnessScan --follow (live)", 50, 50, 1400, 600);
+            live->Divide(2, 1);
+        }
+        live->cd(1);
+        hDev->Draw();
+        live->cd(2);
+        if (liveMap.hZ) liveMap.hZ->Draw("COLZ");
+        else gPad->Clear();
+        live->Modified();
+        live->Update();
+    };
+
+    for (;;) {
+        while (tail.poll(chunk)) {
+            for (size_t i = 0; i < chunk.size(); ++i)
+                acc.add(chunk.x[i], chunk.y[i], chunk.z[i]);
+            cloud.x.insert(cloud.x.end(), chunk.x.begin(), chunk.x.end());
+            cloud.y.insert(cloud.y.end(), chunk.y.begin(), chunk.y.end());
+            cloud.z.insert(cloud.z.end(), chunk.z.begin(), chunk.z.end());
+            cloud.i.insert(cloud.i.end(), chunk.i.begin(), chunk.i.end());
+            cloud.j.insert(cloud.j.end(), chunk.j.begin(), chunk.j.end());
+            cloud.k.insert(cloud.k.end(), chunk.k.begin(), chunk.k.end());
+            cloud.label.insert(cloud.label.end(), chunk.label.begin(), chunk.label.end());
+            lastData = Clock::now();
+        }
+        if (cloud.size() >= 4 && cloud.size() != drawn && elapsed(lastDraw) >= kFollowRedraw) {
+            update();
+            drawn = cloud.size();
+            lastDraw = Clock::now();
+        }
+        if (!opt.batch) {
+            gSystem->ProcessEvents();
+            if (live && !gROOT->GetListOfCanvases()->FindObject("cFollow")) {
+                live = nullptr;           // closed by the operator
+                break;
+            }
+        }
+        if (idle(lastData)) break;
+        gSystem->Sleep(kFollowPoll);
+    }
+
+    if (live) delete live;
+    delete hDev;
+    releaseObjects(liveMap);
+    log << "Stopped following " << filename << " after " << cloud.size() << " points." << endl;
+
+    if (cloud.empty())
+        return scanFailed(r, log, "No valid points found in " + filename + ".");
+    in.view = cloud.view();
+    return analyzeScan(in.view, opt, r, log);
+}
+
+//------------------------------------------------------------------------------
+// ScatterZoom
+//   Level-of-detail scatter plot for scans of more than kScatterMaxPoints
+//   points.  The canvas gets a fixed frame over the full extent, so zoom
+//   and unzoom act on the frame axes; a timer polls the visible range and,
+//   when it changes, refills the graph with at most kScatterMaxPoints
+//   points of that window — every point once the window is small enough.
+//   The columns must stay alive while the GUI runs.
+//------------------------------------------------------------------------------
+
+const long kScatterZoomPoll = 250;   // ms
+
+class ScatterZoom : public TTimer {
+public:
+    ScatterZoom(TCanvas *canvas, TGraph *graph, const PointView &pts)
+        : TTimer(kScatterZoomPoll, kTRUE), canvas_(canvas), graph_(graph),
+          lod_(pts.x.data(), pts.y.data(), pts.size())
+    {
+        frame_ = canvas_->DrawFrame(lod_.xMin(), lod_.yMin(), lod_.xMax(), lod_.yMax(),
+                                    graph_->GetTitle());
+        frame_->GetXaxis()->SetTitle("X [mm]");
+        frame_->GetYaxis()->SetTitle("Y [mm]");
+        graph_->Draw("P");
+        range(last_);
+    }
+
+    Bool_t Notify() override {
+        if (!gROOT->GetListOfCanvases()->FindObject(canvas_)) {
+            TurnOff();
+            return kTRUE;
+        }
+        double now[4];
+        range(now);
+        if (!std::equal(now, now + 4, last_)) {
+            std::copy(now, now + 4, last_);
+            size_t stride = lod_.select(now[0], now[1], now[2], now[3], kScatterMaxPoints, sx_, sy_);
+            graph_->Set(0);
+            for (size_t k = 0; k < sx_.size(); ++k)
+                graph_->SetPoint(static_cast<int>(k), sx_[k], sy_[k]);
+            std::string title = stride > 1 ? "Y vs X (1 in " + std::to_string(stride) + ")"
+                                           : "Y vs X (all points)";
+            frame_->SetTitle(title.c_str());
+            canvas_->Modified();
+            canvas_->Update();
+        }
+        Reset();
+        return kTRUE;
+    }
+
+private:
+    // Visible window of the frame: x0, x1, y0, y1
+    void range(double r[4]) const {
+        TAxis *ax = frame_->GetXaxis(), *ay = frame_->GetYaxis();
+        r[0] = ax->GetBinLowEdge(ax->GetFirst());
+        r[1] = ax->GetBinUpEdge(ax->GetLast());
+        r[2] = ay->GetBinLowEdge(ay->GetFirst());
+        r[3] = ay->GetBinUpEdge(ay->GetLast());
     }
 
-    // 8. Display results
+    TCanvas *canvas_;
+    TGraph *graph_;
+    TH1F *frame_ = nullptr;
+    ScatterLod lod_;
+    double last_[4];
+    std::vector<double> sx_, sy_;
+};
+
+//------------------------------------------------------------------------------
+// displayResults()
+//   Step 8: one canvas per histogram, the scatter plot and the flatness map.
+//   Interactive mode only.  points, when they are still in memory, feed the
+//   level-of-detail scatter plot of large scans.
+//------------------------------------------------------------------------------
+
+void displayResults(const ScanResult &r, const PointView &points) {
+    const std::vector<TH1D*> &hists = r.hists;
     int canvasWidth = 800, canvasHeight = 600;
 
     for (size_t i = 0; i < hists.size(); ++i) {
@@ -381,57 +1487,1022 @@ int main(int argc, char *argv[]) {
 
     TCanvas *c2 = new TCanvas("c2", "2D Scatter (Y vs X)", 900, 150, 700, 600);
     c2->Connect("Closed()", "TApplication", gApplication, "Terminate()");
-    g2->SetMarkerStyle(20);
-    g2->SetMarkerSize(0.8);
-    g2->SetMarkerColor(kBlack);
-    g2->Draw("AP");
+    r.g2->SetMarkerStyle(20);
+    r.g2->SetMarkerSize(0.8);
+    r.g2->SetMarkerColor(kBlack);
+    if (points.size() > kScatterMaxPoints) {
+        r.g2->SetMarkerSize(0.3);
+        (new ScatterZoom(c2, r.g2, points))->TurnOn();   // lives with the GUI
+    } else {
+        r.g2->Draw("AP");
+    }
     c2->Update();
 
-    if (hZ) {
+    if (r.hZ) {
         TCanvas *cMap = new TCanvas("cMap", "Flatness Map", 1650, 150, 800, 650);
         gStyle->SetPalette(kBird);
         cMap->SetLeftMargin(0.15);
         cMap->SetRightMargin(0.18);
         cMap->SetBottomMargin(0.12);
         cMap->SetTopMargin(0.08);
-        hZ->SetStats(0);
-        hZ->GetXaxis()->SetTitleOffset(1.2);
-        hZ->GetYaxis()->SetTitleOffset(1.6);
-        hZ->Draw("COLZ");
+        r.hZ->SetStats(0);
+        r.hZ->GetXaxis()->SetTitleOffset(1.2);
+        r.hZ->GetYaxis()->SetTitleOffset(1.6);
+        r.hZ->Draw("COLZ");
         cMap->Update();
 	}
+
+    if (r.hLocal) {
+        TCanvas *cLocal = new TCanvas("cLocal", "Local Flatness", 1680, 200, 800, 650);
+        cLocal->SetRightMargin(0.18);
+        r.hLocal->Draw("COLZ");
+        cLocal->Update();
+    }
+
+    if (r.hDeviationVsAngle) {
+        TCanvas *cNormals = new TCanvas("cNormals", "Residuals along the Normals", 1000, 200, 1200, 500);
+        cNormals->Divide(2, 1);
+        cNormals->cd(1);
+        r.hNormalDeviations->Draw();
+        cNormals->cd(2);
+        gPad->SetRightMargin(0.15);
+        r.hDeviationVsAngle->Draw("COLZ");
+        cNormals->Update();
+    }
+
+    // What is left once the fitted modes are removed
+    if (!r.hSurfaceResidual.empty()) {
+        TCanvas *cSurf = new TCanvas("cSurface", "Surface Residual", 1700, 250, 800, 650);
+        cSurf->SetRightMargin(0.18);
+        r.hSurfaceResidual.back()->Draw("COLZ");
+        cSurf->Update();
+    }
+}
+
+//------------------------------------------------------------------------------
+// writeSummaryJson()
+//   Machine-readable summary for automated pipelines (lengths in mm).
+//------------------------------------------------------------------------------
+
+std::string jsonEscape(const std::string &s) {
+    std::string out;
+    for (char c : s) {
+        if (c == '"' || c == '\\') { out += '\\'; out += c; }
+        else if (static_cast<unsigned char>(c) < 0x20) {
+            char buf[8];
+            std::snprintf(buf, sizeof(buf), "\\u%04x", c);
+            out += buf;
+        }
+        else out += c;
+    }
+    return out;
+}
+
+void writeSummaryJson(std::ostream &os, const ScanResult &r, const std::string &rootFile) {
+    const GridFinder::Result &g = r.grid;
+    ScientificPrecision sp(os, 9);
+    os << "{\n"
+       << "  \"version\": \"" << FLATNESS_SCAN_VERSION << "\",\n"
+       << "  \"input\": \"" << jsonEscape(r.input) << "\",\n"
+       << "  \"output\": \"" << jsonEscape(rootFile) << "\",\n"
+       << "  \"points\": " << r.nPoints << ",\n"
+       << "  \"offset\": " << offset << ",\n"
+       << "  \"fit\": {\"ax\": " << r.ax << ", \"ay\": " << r.ay << ", \"az\": " << r.az
+       << ", \"ax_err\": " << r.ax_e << ", \"ay_err\": " << r.ay_e << ", \"az_err\": " << r.az_e
+       << ", \"chi2\": " << r.chi2 << "},\n"
+       << "  \"sigma\": " << r.sigma << ",\n"
+       << "  \"peak_to_valley\": " << r.peakToValley << ",\n"
+       << "  \"minimum_zone\": {\"width\": " << r.minimumZone << ", \"upper\": [";
+    for (size_t k = 0; k < r.zoneUpper.size(); ++k) os << (k ? ", " : "") << r.zoneUpper[k];
+    os << "], \"lower\": [";
+    for (size_t k = 0; k < r.zoneLower.size(); ++k) os << (k ? ", " : "") << r.zoneLower[k];
+    os << "]},\n"
+       << "  \"grid\": {\"regular_x\": " << (g.regularX ? "true" : "false")
+       << ", \"regular_y\": " << (g.regularY ? "true" : "false")
+       << ", \"nx\": " << g.Nx << ", \"ny\": " << g.Ny
+       << ", \"dx\": " << g.dx << ", \"dy\": " << g.dy
+       << ", \"missing_points\": " << g.missingPoints
+       << ", \"angle_deg\": " << g.angle * 180.0 / GridFinder::kPi << "}";
+    if (r.robust) {
+        os << ",\n  \"robust\": {\"k_sigma\": " << r.robustKSigma
+           << ", \"iterations\": " << r.robustIterations
+           << ", \"rejected\": " << r.rejectedLabels.size() << ", \"rejected_labels\": [";
+        for (size_t k = 0; k < r.rejectedLabels.size(); ++k)
+            os << (k ? ", " : "") << r.rejectedLabels[k];
+        os << "]}";
+    }
+    if (r.surface.valid) {
+        const SurfaceFit::Result &s = r.surface;
+        os << ",\n  \"surface\": {\"basis\": \"legendre\", \"order\": " << s.order
+           << ", \"rows\": " << s.rows << ", \"cached\": " << (s.cached ? "true" : "false")
+           << ", \"coefficients\": {";
+        for (size_t m = 0; m < s.modes.size(); ++m)
+            os << (m ? ", " : "") << "\"c" << s.modes[m].p << s.modes[m].q << "\": " << s.coeff[m];
+        os << "}, \"rms_after_order\": [";
+        for (size_t k = 0; k < s.rms.size(); ++k) os << (k ? ", " : "") << s.rms[k];
+        os << "]}";
+    }
+    if (r.local.valid) {
+        os << ",\n  \"local\": {\"window_mm\": [" << r.local.wx * g.dx << ", " << r.local.wy * g.dy
+           << "], \"window_cells\": [" << r.local.wx << ", " << r.local.wy
+           << "], \"windows\": " << r.local.windows << ", \"worst_rms\": " << r.local.worst
+           << ", \"worst_x\": " << r.localX << ", \"worst_y\": " << r.localY
+           << ", \"over_tolerance\": " << r.local.over << "}";
+    }
+    if (r.hNormalDeviations) {
+        const NormalResiduals::Result &nr = r.normals;
+        os << ",\n  \"normals\": {\"probe_radius\": " << nr.probeRadius
+           << ", \"points\": " << nr.used << ", \"sigma\": " << nr.residualStats.sigma()
+           << ", \"peak_to_valley\": " << nr.residualStats.peakToValley()
+           << ", \"angle_mean_deg\": " << nr.angleStats.mean
+           << ", \"angle_max_deg\": " << nr.angleStats.max
+           << ", \"grazing\": " << nr.grazing << ", \"no_normal\": " << nr.nullNormals << "}";
+    }
+    if (r.resample.valid) {
+        const Resample::Result &rs = r.resample;
+        auto interval = [&](const Resample::Interval &iv) {
+            os << "{\"lo\": " << iv.lo << ", \"hi\": " << iv.hi << ", \"se\": " << iv.se << "}";
+        };
+        os << ",\n  \"resample\": {\"method\": \"" << Resample::methodName(rs.method)
+           << "\", \"replicates\": " << rs.replicates << ", \"confidence\": 0.95, \"sigma\": ";
+        interval(rs.sigma);
+        os << ", \"peak_to_valley\": ";
+        interval(rs.peakToValley);
+        os << "}";
+    }
+    if (r.profile) {
+        os << ",\n  \"profile\": ";
+        r.profile->writeJson(os);
+    }
+    os << "\n}\n";
+}
+
+//------------------------------------------------------------------------------
+// Multi-file processing
+//------------------------------------------------------------------------------
+
+// --compression=zstd|lz4|zlib|lzma[:<level>] or none, as TFile settings
+bool parseCompression(const std::string &text, int &settings) {
+    if (text == "none") {
+        settings = 0;
+        return true;
+    }
+    std::string algo = text, level = "5";
+    size_t colon = text.find(':');
+    if (colon != std::string::npos) {
+        algo = text.substr(0, colon);
+        level = text.substr(colon + 1);
+    }
+    char *end = nullptr;
+    long l = std::strtol(level.c_str(), &end, 10);
+    if (level.empty() || *end != '\0' || l < 1 || l > 9) return false;
+    using Algo = ROOT::RCompressionSetting::EAlgorithm;
+    Algo::EValues a;
+    if (algo == "zstd")      a = Algo::kZSTD;
+    else if (algo == "lz4")  a = Algo::kLZ4;
+    else if (algo == "zlib") a = Algo::kZLIB;
+    else if (algo == "lzma") a = Algo::kLZMA;
+    else return false;
+    settings = ROOT::CompressionSettings(a, static_cast<int>(l));
+    return true;
+}
+
+bool endsWithRoot(const std::string &name) {
+    return name.size() >= 5 &&
+           (name.substr(name.size() - 5) == ".root" ||
+            name.substr(name.size() - 5) == ".ROOT");
+}
+
+// Expands directories (to their *.csv files) and glob patterns
+std::vector<std::string> expandInputs(const std::vector<std::string> &args) {
+    std::vector<std::string> files;
+    for (const auto &arg : args) {
+        struct stat st;
+        std::string pattern;
+        if (::stat(arg.c_str(), &st) == 0 && S_ISDIR(st.st_mode))
+            pattern = arg + "/*.csv";
+        else if (arg.find_first_of("*?[") != std::string::npos)
+            pattern = arg;
+        else {
+            files.push_back(arg);
+            continue;
+        }
+        glob_t g;
+        if (::glob(pattern.c_str(), 0, nullptr, &g) == 0) {
+            for (size_t i = 0; i < g.gl_pathc; ++i)
+                files.push_back(g.gl_pathv[i]);
+        } else {
+            std::cerr << "Warning: no input files match " << pattern << std::endl;
+        }
+        ::globfree(&g);
+    }
+    return files;
+}
+
+// ROOT directory name for a scan: file stem with unsafe characters replaced
+std::string scanDirectoryName(const std::string &path, std::set<std::string> &used) {
+    std::string stem = path.substr(path.find_last_of('/') + 1);
+    size_t dot = stem.find_last_of('.');
+    if (dot != std::string::npos && dot > 0) stem = stem.substr(0, dot);
+    for (char &c : stem)
+        if (!std::isalnum(static_cast<unsigned char>(c)) && c != '_' && c != '-') c = '_';
+    if (stem.empty()) stem = "scan";
+    std::string name = stem;
+    for (int k = 2; used.count(name); ++k) name = stem + "_" + std::to_string(k);
+    used.insert(name);
+    return name;
+}
+
+//------------------------------------------------------------------------------
+// runMultiScan()
+//   One scan per task on a worker pool.  ROOT objects are created detached
+//   (TH1::AddDirectory(kFALSE)) inside each task; writes to the shared
+//   output file are serialized.  With opt.splitOutput every scan gets its
+//   own <input stem>.root next to the input instead of a directory.
+//------------------------------------------------------------------------------
+
+int runMultiScan(const std::vector<std::string> &inputs, const std::string &outname,
+                 const Options &opt) {
+    ROOT::EnableThreadSafety();
+    TH1::AddDirectory(kFALSE);
+
+    std::unique_ptr<TFile> outfile;
+    if (!opt.splitOutput) {
+        outfile.reset(new TFile(outname.c_str(), "RECREATE", "", opt.compression));
+        if (outfile->IsZombie()) {
+            std::cerr << "Error: cannot create " << outname << std::endl;
+            return 1;
+        }
+    }
+
+    std::set<std::string> used;
+    std::vector<std::string> dirNames;
+    for (const auto &in : inputs) dirNames.push_back(scanDirectoryName(in, used));
+
+    std::vector<ScanResult> results(inputs.size());
+    std::vector<char> ok(inputs.size(), 0);
+    std::mutex ioMutex;
+
+    unsigned nThreads = opt.jobs > 0 ? opt.jobs : ThreadPool::defaultThreads();
+    cout << "Processing " << inputs.size() << " scans on " << nThreads << " threads" << endl;
+    {
+        ThreadPool pool(nThreads);
+        for (size_t k = 0; k < inputs.size(); ++k) {
+            pool.submit([&, k] {
+                std::ostringstream log;
+                log << "\n=== " << inputs[k] << " ===\n";
+                ScanResult &r = results[k];
+                r.input = inputs[k];
+                if (opt.profile) r.profile = std::make_shared<Profiler::Profile>();
+                ScanInput in;
+                bool good = runScan(inputs[k], opt, in, r, log);
+                const PointView *points = opt.tree ? &in.view : nullptr;
+
+                Profiler::Scope stage(r.profile.get(), "write");
+                if (good && opt.splitOutput) {
+                    std::string stem = inputs[k];
+                    size_t dot = stem.find_last_of('.');
+                    if (dot != std::string::npos && stem.find('/', dot) == std::string::npos)
+                        stem = stem.substr(0, dot);
+                    r.output = stem + ".root";
+                    TFile f(r.output.c_str(), "RECREATE", "", opt.compression);
+                    writeScan(&f, r, points);
+                    f.Close();
+                }
+
+                std::lock_guard<std::mutex> lock(ioMutex);
+                if (good && !opt.splitOutput) {
+                    TDirectory *dir = outfile->mkdir(dirNames[k].c_str());
+                    writeScan(dir, r, points);
+                    r.output = outname + ":" + dirNames[k];
+                }
+                releaseObjects(r);
+                stage.stop();
+                if (good && r.profile) r.profile->print(log);
+                ok[k] = good;
+                cout << log.str() << std::flush;
+            });
+        }
+        pool.wait();
+    }
+
+    if (outfile) outfile->Close();
+
+    size_t nGood = 0;
+    for (char g : ok) nGood += g ? 1 : 0;
+    cout << "\n" << nGood << " of " << inputs.size() << " scans analyzed";
+    if (outfile) cout << ", written to " << outname;
+    cout << endl;
+
+    if (!opt.summaryFile.empty()) {
+        std::ofstream js(opt.summaryFile);
+        if (!js) {
+            std::cerr << "Error: cannot write summary " << opt.summaryFile << std::endl;
+            return 1;
+        }
+        js << "[\n";
+        bool first = true;
+        for (size_t k = 0; k < inputs.size(); ++k) {
+            if (!ok[k]) continue;
+            if (!first) js << ",\n";
+            writeSummaryJson(js, results[k], results[k].output);
+            first = false;
+        }
+        js << "]\n";
+        cout << "Summary written to " << opt.summaryFile << endl;
+    }
+    return nGood == inputs.size() ? 0 : 1;
+}
+
+//------------------------------------------------------------------------------
+// runCompare()
+//   --compare[=grid|label]: drift of repeated scans of one surface.  The
+//   first input is the reference: it is read whole once, for its grid and
+//   (label matching) the cell of every label.  Every other input is
+//   streamed once in chunks, on the worker pool, into a per-scan
+//   FlatnessMap on that grid and folded into the per-cell temporal
+//   accumulators of a DriftMap (see DriftMap.h), so memory stays at a few
+//   maps per worker whatever the number of scans.  Writes hDriftMean,
+//   hDriftSigma, hDriftDifference (latest − reference) and hDriftScans,
+//   plus gDriftRms / gScanFlatness versus scan index.
+//------------------------------------------------------------------------------
+
+const size_t kCompareChunkBytes = size_t(8) << 20;   // per worker, unless --stream=<MB>
+
+int runCompare(const std::vector<std::string> &inputs, const std::string &outname,
+               const Options &opt) {
+    const bool byLabel = opt.compare == "label";
+    ScanInput ref;
+    cout << "\nReference scan: " << inputs[0] << endl;
+    if (!loadScan(inputs[0], opt, ref, cout)) return 1;
+    const PointView &pts = ref.view;
+    if (byLabel && !pts.hasLabels()) {
+        std::cerr << "Error: --compare=label needs point labels in " << inputs[0] << std::endl;
+        return 1;
+    }
+    GridFinder::Result grid = GridFinder::analyze(pts.x.data(), pts.y.data(), pts.size());
+    if (!grid.regularX || !grid.regularY) {
+        std::cerr << "Error: the reference scan is not on a regular grid; --compare needs one."
+                  << std::endl;
+        return 1;
+    }
+
+    // Reference scan, and the reference cell of each label
+    DriftMap drift(grid);
+    std::unordered_map<long, size_t> labelCell;
+    std::vector<DriftMap::ScanStats> stats(inputs.size());
+    std::vector<size_t> unmatched(inputs.size(), 0);
+    std::vector<char> ok(inputs.size(), 0);
+    {
+        FlatnessMap scan = drift.newScan();
+        for (size_t i = 0; i < pts.size(); ++i) {
+            int ix, iy;
+            if (!scan.cell(pts.x[i], pts.y[i], ix, iy)) { ++unmatched[0]; continue; }
+            scan.addCell(scan.index(ix, iy), pts.z[i]);
+            if (byLabel) labelCell.emplace(pts.label[i], scan.index(ix, iy));
+        }
+        stats[0] = drift.fold(scan, 0);
+        ok[0] = 1;
+    }
+    ref = ScanInput();
+
+    const size_t chunkBytes = opt.streamChunkBytes > 0 ? opt.streamChunkBytes : kCompareChunkBytes;
+    unsigned nThreads = opt.jobs > 0 ? opt.jobs : ThreadPool::defaultThreads();
+    cout << "Comparing " << inputs.size() - 1 << " scans with the reference ("
+         << grid.Nx << " × " << grid.Ny << " grid, matched by " << (byLabel ? "label" : "grid cell")
+         << ") on " << nThreads << " threads" << endl;
+    {
+        ThreadPool pool(nThreads);
+        for (size_t k = 1; k < inputs.size(); ++k) {
+            pool.submit([&, k] {
+                ChunkedReader in(inputs[k], chunkBytes);
+                if (!in.ok()) return;
+                FlatnessMap scan = drift.newScan();
+                PointCloud chunk;
+                size_t miss = 0;
+                while (in.next(chunk)) {
+                    const size_t nc = chunk.size();
+                    if (byLabel && !chunk.hasLabels()) { miss += nc; continue; }
+                    for (size_t i = 0; i < nc; ++i) {
+                        if (byLabel) {
+                            auto it = labelCell.find(chunk.label[i]);
+                            if (it == labelCell.end()) ++miss;
+                            else scan.addCell(it->second, chunk.z[i]);
+                        } else if (!scan.add(chunk.x[i], chunk.y[i], chunk.z[i])) {
+                            ++miss;
+                        }
+                    }
+                }
+                stats[k] = drift.fold(scan, k);
+                unmatched[k] = miss;
+                ok[k] = 1;
+            });
+        }
+        pool.wait();
+    }
+
+    {
+        FloatingPointPrecision fpp(cout, 3);
+        cout << "\n  scan  cells  unmatched  flatness [µm]  drift RMS [µm]  input\n";
+        for (size_t k = 0; k < inputs.size(); ++k) {
+            cout << std::setw(6) << k;
+            if (!ok[k]) { cout << "  (unreadable)  " << inputs[k] << "\n"; continue; }
+            cout << std::setw(7) << stats[k].cells << std::setw(11) << unmatched[k]
+                 << std::setw(15) << 1000. * stats[k].rms
+                 << std::setw(16) << 1000. * stats[k].driftRms << "  " << inputs[k] << "\n";
+        }
+        cout << std::flush;
+    }
+
+    // Per-cell maps on the reference grid
+    const char *axes = grid.angle != 0.0 ? ";X' [mm];Y' [mm];" : ";X [mm];Y [mm];";
+    auto book = [&](const char *name, const std::string &title) {
+        TH2D *h = new TH2D(name, (title + axes).c_str(),
+                           grid.Nx, grid.xMin - grid.dx/2, grid.xMax + grid.dx/2,
+                           grid.Ny, grid.yMin - grid.dy/2, grid.yMax + grid.dy/2);
+        h->SetStats(0);
+        return h;
+    };
+    TH2D *hMean = book("hDriftMean", "Temporal mean of plane-removed Z");
+    TH2D *hSigma = book("hDriftSigma", "Temporal #sigma of plane-removed Z");
+    TH2D *hDiff = book("hDriftDifference", "Latest scan #minus reference");
+    TH2D *hScans = book("hDriftScans", "Scans per cell");
+    hMean->GetZaxis()->SetTitle("Z [mm]");
+    hSigma->GetZaxis()->SetTitle("#sigma_{t} [mm]");
+    hDiff->GetZaxis()->SetTitle("#DeltaZ [mm]");
+    hScans->GetZaxis()->SetTitle("scans");
+    double maxSigma = 0.0, maxDiff = 0.0;
+    for (int iy = 0; iy < grid.Ny; ++iy)
+        for (int ix = 0; ix < grid.Nx; ++ix) {
+            size_t c = size_t(ix) + size_t(grid.Nx) * size_t(iy);
+            if (!drift.scans(c)) continue;
+            hMean->SetBinContent(ix + 1, iy + 1, drift.mean(c));
+            hSigma->SetBinContent(ix + 1, iy + 1, drift.sigma(c));
+            hScans->SetBinContent(ix + 1, iy + 1, drift.scans(c));
+            maxSigma = std::max(maxSigma, drift.sigma(c));
+            if (drift.hasDifference(c)) {
+                hDiff->SetBinContent(ix + 1, iy + 1, drift.difference(c));
+                maxDiff = std::max(maxDiff, std::fabs(drift.difference(c)));
+            }
+        }
+
+    TGraph *gDrift = new TGraph();
+    gDrift->SetName("gDriftRms");
+    gDrift->SetTitle("RMS difference from the reference;scan;RMS #DeltaZ [mm]");
+    TGraph *gFlat = new TGraph();
+    gFlat->SetName("gScanFlatness");
+    gFlat->SetTitle("Plane-removed cell-mean RMS;scan;RMS Z [mm]");
+    for (size_t k = 0; k < inputs.size(); ++k) {
+        if (!ok[k]) continue;
+        if (k > 0) gDrift->SetPoint(gDrift->GetN(), k, stats[k].driftRms);
+        gFlat->SetPoint(gFlat->GetN(), k, stats[k].rms);
+    }
+
+    TFile outfile(outname.c_str(), "RECREATE", "", opt.compression);
+    if (outfile.IsZombie()) {
+        std::cerr << "Error: cannot create " << outname << std::endl;
+        return 1;
+    }
+    TNamed versionTag("FlatnessScanVersion", FLATNESS_SCAN_VERSION.c_str());
+    outfile.WriteTObject(&versionTag);
+    for (TObject *o : std::initializer_list<TObject*>{hMean, hSigma, hDiff, hScans, gDrift, gFlat}) {
+        outfile.WriteTObject(o);
+        delete o;
+    }
+    outfile.Close();
+    {
+        FloatingPointPrecision fpp(cout, 3);
+        cout << "\nMax temporal σ = " << 1000. * maxSigma << " µm, max |latest − reference| = "
+             << 1000. * maxDiff << " µm; written to " << outname << endl;
+    }
+
+    if (!opt.summaryFile.empty()) {
+        std::ofstream js(opt.summaryFile);
+        if (!js) {
+            std::cerr << "Error: cannot write summary " << opt.summaryFile << std::endl;
+            return 1;
+        }
+        ScientificPrecision sp(js, 9);
+        js << "{\n"
+           << "  \"version\": \"" << FLATNESS_SCAN_VERSION << "\",\n"
+           << "  \"compare\": \"" << (byLabel ? "label" : "grid") << "\",\n"
+           << "  \"output\": \"" << jsonEscape(outname) << "\",\n"
+           << "  \"grid\": {\"nx\": " << grid.Nx << ", \"ny\": " << grid.Ny
+           << ", \"dx\": " << grid.dx << ", \"dy\": " << grid.dy
+           << ", \"angle_deg\": " << grid.angle * 180.0 / GridFinder::kPi << "},\n"
+           << "  \"max_sigma\": " << maxSigma << ",\n"
+           << "  \"max_abs_difference\": " << maxDiff << ",\n"
+           << "  \"scans\": [";
+        bool first = true;
+        for (size_t k = 0; k < inputs.size(); ++k) {
+            if (!ok[k]) continue;
+            js << (first ? "\n" : ",\n") << "    {\"input\": \"" << jsonEscape(inputs[k])
+               << "\", \"cells\": " << stats[k].cells << ", \"unmatched\": " << unmatched[k]
+               << ", \"plane_removed\": " << (stats[k].planeRemoved ? "true" : "false")
+               << ", \"flatness_rms\": " << stats[k].rms
+               << ", \"drift_rms\": " << stats[k].driftRms << "}";
+            first = false;
+        }
+        js << "\n  ]\n}\n";
+        cout << "Summary written to " << opt.summaryFile << endl;
+    }
+
+    size_t nGood = 0;
+    for (char g : ok) nGood += g ? 1 : 0;
+    return nGood == inputs.size() ? 0 : 1;
+}
+
+//------------------------------------------------------------------------------
+// Command-line options
+//   parseOptions() fills opt from "--option[=value]" arguments (on top of
+//   whatever opt already holds) and collects the positional ones; false on
+//   an unknown option, badOption for a malformed value.  checkOptions()
+//   rejects combinations the pipeline cannot run.  Shared by main() and
+//   the jobs of --serve.
+//------------------------------------------------------------------------------
+
+bool parseOptions(const std::vector<std::string> &args, Options &opt,
+                  std::vector<std::string> &positional, bool &badOption, std::ostream &err) {
+	for (const std::string &arg : args) {
+		if (arg.rfind("--fit=", 0) == 0) {
+			opt.fitEngine = arg.substr(6);
+		} else if (arg.rfind("--binning=", 0) == 0) {
+			badOption |= !Binning::parse(arg.substr(10), opt.binning);
+		} else if (arg.rfind("--max-bins=", 0) == 0) {
+			opt.binning.maxBins = std::atoi(arg.c_str() + 11);
+			badOption |= (opt.binning.maxBins < 1);
+		} else if (arg == "--batch") {
+			opt.batch = true;
+		} else if (arg.rfind("--summary=", 0) == 0) {
+			opt.summaryFile = arg.substr(10);
+		} else if (arg.rfind("--jobs=", 0) == 0) {
+			int j = std::atoi(arg.c_str() + 7);
+			badOption |= (j < 1);
+			opt.jobs = j > 0 ? static_cast<unsigned>(j) : 0;
+		} else if (arg.rfind("--robust=", 0) == 0) {
+			badOption |= !RobustFit::parse(arg.substr(9), opt.robust);
+		} else if (arg == "--stream") {
+			opt.streamChunkBytes = ChunkedReader::kDefaultChunkBytes;
+		} else if (arg.rfind("--stream=", 0) == 0) {
+			int mb = std::atoi(arg.c_str() + 9);
+			badOption |= (mb < 1);
+			opt.streamChunkBytes = size_t(mb > 0 ? mb : 1) << 20;
+		} else if (arg == "--tree") {
+			opt.tree = true;
+		} else if (arg == "--no-cache") {
+			opt.cache = false;
+		} else if (arg == "--no-normals") {
+			opt.normals = false;
+		} else if (arg.rfind("--probe-radius=", 0) == 0) {
+			char *end = nullptr;
+			opt.probeRadius = std::strtod(arg.c_str() + 15, &end);
+			badOption |= (*end != '\0' || end == arg.c_str() + 15 || !std::isfinite(opt.probeRadius));
+		} else if (arg.rfind("--compression=", 0) == 0) {
+			badOption |= !parseCompression(arg.substr(14), opt.compression);
+		} else if (arg == "--follow") {
+			opt.follow = true;
+		} else if (arg.rfind("--follow=", 0) == 0) {
+			opt.follow = true;
+			opt.followIdle = std::atof(arg.c_str() + 9);
+			badOption |= (opt.followIdle < 0);
+		} else if (arg == "--profile") {
+			opt.profile = true;
+		} else if (arg.rfind("--profile=", 0) == 0) {
+			opt.profile = true;
+			opt.profileFile = arg.substr(10);
+		} else if (arg.rfind("--surface=", 0) == 0) {
+			badOption |= !SurfaceFit::parse(arg.substr(10), opt.surface);
+		} else if (arg.rfind("--local=", 0) == 0) {
+			badOption |= !LocalFlatness::parse(arg.substr(8), opt.local);
+		} else if (arg == "--pyramid") {
+			opt.pyramid = true;
+		} else if (arg.rfind("--resample=", 0) == 0) {
+			badOption |= !Resample::parse(arg.substr(11), opt.resample);
+		} else if (arg == "--compare") {
+			opt.compare = "grid";
+		} else if (arg.rfind("--compare=", 0) == 0) {
+			opt.compare = arg.substr(10);
+			badOption |= (opt.compare != "grid" && opt.compare != "label");
+		} else if (arg.rfind("--serve=", 0) == 0) {
+			opt.serve = arg.substr(8);
+			badOption |= opt.serve.empty();
+		} else if (arg == "--split-output") {
+			opt.splitOutput = true;
+		} else if (arg.rfind("--", 0) == 0) {
+			err << "Unknown option: " << arg << std::endl;
+			return false;
+		} else {
+			positional.push_back(arg);
+		}
+	}
+
+	return true;
+}
+
+bool checkOptions(const Options &opt, std::ostream &err) {
+	if (opt.follow && opt.streamChunkBytes > 0) {
+		err << "--follow and --stream cannot be combined." << std::endl;
+		return false;
+	}
+	if ((opt.robust.enabled || opt.tree || opt.resample.enabled || opt.probeRadius != 0.0) &&
+	    opt.streamChunkBytes > 0) {
+		err << (opt.robust.enabled ? "--robust" : opt.tree ? "--tree" :
+		        opt.resample.enabled ? "--resample" : "--probe-radius")
+		    << " needs the points in memory and cannot be combined with --stream." << std::endl;
+		return false;
+	}
+	return true;
+}
+
+//------------------------------------------------------------------------------
+// runServe()
+//   --serve=<spool dir>: long-running server.  ROOT is initialized once and
+//   the process stays up; jobs dropped in the spool directory (see
+//   SpoolDir.h) are claimed while fewer than --jobs are running, analyzed
+//   on the worker pool exactly as a --batch run of the job's arguments
+//   would be, and filed under done/ (summary JSON, with the ROOT file path)
+//   or failed/.  The server's own options are the defaults of every job;
+//   by default a job's ROOT file is done/<job>.root.  SIGINT / SIGTERM stop
+//   claiming and exit once the running jobs are finished.
+//------------------------------------------------------------------------------
+
+const unsigned kServePoll = 200;      // [ms] between scans of the spool directory
+
+volatile std::sig_atomic_t serveStop = 0;
+extern "C" void stopServing(int) { serveStop = 1; }
+
+// One claimed job; false with `error` set if it could not be run
+bool serveJob(const SpoolDir &spool, const std::string &name, const Options &defaults,
+              ScanResult &r, std::ostream &log, std::string &error) {
+    Options opt = defaults;
+    opt.batch = true;
+    opt.jobs = 0;
+    opt.kernelThreads = 1;              // the jobs themselves share the cores
+    opt.splitOutput = false;
+    opt.serve.clear();
+    opt.summaryFile.clear();
+    opt.profileFile.clear();
+
+    std::vector<std::string> positional;
+    bool badOption = false;
+    std::ostringstream err;
+    if (!parseOptions(spool.arguments(name), opt, positional, badOption, err) ||
+        !checkOptions(opt, err)) {
+        error = err.str();
+        if (!error.empty() && error.back() == '\n') error.pop_back();
+        return false;
+    }
+    if (badOption || (opt.fitEngine != "pca" && opt.fitEngine != "minuit")) {
+        error = "malformed option";
+        return false;
+    }
+    if (opt.follow || !opt.compare.empty() || !opt.serve.empty() || opt.jobs || opt.splitOutput ||
+        !opt.summaryFile.empty() || !opt.profileFile.empty()) {
+        error = "--follow, --compare, --serve, --jobs, --split-output, --summary and "
+                "--profile=<file> are not available in a job";
+        return false;
+    }
+    std::vector<std::string> inputs;
+    for (const auto &arg : positional)
+        if (endsWithRoot(arg)) r.output = arg;
+        else inputs.push_back(arg);
+    if (inputs.size() != 1) {
+        error = "a job takes exactly one input file";
+        return false;
+    }
+    r.input = inputs[0];
+    if (r.output.empty()) r.output = spool.resultPath(name, ".root");
+    if (opt.profile) r.profile = std::make_shared<Profiler::Profile>();
+
+    ScanInput in;
+    if (!runScan(r.input, opt, in, r, log)) {
+        error = r.failure.empty() ? "analysis of " + r.input + " failed" : r.failure;
+        releaseObjects(r);
+        return false;
+    }
+    {
+        Profiler::Scope stage(r.profile.get(), "write");
+        TFile f(r.output.c_str(), "RECREATE", "", opt.compression);
+        if (f.IsZombie()) {
+            error = "cannot create " + r.output;
+            releaseObjects(r);
+            return false;
+        }
+        writeScan(&f, r, opt.tree ? &in.view : nullptr);
+        f.Close();
+    }
+    releaseObjects(r);
+    if (r.profile) r.profile->print(log);
+    return true;
+}
+
+int runServe(const Options &opt) {
+    SpoolDir spool(opt.serve);
+    std::string error;
+    if (!spool.open(error)) {
+        std::cerr << "Error: " << error << std::endl;
+        return 1;
+    }
+    ROOT::EnableThreadSafety();
+    gROOT->SetBatch(kTRUE);
+    TH1::AddDirectory(kFALSE);
+    std::signal(SIGINT, stopServing);
+    std::signal(SIGTERM, stopServing);
+
+    const unsigned nThreads = opt.jobs > 0 ? opt.jobs : ThreadPool::defaultThreads();
+    cout << "Serving " << spool.root() << " on " << nThreads
+         << " threads (SIGINT or SIGTERM to stop)" << endl;
+
+    std::atomic<unsigned> running(0);
+    std::atomic<size_t> nDone(0), nFailed(0);
+    std::mutex ioMutex;
+    {
+        ThreadPool pool(nThreads);
+        while (!serveStop) {
+            if (running < nThreads) {
+                for (const std::string &name : spool.pending()) {
+                    if (serveStop || running >= nThreads) break;
+                    if (!spool.claim(name)) continue;      // taken by another server
+                    ++running;
+                    pool.submit([&, name] {
+                        auto t0 = std::chrono::steady_clock::now();
+                        ScanResult r;
+                        std::ostringstream log, json;
+                        std::string why;
+                        bool ok = serveJob(spool, name, opt, r, log, why);
+                        if (ok) {
+                            writeSummaryJson(json, r, r.output);
+                        } else {
+                            json << "{\n  \"version\": \"" << FLATNESS_SCAN_VERSION << "\",\n"
+                                 << "  \"input\": \"" << jsonEscape(r.input) << "\",\n"
+                                 << "  \"error\": \"" << jsonEscape(why) << "\"\n}\n";
+                        }
+                        bool filed = spool.finish(name, ok, json.str(), log.str());
+                        double ms = std::chrono::duration<double, std::milli>(
+                                        std::chrono::steady_clock::now() - t0).count();
+                        {
+                            std::lock_guard<std::mutex> lock(ioMutex);
+                            FloatingPointPrecision fpp(cout, 4);
+                            cout << name << ": " << (ok ? "done" : "failed: " + why)
+                                 << " (" << ms << " ms)" << endl;
+                            if (!filed)
+                                std::cerr << "Error: cannot write the summary of job " << name << std::endl;
+                        }
+                        ++(ok ? nDone : nFailed);
+                        --running;
+                    });
+                }
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(kServePoll));
+        }
+        cout << "\nStopping: waiting for " << running << " running jobs" << endl;
+        pool.wait();
+    }
+    cout << nDone << " jobs done, " << nFailed << " failed" << endl;
+    return 0;
+}
+
+//------------------------------------------------------------------------------
+// Main program
+//------------------------------------------------------------------------------
+
+int main(int argc, char *argv[]) {
+
+// Usage:
+//
+//   ./flatnessScan input.csv [output.root] [--fit=pca|minuit]
+//                  [--binning=fd|um:<width>|bins:<n>] [--max-bins=<n>]
+//                  [--batch] [--summary=<file.json>] [--robust=clip[:K]]
+//                  [--stream[=<MB>]] [--no-cache] [--tree]
+//                  [--compression=zstd|lz4|zlib|lzma[:<level>]|none]
+//                  [--profile[=<file.json>]] [--follow[=<idle s>]]
+//                  [--surface=legendre:<order>]
+//                  [--resample=bootstrap[:K]|jackknife[:G]] [--pyramid]
+//                  [--local=<W>[x<H>][:<tol µm>]] [--probe-radius=<mm>] [--no-normals]
+//   ./flatnessScan reference.csv scan2.csv ... | '<glob>' [output.root]
+//                  --compare[=grid|label] [--jobs=<n>] [--stream=<MB>]
+//   ./flatnessScan in1.csv in2.csv ... | <dir> | '<glob>' [output.root]
+//                  [--jobs=<n>] [--split-output] [options]
+//   ./flatnessScan --serve=<spool dir> [--jobs=<n>] [options]
+//
+//------------------------------------------------------------------------------
+// 1. Parse command-line arguments and initialize ROOT application.
+//------------------------------------------------------------------------------
+////
+// If no output file is specified, defaults to "output.root".
+// If the name given does not end with ".root", the extension is added automatically.
+//
+// --batch skips TApplication, canvases and the GUI event loop: the program
+// writes the ROOT file plus a JSON summary (default <output>.json) and exits.
+//
+// Several inputs (files, directories of *.csv, or quoted glob patterns)
+// imply --batch and are analyzed concurrently, one scan per task; each scan
+// is written to its own directory of the output file, or with
+// --split-output to <input stem>.root.
+//
+// --serve=<spool dir> runs as a server instead: ROOT stays initialized and
+// the jobs dropped in the spool directory are analyzed as they arrive (see
+// runServe(), SpoolDir.h).
+//
+
+	// Separate "--option=value" flags from positional arguments
+	std::vector<std::string> positional;
+	Options opt;
+	bool badOption = false;
+	if (!parseOptions(std::vector<std::string>(argv + 1, argv + argc), opt, positional,
+	                  badOption, std::cerr) ||
+	    !checkOptions(opt, std::cerr))
+		return 1;
+	if ((positional.empty() && opt.serve.empty()) || badOption || (opt.fitEngine != "pca" && opt.fitEngine != "minuit")) {
+		std::cerr << "Usage: " << argv[0]
+		          << " input.csv [output.root] [--fit=pca|minuit]"
+		          << " [--binning=fd|um:<width>|bins:<n>] [--max-bins=<n>]"
+		          << " [--batch] [--summary=<file.json>] [--robust=clip[:K]]"
+		          << " [--stream[=<MB>]] [--no-cache] [--tree]"
+		          << " [--compression=<algo>[:<level>]|none] [--profile[=<file.json>]]"
+		          << " [--follow[=<idle s>]] [--surface=legendre:<order>]"
+		          << " [--resample=bootstrap[:K]|jackknife[:G]] [--pyramid]"
+		          << " [--local=<W>[x<H>][:<tol µm>]] [--probe-radius=<mm>] [--no-normals]\n"
+		          << "       " << argv[0]
+		          << " in1.csv in2.csv ...|<dir>|'<glob>' [output.root]"
+		          << " [--jobs=<n>] [--split-output] [options]\n"
+		          << "       " << argv[0]
+		          << " reference.csv scan2.csv ...|'<glob>' [output.root]"
+		          << " --compare[=grid|label] [--jobs=<n>] [--stream=<MB>]\n"
+		          << "       " << argv[0]
+		          << " --serve=<spool dir> [--jobs=<n>] [options]" << std::endl;
+		return 1;
+	}
+	
+	cout << "\n====================================\n";
+	cout << " FlatnessScan " << FLATNESSSCAN_VERSION << " — Luciano Ristori\n";
+	cout << " Built: " << __DATE__ << " " << __TIME__ << endl;
+	cout << "====================================\n";
+
+	if (!opt.serve.empty()) {
+		if (!positional.empty() || opt.follow || !opt.compare.empty()) {
+			std::cerr << "--serve takes its inputs from the spool directory (no inputs, --follow or --compare)." << std::endl;
+			return 1;
+		}
+		if (opt.profile) Profiler::enableAllocationCounting();
+		return runServe(opt);
+	}
+
+	// The output file is the positional argument ending in ".root"; for
+	// backward compatibility a second argument that is not an existing file
+	// or directory is also taken as the output name.
+	std::string outname = "output.root";
+	std::vector<std::string> inputArgs;
+	for (const auto &arg : positional) {
+		if (endsWithRoot(arg)) outname = arg;
+		else inputArgs.push_back(arg);
+	}
+	struct stat st;
+	if (inputArgs.size() == 2 && ::stat(inputArgs[1].c_str(), &st) != 0 &&
+	    inputArgs[1].find_first_of("*?[") == std::string::npos) {
+		outname = inputArgs[1];
+		inputArgs.pop_back();
+	}
+	std::vector<std::string> inputs = expandInputs(inputArgs);
+	if (inputs.empty()) {
+		std::cerr << "No input files." << std::endl;
+		return 1;
+	}
+	bool multi = inputs.size() > 1 || (inputArgs.size() == 1 && inputArgs[0] != inputs[0]);
+
+	// Append ".root" if missing (case-insensitive)
+	if (!endsWithRoot(outname)) {
+		outname += ".root";
+	}
+	if (multi && opt.follow) {
+		std::cerr << "--follow takes a single input file." << std::endl;
+		return 1;
+	}
+	if (opt.follow && opt.batch && opt.followIdle == 0) {
+		std::cerr << "--follow=0 (no idle timeout) needs the interactive display." << std::endl;
+		return 1;
+	}
+	if (!opt.compare.empty() && inputs.size() < 2) {
+		std::cerr << "--compare needs a reference scan and at least one more." << std::endl;
+		return 1;
+	}
+	if (multi) opt.batch = true;
+	if (opt.profile) Profiler::enableAllocationCounting();
+	if (opt.batch && opt.summaryFile.empty())
+		opt.summaryFile = outname.substr(0, outname.size() - 5) + ".json";
+
+	// One scan at a time may use every core in its kernels; in multi-file
+	// runs the scans themselves are spread over the cores instead.
+	if (!opt.compare.empty()) {
+		gROOT->SetBatch(kTRUE);
+		TH1::AddDirectory(kFALSE);
+		return runCompare(inputs, outname, opt);
+	}
+	if (multi) {
+		gROOT->SetBatch(kTRUE);
+		return runMultiScan(inputs, outname, opt);
+	}
+	std::string filename = inputs[0];
+	opt.kernelThreads = opt.jobs > 0 ? opt.jobs : ThreadPool::defaultThreads();
+
+	// Initialize ROOT GUI (our own options are not meant for TApplication).
+	// In batch mode no application object or graphics system is created.
+	std::unique_ptr<TApplication> app;
+	if (!opt.batch) {
+		int appArgc = 1;
+		app.reset(new TApplication("app", &appArgc, argv));
+	}
+	gROOT->SetBatch(opt.batch ? kTRUE : kFALSE);
+	// Nothing is attached to the output file: writeScan() writes each
+	// object exactly once, then the file is closed.
+	TH1::AddDirectory(kFALSE);
+	if (!opt.batch) ROOT::EnableThreadSafety();
+
+    // 2. Read 3D points from input file (--stream: read in chunks), then
+    //    steps 3-7 of the analysis
+
+    ScanResult result;
+    result.input = filename;
+    result.output = outname;
+    if (opt.profile) result.profile = std::make_shared<Profiler::Profile>();
+
+    ScanInput input;
+    bool analyzed = opt.follow ? followScan(filename, opt, input, result, cout)
+                               : runScan(filename, opt, input, result, cout);
+    if (!analyzed)
+        return 1;
+
+    // 8. Write the output file and display results.  Interactively the file
+    //    is compressed and written on its own thread from detached copies
+    //    while the canvases are drawn; the points (--tree) are read-only.
+
+    const PointView *points = opt.tree ? &input.view : nullptr;
+    auto writeOutput = [&](const ScanResult &r) {
+        Profiler::Scope stage(r.profile.get(), "write");
+        TFile outfile(outname.c_str(), "RECREATE", "", opt.compression);
+        if (outfile.IsZombie()) return false;
+        writeScan(&outfile, r, points);
+        outfile.Close();
+        return true;
+    };
+    bool written = false;
+    if (opt.batch) {
+        written = writeOutput(result);
+    } else {
+        ScanResult copy = cloneObjects(result);
+        std::thread writer([&] {
+            written = writeOutput(copy);
+            releaseObjects(copy);
+        });
+        Profiler::Scope stage(result.profile.get(), "display");
+        displayResults(result, input.view);
+        stage.stop();
+        writer.join();
+    }
+    if (!written) {
+        std::cerr << "Error: cannot create " << outname << std::endl;
+        return 1;
+    }
+
 	//------------------------------------------------------------------------------
 	// 9. Run ROOT GUI loop
 	//------------------------------------------------------------------------------
 	//
-	// Close the output file before entering the interactive ROOT GUI loop.
-	// Canvases remain accessible even after the file is closed.
+	// The output file is already closed; the canvases own the original
+	// (detached) objects and stay alive in the GUI loop.
 	//
 	
-	
 	std::cout << "\nHistograms written to " << outname << std::endl;
-	std::cout << "\nHit ctrl-c to exit" << std:: endl;
-	
-		
-	
-	// detach histograms from file so they survive after outfile.Close()
-	for (TH1D* hist : hists) {
-		hist->SetDirectory(nullptr);
-		hist->Write();
-	}	
-	// detach and write scatter plot
-	g2->Write();
-
-	// write flatness map if present
-	if (hZ) {
-		hZ->SetDirectory(nullptr);
-		hZ->Write();
+	if (!opt.batch)
+		std::cout << "\nHit ctrl-c to exit" << std:: endl;
+
+	if (result.profile)
+		result.profile->print(cout);
+
+	if (!opt.summaryFile.empty()) {
+		std::ofstream js(opt.summaryFile);
+		if (!js) {
+			std::cerr << "Error: cannot write summary " << opt.summaryFile << std::endl;
+			return 1;
+		}
+		writeSummaryJson(js, result, result.output);
+		std::cout << "Summary written to " << opt.summaryFile << std::endl;
+	}
+	if (result.profile && !opt.profileFile.empty()) {
+		std::ofstream pj(opt.profileFile);
+		if (!pj) {
+			std::cerr << "Error: cannot write profile " << opt.profileFile << std::endl;
+			return 1;
+		}
+		result.profile->writeJson(pj);
+		pj << "\n";
+		std::cout << "Profile written to " << opt.profileFile << std::endl;
 	}
-		outfile.Close();
 
 	// Enter the ROOT GUI event loop — close all canvases or press Ctrl+C to exit.
 	
-	app.Run();
+	if (app)
+		app->Run();
 	
     return 0;
 }
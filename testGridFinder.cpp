@@ -5,29 +5,32 @@
  * ------------------------------------------------------------
  * Purpose:
  *     Standalone test and demonstration program for GridFinder.h.
- *     Reads (n, X, Y, Z) data from a text or CSV file using
- *     readPoints() and checks whether the (X,Y) coordinates
- *     correspond to a regular rectangular grid.
+ *     Reads a point file with readPointCloud() and checks whether
+ *     the (X,Y) coordinates correspond to a regular rectangular grid.
  *
  * Workflow:
- *     1. Input file lines must contain four numeric values:
- *            n, X, Y, Z
- *        where n is a point index (ignored in analysis).
+ *     1. Input file lines hold one of the layouts of PointCloud.h:
+ *            X Y Z,  n X Y Z,  X Y Z I J K  or  n X Y Z I J K
+ *        where n is a point label (ignored in analysis).
  *
- *     2. The program calls readPoints(filename, 4)
- *        to read all points into a std::vector<Point>.
+ *     2. The program calls readPointCloud(filename); the first data
+ *        line fixes the layout, exactly as in flatnessScan, so both
+ *        programs take X and Y from the same columns.
  *
- *     3. It extracts the second and third coordinates
- *        (X = coords[1], Y = coords[2]) into a vector of pairs (X,Y).
- *
- *     4. The vector is passed to:
- *            GridFinder::analyze(xy, tolFrac, presenceFrac, mergeFrac)
+ *     3. The X and Y columns are passed to:
+ *            GridFinder::analyze(x, y, n, tolFrac, presenceFrac, mergeFrac)
  *
  *        which returns a GridFinder::Result containing:
  *            Nx, Ny, dx, dy, regularX/Y, missingPoints
  *
  * Command line usage:
  *        ./testGridFinder <pointsFile>
+ *        ./testGridFinder --self-test
+ *
+ *     --self-test runs GridFinder on built-in synthetic grids (complete,
+ *     with a stray point, with a band of missing columns, 1000 x 1000
+ *     at 1 mm with CMM-like jitter) and exits non-zero if any result
+ *     differs from the expected one.
  *
  * Example:
  *        ./testGridFinder ASTRAL_GRANITE_VISION_FLATNESS_004.csv
@@ -41,7 +44,7 @@
  *
  * Notes:
  *     - Lines containing text headers or wrong column counts
- *       are skipped automatically by readPoints().
+ *       are skipped automatically by readPointCloud().
  *     - GridFinder tolerates small floating-point differences
  *       (e.g., 29.444 vs 29.445) via mergeStepFraction.
  *     - The output provides a quick diagnostic of grid
@@ -56,38 +59,88 @@
  */
 
 #include <iostream>
+#include <string>
 #include <vector>
-#include <utility>
-#include "Points.h"
+#include <cmath>
+#include <random>
+#include "PointCloud.h"
 #include "GridFinder.h"
 
+// ------------------------------------------------------------
+// selfTest()
+//   Synthetic nx × ny grids; returns the number of failed checks.
+//   Y is always complete, so Ny = ny and regularY are expected too.
+// ------------------------------------------------------------
+static int selfTest() {
+    struct Case {
+        const char *name;
+        int nx, ny;
+        double pitch;                // [mm]
+        double sigma;                // [mm] Gaussian jitter of X and Y
+        double quantum;              // [mm] rounding of the coordinates, 0 = none
+        int skipFrom, skipTo;        // columns [skipFrom, skipTo) left out
+        bool stray;                  // extra point at X = 900
+        bool regular;                // expected regularX
+        int Nx;                      // expected Nx
+    };
+    const Case cases[] = {
+        {"complete 10x10",             10,   10, 10.0, 0,     0,      0,  0, false, true,  10},
+        {"10x10 + stray at X=900",     10,   10, 10.0, 0,     0,      0,  0, true,  false, 11},
+        {"40x10, 20 columns missing",  40,   10, 10.0, 0,     0,     10, 30, false, false, 20},
+        {"1000x1000 at 1 mm, 10 um",   1000, 1000, 1.0, 0.010, 0,     0,  0, false, true,  1000},
+        {"1000x1000 at 1 mm, 5 um, 1 um steps",
+                                       1000, 1000, 1.0, 0.005, 0.001, 0,  0, false, true,  1000},
+    };
+    int failed = 0;
+    std::mt19937 rng(12345);
+    for (const Case &c : cases) {
+        std::normal_distribution<double> jitter(0.0, c.sigma > 0 ? c.sigma : 1.0);
+        auto coordinate = [&](double nominal) {
+            double v = nominal + (c.sigma > 0 ? jitter(rng) : 0.0);
+            return c.quantum > 0 ? std::round(v / c.quantum) * c.quantum : v;
+        };
+        std::vector<double> x, y;
+        for (int iy = 0; iy < c.ny; ++iy)
+            for (int ix = 0; ix < c.nx; ++ix) {
+                if (ix >= c.skipFrom && ix < c.skipTo) continue;
+                x.push_back(coordinate(c.pitch * ix));
+                y.push_back(coordinate(c.pitch * iy));
+            }
+        if (c.stray) { x.push_back(900.0); y.push_back(0.0); }
+        GridFinder::Result res = GridFinder::analyze(x.data(), y.data(), x.size());
+        bool ok = res.regularX == c.regular && res.Nx == c.Nx &&
+                  res.regularY && res.Ny == c.ny;
+        std::cout << (ok ? "ok    " : "FAIL  ") << c.name << ": Nx=" << res.Nx
+                  << " Ny=" << res.Ny << " dx=" << res.dx << " regularX=" << std::boolalpha
+                  << res.regularX << " regularY=" << res.regularY
+                  << " missing=" << res.missingPoints << std::endl;
+        failed += ok ? 0 : 1;
+    }
+    return failed;
+}
+
 int main(int argc, char *argv[]) {
 
+    if (argc >= 2 && std::string(argv[1]) == "--self-test")
+        return selfTest() ? 1 : 0;
+
     if (argc < 2) {
         std::cerr << "Usage: " << argv[0] << " <pointsFile>" << std::endl;
         return 1;
     }
 
     std::string fileName = argv[1];
-    int nCols = 4;  // each line has: n, X, Y, Z
 
     // --- Read all points ---
-    std::vector<Point> points = readPoints(fileName, nCols);
+    PointCloud points = readPointCloud(fileName);
     if (points.empty()) {
         std::cerr << "Error: no points read from file " << fileName << std::endl;
         return 1;
     }
 
-    // --- Extract (X,Y) pairs from coords[1] and coords[2] ---
-    std::vector<std::pair<double,double>> xy;
-    xy.reserve(points.size());
-    for (const auto &p : points) {
-        if (p.coords.size() >= 3)
-            xy.emplace_back(p.coords[1], p.coords[2]);
-    }
-
-    // --- Analyze grid ---
-    GridFinder::Result res = GridFinder::analyze(xy, 0.05, 0.2, 0.10);
+    // --- Analyze grid on the X and Y columns ---
+    GridFinder::Result res = GridFinder::analyze(points.x.data(), points.y.data(),
+                                                 points.size(), 0.05, 0.2, 0.10);
 
     // --- Print results ---
     std::cout << "Analyzed file: " << fileName << std::endl;
@@ -97,6 +150,9 @@ int main(int argc, char *argv[]) {
     std::cout << "Regular X: " << std::boolalpha << res.regularX
               << "   Regular Y: " << res.regularY << std::endl;
     std::cout << "Missing grid points: " << res.missingPoints << std::endl;
+    if (res.angle != 0.0)
+        std::cout << "Grid rotation: " << res.angle * 180.0 / GridFinder::kPi
+                  << " deg" << std::endl;
 
     return 0;
 }